@@ -23,18 +23,56 @@ $GLSLC $SHADER_SRC/reticle.frag -o $SHADER_OUT/reticle_frag.spv
 if [ $? -ne 0 ]; then
 	exit 1
 fi
+$GLSLC $SHADER_SRC/cull.comp -o $SHADER_OUT/cull_comp.spv
+if [ $? -ne 0 ]; then
+	exit 1
+fi
+$GLSLC $SHADER_SRC/trace.comp -o $SHADER_OUT/trace_comp.spv
+if [ $? -ne 0 ]; then
+	exit 1
+fi
+
+# Asset packing
+printf "Packing assets...\n"
+
+gcc -o $BIN/pack src/pack/pack_main.c -I src/ -O2 -lm -lpthread
+if [ $? -ne 0 ]; then
+	exit 1
+fi
+# Asset names are paths relative to the binary, so pack from inside BIN.
+(cd $BIN && ./pack assets.pack shaders/*.spv $(ls textures/*.bmp 2>/dev/null))
+if [ $? -ne 0 ]; then
+	exit 1
+fi
 
 # Executable compilation
 CC=gcc
 EXE=vulkan4d
 SRC=src/xcb/xcb_main.c
 INCLUDE=src/
-LIBS="-lX11 -lX11-xcb -lm -lxcb -lxcb-xfixes -lxcb-keysyms -lvulkan"
+LIBS="-lX11 -lX11-xcb -lm -lxcb -lxcb-xfixes -lxcb-keysyms -lvulkan -lpthread"
 FLAGS="-g -O3 -Wall"
 
 printf "Compiling executable...\n"
 
 $CC -o $BIN/$EXE $SRC -I $INCLUDE $FLAGS $LIBS
+if [ $? -ne 0 ]; then
+	exit 1
+fi
+
+# Headless executable, which needs no window system libraries.
+HEADLESS_SRC=src/headless/headless_main.c
+HEADLESS_LIBS="-lm -lvulkan -lpthread"
+
+$CC -o $BIN/${EXE}_headless $HEADLESS_SRC -I $INCLUDE $FLAGS $HEADLESS_LIBS
+if [ $? -ne 0 ]; then
+	exit 1
+fi
+
+# Benchmark harness, built on the headless platform.
+BENCH_SRC=src/bench/bench_main.c
+
+$CC -o $BIN/${EXE}_bench $BENCH_SRC -I $INCLUDE $FLAGS $HEADLESS_LIBS
 
 if [ $? -eq 0 ]; then
     printf "Compilation was \033[0;32m\033[1msuccessful\033[0m.\n"
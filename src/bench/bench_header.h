@@ -0,0 +1,5 @@
+// Deterministic benchmark harness. Runs scripted scenarios through game_loop
+// and the headless renderer with a fixed dt and seed, and reports frame time
+// percentiles for simulation and rendering as JSON.
+#include "bench_scenarios.c"
+#include "bench_stats.c"
@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "utils/utils_header.h"
+#include "game/game_header.h"
+#include "program_info.c"
+#include "vulkan/vk_header.h"
+#include "headless/headless_header.h"
+#include "bench/bench_header.h"
+
+struct bench_options
+{
+	struct headless_options headless;
+	uint32_t                warmup_len;
+	// Null runs every scenario.
+	const char*             scenario;
+	const char*             out_fname;
+	// Skips Vulkan entirely and only times game_loop.
+	bool                    sim_only;
+	// Job threads, counting the main thread. 0 is one per core.
+	uint32_t                threads_len;
+	// Runs everything at 1, 2, 4... job threads, up to one per core.
+	bool                    scaling;
+};
+
+void print_usage()
+{
+	printf(
+		"Usage: %s_bench [options]\n"
+		"  --scenario NAME   Only run NAME, one of:",
+		PROGRAM_NAME);
+	for(uint32_t i = 0; i < BENCH_SCENARIOS_LEN; i++)
+	{
+		printf(" %s", bench_scenarios[i].name);
+	}
+	printf(
+		"\n"
+		"  --frames N        Measured frames per scenario (default 1000)\n"
+		"  --warmup N        Unmeasured frames before those (default 60)\n"
+		"  --seed N          Seed for the cube field and scripts (default 1)\n"
+		"  --cubes N         Cubes in the field (default %u)\n"
+		"  --width N         Image width (default 480)\n"
+		"  --height N        Image height (default 480)\n"
+		"  --msaa QUALITY    off, low, medium or high (default off)\n"
+		"  --no-reuse        Record every frame instead of reusing command buffers\n"
+		"  --sim-only        Don't render, only time the simulation\n"
+		"  --threads N       Job threads, counting the main thread (default one per core)\n"
+		"  --scaling         Run at 1, 2, 4... job threads, up to one per core\n"
+		"  --out FILE        Where to write the JSON report (default bench.json)\n",
+		CUBES_DEFAULT_LEN);
+}
+
+int32_t main(int32_t argc, char** argv)
+{
+	struct bench_options options = {};
+	options.headless.frames_len           = 1000;
+	options.headless.width                = 480;
+	options.headless.height               = 480;
+	options.headless.ppm_dir              = 0;
+	options.headless.ppm_every            = 1;
+	options.headless.msaa_quality         = VK_MSAA_QUALITY_OFF;
+	options.headless.seed                 = 1;
+	options.headless.cubes_len            = CUBES_DEFAULT_LEN;
+	options.headless.command_buffer_reuse = VK_REUSE_COMMAND_BUFFERS;
+	options.warmup_len                    = 60;
+	options.scenario                      = 0;
+	options.out_fname                     = "bench.json";
+	options.sim_only                      = false;
+	options.threads_len                   = 0;
+	options.scaling                       = false;
+
+	for(int32_t i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if(strcmp(argv[i], "--scenario") == 0 && has_value)
+		{
+			options.scenario = argv[++i];
+		}
+		else if(strcmp(argv[i], "--frames") == 0 && has_value)
+		{
+			options.headless.frames_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--warmup") == 0 && has_value)
+		{
+			options.warmup_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--seed") == 0 && has_value)
+		{
+			options.headless.seed = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--cubes") == 0 && has_value)
+		{
+			options.headless.cubes_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--width") == 0 && has_value)
+		{
+			options.headless.width = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--height") == 0 && has_value)
+		{
+			options.headless.height = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--msaa") == 0 && has_value)
+		{
+			// Auto is left out on purpose, as it changes the sample count partway
+			// through a run.
+			i++;
+			options.headless.msaa_quality = VK_MSAA_QUALITY_LEN;
+			for(uint32_t q = VK_MSAA_QUALITY_OFF; q < VK_MSAA_QUALITY_LEN; q++)
+			{
+				if(strcmp(argv[i], vk_msaa_quality_names[q]) == 0)
+				{
+					options.headless.msaa_quality = q;
+				}
+			}
+			if(options.headless.msaa_quality == VK_MSAA_QUALITY_LEN)
+			{
+				print_usage();
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "--no-reuse") == 0)
+		{
+			options.headless.command_buffer_reuse = false;
+		}
+		else if(strcmp(argv[i], "--sim-only") == 0)
+		{
+			options.sim_only = true;
+		}
+		else if(strcmp(argv[i], "--threads") == 0 && has_value)
+		{
+			options.threads_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--scaling") == 0)
+		{
+			options.scaling = true;
+		}
+		else if(strcmp(argv[i], "--out") == 0 && has_value)
+		{
+			options.out_fname = argv[++i];
+		}
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+
+	if(options.headless.frames_len == 0 || options.headless.width == 0 || options.headless.height == 0 || options.headless.cubes_len == 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	profiler_init(false);
+
+	// Thread counts to run every scenario at.
+	uint32_t threads_lens[JOBS_MAX_THREADS] = {};
+	uint32_t threads_lens_len = 0;
+	if(options.scaling)
+	{
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		uint32_t max_threads = cores < 1 ? 1 : cores > JOBS_MAX_THREADS ? JOBS_MAX_THREADS : cores;
+		for(uint32_t t = 1; t < max_threads; t *= 2)
+		{
+			threads_lens[threads_lens_len++] = t;
+		}
+		threads_lens[threads_lens_len++] = max_threads;
+	}
+	else
+	{
+		threads_lens[threads_lens_len++] = options.threads_len;
+	}
+
+	// The headless context is reused across scenarios, only the game is reset
+	// between them.
+	struct headless_context headless = {};
+	struct m4* sim_only_transforms = 0;
+	if(options.sim_only)
+	{
+		headless.options           = options.headless;
+		headless.memory_pool       = aligned_alloc(64, MEMORY_POOL_BYTES);
+		headless.memory_pool_bytes = MEMORY_POOL_BYTES;
+		sim_only_transforms        = malloc(options.headless.cubes_len * sizeof(struct m4));
+	}
+	else
+	{
+		headless = headless_init(options.headless);
+	}
+
+	uint32_t frames_len = options.headless.frames_len;
+	float* sim_ms    = malloc(frames_len * sizeof(float));
+	float* render_ms = malloc(frames_len * sizeof(float));
+
+	FILE* out = fopen(options.out_fname, "w");
+	if(!out)
+	{
+		printf("Failed to open %s for writing.\n", options.out_fname);
+		return 1;
+	}
+
+	fprintf(out, "{\"program\":\"%s\",\"seed\":%u,\"cubes\":%u,\"frames\":%u,\"warmup\":%u,\"dt\":%.6f,",
+		PROGRAM_NAME,
+		options.headless.seed,
+		options.headless.cubes_len,
+		frames_len,
+		options.warmup_len,
+		BENCH_DT);
+	if(options.sim_only)
+	{
+		fprintf(out, "\"rendering\":false,");
+	}
+	else
+	{
+		fprintf(out, "\"rendering\":true,\"width\":%u,\"height\":%u,\"samples\":%u,\"reuse\":%s,\"device\":\"%s\",",
+			options.headless.width,
+			options.headless.height,
+			headless.vk.render_samples,
+			headless.vk.reuse.enabled ? "true" : "false",
+			headless.vk.physical_device_properties.deviceName);
+	}
+	fprintf(out, "\"scenarios\":[");
+
+	bool first = true;
+	for(uint32_t t = 0; t < threads_lens_len; t++)
+	{
+		jobs_init(threads_lens[t]);
+		uint32_t threads_len = jobs_threads_len();
+
+		for(uint32_t s = 0; s < BENCH_SCENARIOS_LEN; s++)
+		{
+			struct bench_scenario* scenario = &bench_scenarios[s];
+			if(options.scenario && strcmp(options.scenario, scenario->name) != 0)
+			{
+				continue;
+			}
+
+			game_init(headless.memory_pool, headless.memory_pool_bytes, options.headless.seed, options.headless.cubes_len);
+			memset(&headless.input, 0, sizeof(headless.input));
+			headless.time_since_start = 0;
+
+			uint64_t submitted_total = 0;
+			uint64_t culled_total    = 0;
+			uint64_t dropped_total   = 0;
+			for(uint32_t frame = 0; frame < options.warmup_len + frames_len; frame++)
+			{
+				input_reset_buttons(&headless.input);
+				headless.input.mouse_delta_x = 0;
+				headless.input.mouse_delta_y = 0;
+				scenario->script(frame, options.headless.seed, &headless.input);
+				headless.time_since_start += BENCH_DT;
+
+				uint64_t t0 = profiler_now_ns();
+				if(options.sim_only)
+				{
+					headless.render_group.cube_transforms          = sim_only_transforms;
+					headless.render_group.cube_transforms_capacity = options.headless.cubes_len;
+					headless.render_group.cube_transforms_len      = 0;
+				}
+				else
+				{
+					vk_begin_frame(&headless.vk, &headless.render_group);
+				}
+
+				uint64_t t1 = profiler_now_ns();
+				game_loop(
+					headless.memory_pool,
+					headless.memory_pool_bytes,
+					BENCH_DT,
+					options.headless.width,
+					options.headless.height,
+					&headless.input,
+					&headless.render_group);
+				headless.render_group.t = headless.time_since_start / 4.0f;
+
+				uint64_t t2 = profiler_now_ns();
+				if(!options.sim_only)
+				{
+					vk_loop(&headless.vk, &headless.render_group);
+				}
+				uint64_t t3 = profiler_now_ns();
+
+				if(frame >= options.warmup_len)
+				{
+					uint32_t i = frame - options.warmup_len;
+					sim_ms[i]    = (t2 - t1) / 1000000.0f;
+					render_ms[i] = ((t1 - t0) + (t3 - t2)) / 1000000.0f;
+					submitted_total += headless.render_group.cube_visibility.submitted_len;
+					culled_total    += headless.render_group.cube_visibility.culled_len;
+					dropped_total   += headless.render_group.cube_visibility.dropped_len;
+				}
+			}
+
+			// Don't let one scenario's frames in flight land in the next one's.
+			if(!options.sim_only)
+			{
+				vkDeviceWaitIdle(headless.vk.device);
+			}
+
+			struct bench_stats sim    = bench_stats_compute(sim_ms, frames_len);
+			struct bench_stats render = bench_stats_compute(render_ms, frames_len);
+
+			fprintf(out, "%s{\"name\":\"%s\",\"threads\":%u,", first ? "" : ",", scenario->name, threads_len);
+			bench_stats_write(out, "simulation", &sim);
+			if(!options.sim_only)
+			{
+				fprintf(out, ",");
+				bench_stats_write(out, "rendering", &render);
+			}
+			fprintf(out, ",\"visibility\":{\"submitted\":%.1f,\"culled\":%.1f,\"dropped\":%.1f}}",
+				(double)submitted_total / frames_len,
+				(double)culled_total / frames_len,
+				(double)dropped_total / frames_len);
+			first = false;
+
+			printf("%-6s %2u threads, sim p50 %.3fms p99 %.3fms", scenario->name, threads_len, sim.p50_ms, sim.p99_ms);
+			if(!options.sim_only)
+			{
+				printf(", render p50 %.3fms p99 %.3fms", render.p50_ms, render.p99_ms);
+			}
+			printf("\n");
+		}
+
+		jobs_deinit();
+	}
+
+	fprintf(out, "]}\n");
+	fclose(out);
+
+	if(first)
+	{
+		printf("No scenario named %s.\n", options.scenario);
+		print_usage();
+		return 1;
+	}
+
+	if(!options.sim_only)
+	{
+		vk_deinit(&headless.vk);
+	}
+
+	printf("Wrote %s.\n", options.out_fname);
+	return 0;
+}
@@ -0,0 +1,54 @@
+// Fixed, so simulation work per frame doesn't depend on how fast frames run.
+#define BENCH_DT (1.0f / 60.0f)
+
+// Scripts fill in the whole input state for a frame from nothing but the
+// frame number and seed, so every run sees the same stream.
+typedef void (*bench_script)(uint32_t frame, uint32_t seed, struct input_state* input);
+
+struct bench_scenario
+{
+	const char*  name;
+	bench_script script;
+};
+
+// Camera never moves.
+void bench_script_idle(uint32_t frame, uint32_t seed, struct input_state* input)
+{
+}
+
+// Constant turn, so cubes are continually entering and leaving the frustum.
+void bench_script_pan(uint32_t frame, uint32_t seed, struct input_state* input)
+{
+	input->mouse_delta_x = 8;
+}
+
+// Slow figure of eight, looking well off the direction of travel.
+void bench_script_sweep(uint32_t frame, uint32_t seed, struct input_state* input)
+{
+	float t = frame * BENCH_DT;
+	input->mouse_delta_x = (int32_t)roundf(20.0f * sinf(t * 0.8f));
+	input->mouse_delta_y = (int32_t)roundf(10.0f * sinf(t * 1.6f));
+}
+
+// Large random flicks, from a hash of the frame so it doesn't touch rand()
+// and the game's own random stream.
+void bench_script_flick(uint32_t frame, uint32_t seed, struct input_state* input)
+{
+	uint32_t h = (frame / 15) * 2654435761u ^ seed * 2246822519u;
+	h ^= h >> 15;
+	h *= 2246822519u;
+	h ^= h >> 13;
+	input->mouse_delta_x = (int32_t)(h % 81) - 40;
+	input->mouse_delta_y = (int32_t)((h >> 8) % 41) - 20;
+	input->move_forward.held = (h >> 16) & 1;
+}
+
+struct bench_scenario bench_scenarios[] = 
+{
+	{ "idle",  bench_script_idle  },
+	{ "pan",   bench_script_pan   },
+	{ "sweep", bench_script_sweep },
+	{ "flick", bench_script_flick },
+};
+
+#define BENCH_SCENARIOS_LEN (sizeof(bench_scenarios) / sizeof(bench_scenarios[0]))
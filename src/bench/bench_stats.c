@@ -0,0 +1,59 @@
+struct bench_stats
+{
+	float mean_ms;
+	float p50_ms;
+	float p95_ms;
+	float p99_ms;
+	float max_ms;
+};
+
+int bench_compare_ms(const void* a, const void* b)
+{
+	float fa = *(const float*)a;
+	float fb = *(const float*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+// Nearest rank on sorted samples.
+float bench_percentile(float* sorted, uint32_t len, float p)
+{
+	uint32_t rank = (uint32_t)ceilf(p / 100.0f * len);
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Sorts samples in place.
+struct bench_stats bench_stats_compute(float* samples, uint32_t len)
+{
+	struct bench_stats stats = {};
+	if(len == 0)
+	{
+		return stats;
+	}
+
+	qsort(samples, len, sizeof(float), bench_compare_ms);
+
+	double sum = 0;
+	for(uint32_t i = 0; i < len; i++)
+	{
+		sum += samples[i];
+	}
+
+	stats.mean_ms = sum / len;
+	stats.p50_ms  = bench_percentile(samples, len, 50);
+	stats.p95_ms  = bench_percentile(samples, len, 95);
+	stats.p99_ms  = bench_percentile(samples, len, 99);
+	stats.max_ms  = samples[len - 1];
+	return stats;
+}
+
+void bench_stats_write(FILE* file, const char* name, struct bench_stats* stats)
+{
+	fprintf(file, 
+		"\"%s\":{\"mean_ms\":%.4f,\"p50_ms\":%.4f,\"p95_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f}",
+		name,
+		stats->mean_ms,
+		stats->p50_ms,
+		stats->p95_ms,
+		stats->p99_ms,
+		stats->max_ms);
+}
@@ -9,3 +9,24 @@ void sync_camera_directions(struct v3* forward, struct v3* right, float yaw, flo
 	struct v3 cam_up = {{{0, 1, 0}}};
 	*right = v3_normalize(v3_cross(*forward, cam_up));
 }
+
+// Direction from the camera through a point in normalized device coordinates,
+// for the same projection the renderer uses. Vulkan's y points down the
+// screen, so positive y is below the camera's forward.
+struct v3 camera_ray_through_ndc(
+	struct v3 forward,
+	struct v3 right,
+	float     fov_y_degrees,
+	float     aspect,
+	struct v2 ndc)
+{
+	struct v3 up = v3_cross(right, forward);
+
+	float tan_half_y = tanf(radians(fov_y_degrees) / 2);
+	float tan_half_x = tan_half_y * aspect;
+
+	struct v3 direction = forward;
+	direction = v3_add(direction, v3_scale(right, ndc.x * tan_half_x));
+	direction = v3_add(direction, v3_scale(up,   -ndc.y * tan_half_y));
+	return v3_normalize(direction);
+}
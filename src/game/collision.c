@@ -0,0 +1,552 @@
+// Collision queries against the cube field, for shooting cubes and for cubes
+// running into the camera.
+//
+// The broadphase is a uniform grid of COLLISION_CELL_SIZE cells, hashed into a
+// fixed table of buckets so it covers all of space however far the field
+// drifts. A cube goes into every cell its bounding sphere's box overlaps,
+// which is at most two per axis as cells are wider than the sphere. Hash
+// collisions and those duplicates only cost extra candidates, which the
+// narrowphase throws out.
+//
+// cubes_update moves every cube by the same step, so rather than rebuilding
+// the grid each frame, cubes are filed by where they are relative to the sum
+// of those steps, which doesn't change. Only cubes which respawned move
+// between cells. The sum is rebased once it gets far enough out to cost
+// precision, which means one full rebuild.
+//
+// The narrowphase tests a ray against four oriented cubes at once when SSE is
+// available, and only works out the face hit for the ones which pass.
+
+#define COLLISION_CELL_SIZE 2.0f
+// Unit cubes, centred on their position.
+#define COLLISION_CUBE_HALF_EXTENT 0.5f
+// Cubes are filed as slightly larger than their bounding sphere, to cover the
+// difference between their own accumulated steps and the grid's. Must leave
+// the sphere's box no wider than a cell.
+#define COLLISION_FILE_RADIUS (CUBE_BOUNDING_RADIUS + 0.05f)
+// How far the grid's sum of steps can get from the origin before rebasing.
+#define COLLISION_REBASE_DISTANCE 1024.0f
+// Candidates gathered from the grid before they're tested together.
+#define COLLISION_BATCH_LEN 64
+#define COLLISION_NONE UINT32_MAX
+
+void collision_grid_init(struct collision_grid* grid, uint32_t cubes_len, struct game_arena* arena)
+{
+	grid->buckets_len = 64;
+	while(grid->buckets_len < cubes_len * 4)
+	{
+		grid->buckets_len *= 2;
+	}
+	grid->bucket_heads = game_arena_push(arena, grid->buckets_len * sizeof(uint32_t));
+	grid->node_next    = game_arena_push(arena, cubes_len * 8 * sizeof(uint32_t));
+	grid->node_prev    = game_arena_push(arena, cubes_len * 8 * sizeof(uint32_t));
+	grid->node_bucket  = game_arena_push(arena, cubes_len * 8 * sizeof(uint32_t));
+}
+
+int32_t collision_cell(float x)
+{
+	return (int32_t)floorf(x / COLLISION_CELL_SIZE);
+}
+
+uint32_t collision_bucket(struct collision_grid* grid, int32_t x, int32_t y, int32_t z)
+{
+	uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u;
+	return h & (grid->buckets_len - 1);
+}
+
+// Files a cube under every cell it overlaps, as node cube * 8 + k for the kth.
+void collision_grid_insert(struct collision_grid* grid, struct cube_streams* cubes, uint32_t cube)
+{
+	float px = cubes->position_x[cube] - grid->drift.x;
+	float py = cubes->position_y[cube] - grid->drift.y;
+	float pz = cubes->position_z[cube] - grid->drift.z;
+	int32_t min_x = collision_cell(px - COLLISION_FILE_RADIUS);
+	int32_t min_y = collision_cell(py - COLLISION_FILE_RADIUS);
+	int32_t min_z = collision_cell(pz - COLLISION_FILE_RADIUS);
+	int32_t max_x = collision_cell(px + COLLISION_FILE_RADIUS);
+	int32_t max_y = collision_cell(py + COLLISION_FILE_RADIUS);
+	int32_t max_z = collision_cell(pz + COLLISION_FILE_RADIUS);
+
+	uint32_t node = cube * 8;
+	for(int32_t z = min_z; z <= max_z; z++)
+	for(int32_t y = min_y; y <= max_y; y++)
+	for(int32_t x = min_x; x <= max_x; x++)
+	{
+		uint32_t bucket = collision_bucket(grid, x, y, z);
+		uint32_t head = grid->bucket_heads[bucket];
+		grid->node_next[node]   = head;
+		grid->node_prev[node]   = COLLISION_NONE;
+		grid->node_bucket[node] = bucket;
+		if(head != COLLISION_NONE)
+		{
+			grid->node_prev[head] = node;
+		}
+		grid->bucket_heads[bucket] = node;
+		node++;
+	}
+	for(; node < cube * 8 + 8; node++)
+	{
+		grid->node_bucket[node] = COLLISION_NONE;
+	}
+}
+
+void collision_grid_remove(struct collision_grid* grid, uint32_t cube)
+{
+	for(uint32_t node = cube * 8; node < cube * 8 + 8; node++)
+	{
+		uint32_t bucket = grid->node_bucket[node];
+		if(bucket == COLLISION_NONE)
+		{
+			break;
+		}
+		uint32_t next = grid->node_next[node];
+		uint32_t prev = grid->node_prev[node];
+		if(prev == COLLISION_NONE)
+		{
+			grid->bucket_heads[bucket] = next;
+		}
+		else
+		{
+			grid->node_next[prev] = next;
+		}
+		if(next != COLLISION_NONE)
+		{
+			grid->node_prev[next] = prev;
+		}
+	}
+}
+
+void collision_grid_rebuild(struct collision_grid* grid, struct cube_streams* cubes)
+{
+	PROFILE_ZONE("collision_grid_rebuild");
+
+	grid->drift = v3_zero();
+	memset(grid->bucket_heads, 0xff, grid->buckets_len * sizeof(uint32_t));
+	for(uint32_t i = 0; i < cubes->len; i++)
+	{
+		collision_grid_insert(grid, cubes, i);
+	}
+}
+
+// Must follow every cubes_update, whose step and respawn scratch it reads.
+void collision_grid_update(struct collision_grid* grid, struct cube_streams* cubes)
+{
+	PROFILE_ZONE("collision_grid_update");
+
+	grid->drift = v3_add(grid->drift, cubes->step);
+	if(v3_dot(grid->drift, grid->drift) > COLLISION_REBASE_DISTANCE * COLLISION_REBASE_DISTANCE)
+	{
+		collision_grid_rebuild(grid, cubes);
+		return;
+	}
+
+	for(uint32_t begin = 0; begin < cubes->len; begin += CUBES_UPDATE_GRAIN)
+	{
+		uint32_t* respawn = cubes->respawn_indices + begin;
+		uint32_t respawn_len = cubes->respawn_lens[begin / CUBES_UPDATE_GRAIN];
+		for(uint32_t i = 0; i < respawn_len; i++)
+		{
+			collision_grid_remove(grid, respawn[i]);
+			collision_grid_insert(grid, cubes, respawn[i]);
+		}
+	}
+}
+
+// Moves v into the space of a cube with orientation q, i.e. rotates it by the
+// conjugate of q.
+struct v3 collision_to_local(versor q, struct v3 v)
+{
+	versor inverse = {-q[0], -q[1], -q[2], q[3]};
+	struct v3 local;
+	glm_quat_rotatev(inverse, v.data, local.data);
+	return local;
+}
+
+// Tests one cube, and takes the place of whatever's in hit if it's nearer than
+// hit->distance.
+void collision_ray_cube(
+	struct cube_streams*  cubes,
+	uint32_t              cube,
+	struct v3             origin,
+	struct v3             dir,
+	struct collision_hit* hit)
+{
+	// Bounding sphere first, which is much cheaper than building the
+	// orientation.
+	struct v3 position = {{{cubes->position_x[cube], cubes->position_y[cube], cubes->position_z[cube]}}};
+	struct v3 offset = v3_sub(position, origin);
+	float along = v3_dot(offset, dir);
+	if(along + CUBE_BOUNDING_RADIUS < 0 ||
+	   along - CUBE_BOUNDING_RADIUS >= hit->distance ||
+	   v3_dot(offset, offset) - along * along > CUBE_BOUNDING_RADIUS * CUBE_BOUNDING_RADIUS)
+	{
+		return;
+	}
+
+	versor q;
+	cube_orientation(cubes, cube, q);
+	struct v3 local_origin = collision_to_local(q, v3_scale(offset, -1));
+	struct v3 local_dir    = collision_to_local(q, dir);
+
+	// Slabs, keeping track of which one the ray enters last.
+	float near = -INFINITY;
+	float far  = INFINITY;
+	uint32_t near_axis = 0;
+	for(uint32_t axis = 0; axis < 3; axis++)
+	{
+		float o = local_origin.data[axis];
+		float d = local_dir.data[axis];
+		if(d == 0)
+		{
+			if(o < -COLLISION_CUBE_HALF_EXTENT || o > COLLISION_CUBE_HALF_EXTENT)
+			{
+				return;
+			}
+			continue;
+		}
+
+		float t0 = (-COLLISION_CUBE_HALF_EXTENT - o) / d;
+		float t1 = ( COLLISION_CUBE_HALF_EXTENT - o) / d;
+		if(t0 > t1)
+		{
+			float t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+		if(t0 > near)
+		{
+			near      = t0;
+			near_axis = axis;
+		}
+		if(t1 < far)
+		{
+			far = t1;
+		}
+	}
+
+	if(near > far || far < 0)
+	{
+		return;
+	}
+	float distance = near > 0 ? near : 0;
+	if(distance >= hit->distance)
+	{
+		return;
+	}
+
+	struct v3 local_normal = v3_zero();
+	if(near > 0)
+	{
+		local_normal.data[near_axis] = local_dir.data[near_axis] > 0 ? -1 : 1;
+	}
+	else
+	{
+		// Starting inside, so the only sensible face is the one facing back
+		// along the ray.
+		local_normal = v3_scale(local_dir, -1);
+	}
+
+	hit->hit      = true;
+	hit->cube     = cube;
+	hit->distance = distance;
+	glm_quat_rotatev(q, local_normal.data, hit->normal.data);
+}
+
+// Tests a ray against every listed cube. Until something's hit, hit->distance
+// is how far the ray reaches.
+void collision_ray_cubes(
+	struct cube_streams*  cubes,
+	uint32_t*             candidates,
+	uint32_t              candidates_len,
+	struct v3             origin,
+	struct v3             dir,
+	struct collision_hit* hit)
+{
+	uint32_t i = 0;
+
+#ifdef CGLM_SSE_FP
+	__m128 zero      = _mm_setzero_ps();
+	__m128 extent    = _mm_set1_ps(COLLISION_CUBE_HALF_EXTENT);
+	__m128 radius    = _mm_set1_ps(CUBE_BOUNDING_RADIUS);
+	__m128 radius_sq = _mm_set1_ps(CUBE_BOUNDING_RADIUS * CUBE_BOUNDING_RADIUS);
+	__m128 origin_x  = _mm_set1_ps(origin.x);
+	__m128 origin_y  = _mm_set1_ps(origin.y);
+	__m128 origin_z  = _mm_set1_ps(origin.z);
+	__m128 dir_x     = _mm_set1_ps(dir.x);
+	__m128 dir_y     = _mm_set1_ps(dir.y);
+	__m128 dir_z     = _mm_set1_ps(dir.z);
+
+	for(; i + 4 <= candidates_len; i += 4)
+	{
+		uint32_t a = candidates[i + 0];
+		uint32_t b = candidates[i + 1];
+		uint32_t c = candidates[i + 2];
+		uint32_t d = candidates[i + 3];
+
+		__m128 vx = _mm_sub_ps(origin_x, CUBES_GATHER(cubes->position_x));
+		__m128 vy = _mm_sub_ps(origin_y, CUBES_GATHER(cubes->position_y));
+		__m128 vz = _mm_sub_ps(origin_z, CUBES_GATHER(cubes->position_z));
+		__m128 reach = _mm_set1_ps(hit->distance);
+
+		// Most candidates are only near the ray's cells, and miss even the
+		// bounding spheres, in which case there's no need for orientations.
+		// v points from the cube to the origin, so along is negated.
+		__m128 along = _mm_mul_ps(vx, dir_x);
+		along = glmm_fmadd(vy, dir_y, along);
+		along = glmm_fmadd(vz, dir_z, along);
+		__m128 dist_sq = _mm_mul_ps(vx, vx);
+		dist_sq = glmm_fmadd(vy, vy, dist_sq);
+		dist_sq = glmm_fmadd(vz, vz, dist_sq);
+		dist_sq = glmm_fnmadd(along, along, dist_sq);
+		__m128 spheres = _mm_and_ps(
+			_mm_cmple_ps(dist_sq, radius_sq),
+			_mm_and_ps(
+				_mm_cmple_ps(along, radius),
+				_mm_cmplt_ps(_mm_sub_ps(zero, radius), _mm_add_ps(along, reach))));
+		if(_mm_movemask_ps(spheres) == 0)
+		{
+			continue;
+		}
+
+		__m128 qx, qy, qz, qw;
+		cubes_orientations_ps(cubes, a, b, c, d, &qx, &qy, &qz, &qw);
+		// Rotating by the conjugate takes the ray into each cube's space.
+		qx = _mm_sub_ps(zero, qx);
+		qy = _mm_sub_ps(zero, qy);
+		qz = _mm_sub_ps(zero, qz);
+
+		// v + w * t + q x t, where t = 2 * (q x v), for the origin and then
+		// the direction.
+		__m128 local[2][3];
+		__m128 in[2][3] =
+		{
+			{ vx,    vy,    vz    },
+			{ dir_x, dir_y, dir_z },
+		};
+		for(uint32_t v = 0; v < 2; v++)
+		{
+			__m128 x = in[v][0];
+			__m128 y = in[v][1];
+			__m128 z = in[v][2];
+			__m128 tx = _mm_sub_ps(_mm_mul_ps(qy, z), _mm_mul_ps(qz, y));
+			__m128 ty = _mm_sub_ps(_mm_mul_ps(qz, x), _mm_mul_ps(qx, z));
+			__m128 tz = _mm_sub_ps(_mm_mul_ps(qx, y), _mm_mul_ps(qy, x));
+			tx = _mm_add_ps(tx, tx);
+			ty = _mm_add_ps(ty, ty);
+			tz = _mm_add_ps(tz, tz);
+			local[v][0] = _mm_add_ps(glmm_fmadd(qw, tx, x), _mm_sub_ps(_mm_mul_ps(qy, tz), _mm_mul_ps(qz, ty)));
+			local[v][1] = _mm_add_ps(glmm_fmadd(qw, ty, y), _mm_sub_ps(_mm_mul_ps(qz, tx), _mm_mul_ps(qx, tz)));
+			local[v][2] = _mm_add_ps(glmm_fmadd(qw, tz, z), _mm_sub_ps(_mm_mul_ps(qx, ty), _mm_mul_ps(qy, tx)));
+		}
+
+		// Slabs. A zero direction component divides to infinities of the
+		// right sign, except exactly on a face, where the NaN just loses.
+		__m128 near = _mm_set1_ps(-INFINITY);
+		__m128 far  = _mm_set1_ps(INFINITY);
+		for(uint32_t axis = 0; axis < 3; axis++)
+		{
+			__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), local[1][axis]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, extent), local[0][axis]), inv);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(extent, local[0][axis]), inv);
+			near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+			far  = _mm_min_ps(far,  _mm_max_ps(t0, t1));
+		}
+
+		__m128 hits = _mm_and_ps(
+			_mm_cmple_ps(near, far),
+			_mm_and_ps(_mm_cmpge_ps(far, zero), _mm_cmplt_ps(near, reach)));
+		int32_t mask = _mm_movemask_ps(hits);
+
+		// Hits are rare, so the winners get tested again one at a time to
+		// find the face.
+		for(uint32_t j = 0; mask != 0; j++, mask >>= 1)
+		{
+			if(mask & 1)
+			{
+				collision_ray_cube(cubes, candidates[i + j], origin, dir, hit);
+			}
+		}
+	}
+#endif
+
+	// Scalar tail, or everything if SSE isn't available.
+	for(; i < candidates_len; i++)
+	{
+		collision_ray_cube(cubes, candidates[i], origin, dir, hit);
+	}
+}
+
+// Nearest cube along a ray, within max_distance. dir must be normalized.
+struct collision_hit collision_raycast(
+	struct collision_grid* grid,
+	struct cube_streams*   cubes,
+	struct v3              origin,
+	struct v3              dir,
+	float                  max_distance)
+{
+	PROFILE_ZONE("collision_raycast");
+
+	// Until something's hit, distance is how far the ray reaches.
+	struct collision_hit hit = {};
+	hit.distance = max_distance;
+
+	// Walks the cells the ray passes through in order, as in Amanatides and
+	// Woo's "A Fast Voxel Traversal Algorithm". Cells are in the grid's
+	// drifted space, but distances along the ray are the same in both.
+	struct v3 grid_origin = v3_sub(origin, grid->drift);
+	int32_t cell[3];
+	int32_t step[3];
+	float   t_next[3];
+	float   t_delta[3];
+	for(uint32_t axis = 0; axis < 3; axis++)
+	{
+		float o = grid_origin.data[axis];
+		float d = dir.data[axis];
+		cell[axis] = collision_cell(o);
+		if(d > 0)
+		{
+			step[axis]    = 1;
+			t_next[axis]  = ((cell[axis] + 1) * COLLISION_CELL_SIZE - o) / d;
+			t_delta[axis] = COLLISION_CELL_SIZE / d;
+		}
+		else if(d < 0)
+		{
+			step[axis]    = -1;
+			t_next[axis]  = (cell[axis] * COLLISION_CELL_SIZE - o) / d;
+			t_delta[axis] = -COLLISION_CELL_SIZE / d;
+		}
+		else
+		{
+			step[axis]    = 0;
+			t_next[axis]  = INFINITY;
+			t_delta[axis] = INFINITY;
+		}
+	}
+
+	uint32_t batch[COLLISION_BATCH_LEN];
+	float t_enter = 0;
+	while(t_enter <= hit.distance)
+	{
+		uint32_t bucket = collision_bucket(grid, cell[0], cell[1], cell[2]);
+		uint32_t batch_len = 0;
+		for(uint32_t node = grid->bucket_heads[bucket]; node != COLLISION_NONE; node = grid->node_next[node])
+		{
+			batch[batch_len++] = node / 8;
+			if(batch_len == COLLISION_BATCH_LEN)
+			{
+				collision_ray_cubes(cubes, batch, batch_len, origin, dir, &hit);
+				batch_len = 0;
+			}
+		}
+		collision_ray_cubes(cubes, batch, batch_len, origin, dir, &hit);
+
+		uint32_t axis = 0;
+		if(t_next[1] < t_next[axis])
+		{
+			axis = 1;
+		}
+		if(t_next[2] < t_next[axis])
+		{
+			axis = 2;
+		}
+
+		// Every cube the ray meets before leaving this cell is in this cell,
+		// so a hit by then can't be beaten further along.
+		if(hit.hit && hit.distance <= t_next[axis])
+		{
+			break;
+		}
+
+		t_enter       = t_next[axis];
+		cell[axis]   += step[axis];
+		t_next[axis] += t_delta[axis];
+	}
+
+	return hit;
+}
+
+// Nearest cube overlapping a sphere, e.g. one around the camera.
+struct collision_hit collision_overlap_sphere(
+	struct collision_grid* grid,
+	struct cube_streams*   cubes,
+	struct v3              center,
+	float                  radius)
+{
+	PROFILE_ZONE("collision_overlap_sphere");
+
+	// Until something's hit, distance is how far out an overlap can be.
+	struct collision_hit hit = {};
+	hit.distance = radius;
+
+	// The overlap lies in the sphere's cells, and any cube touching it was
+	// filed under every cell it does.
+	struct v3 grid_center = v3_sub(center, grid->drift);
+	int32_t min_x = collision_cell(grid_center.x - radius);
+	int32_t min_y = collision_cell(grid_center.y - radius);
+	int32_t min_z = collision_cell(grid_center.z - radius);
+	int32_t max_x = collision_cell(grid_center.x + radius);
+	int32_t max_y = collision_cell(grid_center.y + radius);
+	int32_t max_z = collision_cell(grid_center.z + radius);
+
+	float reach_sq = (radius + CUBE_BOUNDING_RADIUS) * (radius + CUBE_BOUNDING_RADIUS);
+
+	for(int32_t z = min_z; z <= max_z; z++)
+	for(int32_t y = min_y; y <= max_y; y++)
+	for(int32_t x = min_x; x <= max_x; x++)
+	{
+		uint32_t bucket = collision_bucket(grid, x, y, z);
+		for(uint32_t node = grid->bucket_heads[bucket]; node != COLLISION_NONE; node = grid->node_next[node])
+		{
+			uint32_t cube = node / 8;
+			struct v3 position = {{{cubes->position_x[cube], cubes->position_y[cube], cubes->position_z[cube]}}};
+			struct v3 offset = v3_sub(center, position);
+			if(v3_dot(offset, offset) > reach_sq)
+			{
+				continue;
+			}
+
+			// Closest point on the cube to the centre, in the cube's space.
+			versor q;
+			cube_orientation(cubes, cube, q);
+			struct v3 local = collision_to_local(q, offset);
+			struct v3 closest;
+			for(uint32_t axis = 0; axis < 3; axis++)
+			{
+				closest.data[axis] = f_clamp(local.data[axis], -COLLISION_CUBE_HALF_EXTENT, COLLISION_CUBE_HALF_EXTENT);
+			}
+
+			struct v3 local_normal = v3_sub(local, closest);
+			float distance = v3_magnitude(local_normal);
+			if(distance >= hit.distance)
+			{
+				continue;
+			}
+
+			if(distance > 0)
+			{
+				local_normal = v3_scale(local_normal, 1 / distance);
+			}
+			else
+			{
+				// Centre inside the cube, so push out through the nearest face.
+				uint32_t axis = 0;
+				for(uint32_t a = 1; a < 3; a++)
+				{
+					if(fabsf(local.data[a]) > fabsf(local.data[axis]))
+					{
+						axis = a;
+					}
+				}
+				local_normal = v3_zero();
+				local_normal.data[axis] = local.data[axis] < 0 ? -1 : 1;
+			}
+
+			hit.hit      = true;
+			hit.cube     = cube;
+			hit.distance = distance;
+			glm_quat_rotatev(q, local_normal.data, hit.normal.data);
+		}
+	}
+
+	return hit;
+}
@@ -1,18 +1,430 @@
-void reposition_cube(struct v3* position, mat4 orientation, struct v3 camera_forward, struct v3 camera_right)
+// Batch kernels over struct cube_streams. They run CUBES_LANES cubes at a time,
+// 8 with AVX and 4 with SSE, with a scalar tail for the remainder, or for
+// everything if neither is available.
+#if defined(CGLM_AVX_FP)
+#define CUBES_LANES 8
+#define cubes_vec            __m256
+#define cubes_load(p)        _mm256_loadu_ps(p)
+#define cubes_store(p, a)    _mm256_storeu_ps(p, a)
+#define cubes_set1(x)        _mm256_set1_ps(x)
+#define cubes_add(a, b)      _mm256_add_ps(a, b)
+#define cubes_mul(a, b)      _mm256_mul_ps(a, b)
+#define cubes_fmadd(a, b, c) glmm256_fmadd(a, b, c)
+#define cubes_lt_bits(a, b)  _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))
+#elif defined(CGLM_SSE_FP)
+#define CUBES_LANES 4
+#define cubes_vec            __m128
+#define cubes_load(p)        _mm_loadu_ps(p)
+#define cubes_store(p, a)    _mm_storeu_ps(p, a)
+#define cubes_set1(x)        _mm_set1_ps(x)
+#define cubes_add(a, b)      _mm_add_ps(a, b)
+#define cubes_mul(a, b)      _mm_mul_ps(a, b)
+#define cubes_fmadd(a, b, c) glmm_fmadd(a, b, c)
+#define cubes_lt_bits(a, b)  _mm_movemask_ps(_mm_cmplt_ps(a, b))
+#endif
+
+void cube_streams_init(struct cube_streams* cubes, uint32_t len, struct game_arena* arena)
+{
+	size_t bytes = len * sizeof(float);
+
+	cubes->len           = len;
+	cubes->position_x    = game_arena_push(arena, bytes);
+	cubes->position_y    = game_arena_push(arena, bytes);
+	cubes->position_z    = game_arena_push(arena, bytes);
+	cubes->orientation_x = game_arena_push(arena, bytes);
+	cubes->orientation_y = game_arena_push(arena, bytes);
+	cubes->orientation_z = game_arena_push(arena, bytes);
+	cubes->orientation_w = game_arena_push(arena, bytes);
+	cubes->spin_x        = game_arena_push(arena, bytes);
+	cubes->spin_y        = game_arena_push(arena, bytes);
+	cubes->spin_z        = game_arena_push(arena, bytes);
+	cubes->spawn_phase   = game_arena_push(arena, bytes);
+	cubes->spin_clock    = 0;
+	cubes->step          = v3_zero();
+
+	uint32_t chunks_len = (len + CUBES_UPDATE_GRAIN - 1) / CUBES_UPDATE_GRAIN;
+	cubes->respawn_indices = game_arena_push(arena, len * sizeof(uint32_t));
+	cubes->respawn_lens    = game_arena_push(arena, chunks_len * sizeof(uint32_t));
+}
+
+// Spin is only ever evaluated modulo one full turn. That keeps the half angle
+// of the spin quaternion in [0, pi), since a whole turn only flips its sign.
+#define CUBES_SPIN_PERIOD (360.0f / CUBES_SPIN_SPEED)
+
+void reposition_cube(struct cube_streams* cubes, uint32_t cube, struct v3 camera_forward, struct v3 camera_right)
 {
 	struct v3 camera_up = {{{0, 1, 0}}};
 
-	*position = v3_zero();
-	*position = v3_add(*position, v3_scale(camera_right, rand_t() * (CUBE_POS_MAX_XY * 2) - CUBE_POS_MAX_XY));
-	*position = v3_add(*position, v3_scale(camera_up, rand_t() * (CUBE_POS_MAX_XY * 2) - CUBE_POS_MAX_XY));
-	*position = v3_add(*position, v3_scale(camera_forward, MAX_DRAW_DISTANCE_Z + rand_t() * CUBE_POS_MAX_Z));
+	struct v3 position = v3_zero();
+	position = v3_add(position, v3_scale(camera_right, rand_t() * (CUBE_POS_MAX_XY * 2) - CUBE_POS_MAX_XY));
+	position = v3_add(position, v3_scale(camera_up, rand_t() * (CUBE_POS_MAX_XY * 2) - CUBE_POS_MAX_XY));
+	position = v3_add(position, v3_scale(camera_forward, MAX_DRAW_DISTANCE_Z + rand_t() * CUBE_POS_MAX_Z));
+	cubes->position_x[cube] = position.x;
+	cubes->position_y[cube] = position.y;
+	cubes->position_z[cube] = position.z;
 
-	struct v3 rot = 
+	struct v3 rot =
 	{{{
 		rand_t(),
 		rand_t(),
 		rand_t()
 	}}};
-	glm_mat4_identity(orientation);
-   	glm_rotate(orientation, radians(rand_t() * 180), rot.data);
+	versor orientation;
+	glm_quatv(orientation, radians(rand_t() * 180), rot.data);
+	cubes->orientation_x[cube] = orientation[0];
+	cubes->orientation_y[cube] = orientation[1];
+	cubes->orientation_z[cube] = orientation[2];
+	cubes->orientation_w[cube] = orientation[3];
+	cubes->spawn_phase[cube]   = cubes->spin_clock;
+}
+
+struct cubes_move_job
+{
+	struct cube_streams* cubes;
+	struct v3            step;
+	struct v3            camera_forward;
+};
+
+// Moves cubes [begin, end) by step, and lists the ones which have passed
+// behind the camera in their chunk of the respawn scratch.
+void cubes_move(void* data, uint32_t begin, uint32_t end)
+{
+	PROFILE_ZONE("cubes_move");
+
+	struct cubes_move_job* job = data;
+	struct cube_streams* cubes = job->cubes;
+	struct v3 step = job->step;
+	struct v3 camera_forward = job->camera_forward;
+	uint32_t* respawn = cubes->respawn_indices + begin;
+	uint32_t respawn_len = 0;
+	uint32_t i = begin;
+
+#ifdef CUBES_LANES
+	cubes_vec step_x = cubes_set1(step.x);
+	cubes_vec step_y = cubes_set1(step.y);
+	cubes_vec step_z = cubes_set1(step.z);
+	cubes_vec fwd_x  = cubes_set1(camera_forward.x);
+	cubes_vec fwd_y  = cubes_set1(camera_forward.y);
+	cubes_vec fwd_z  = cubes_set1(camera_forward.z);
+	cubes_vec zero   = cubes_set1(0.0f);
+
+	for(; i + CUBES_LANES <= end; i += CUBES_LANES)
+	{
+		cubes_vec px = cubes_add(cubes_load(cubes->position_x + i), step_x);
+		cubes_vec py = cubes_add(cubes_load(cubes->position_y + i), step_y);
+		cubes_vec pz = cubes_add(cubes_load(cubes->position_z + i), step_z);
+		cubes_store(cubes->position_x + i, px);
+		cubes_store(cubes->position_y + i, py);
+		cubes_store(cubes->position_z + i, pz);
+
+		cubes_vec depth = cubes_mul(px, fwd_x);
+		depth = cubes_fmadd(py, fwd_y, depth);
+		depth = cubes_fmadd(pz, fwd_z, depth);
+		int32_t behind = cubes_lt_bits(depth, zero);
+		for(uint32_t j = 0; behind != 0; j++, behind >>= 1)
+		{
+			if(behind & 1)
+			{
+				respawn[respawn_len++] = i + j;
+			}
+		}
+	}
+#endif
+
+	// Scalar tail, or everything if SIMD isn't available.
+	for(; i < end; i++)
+	{
+		cubes->position_x[i] += step.x;
+		cubes->position_y[i] += step.y;
+		cubes->position_z[i] += step.z;
+
+		float depth =
+			cubes->position_x[i] * camera_forward.x +
+			cubes->position_y[i] * camera_forward.y +
+			cubes->position_z[i] * camera_forward.z;
+		if(depth < 0)
+		{
+			respawn[respawn_len++] = i;
+		}
+	}
+
+	cubes->respawn_lens[begin / CUBES_UPDATE_GRAIN] = respawn_len;
+}
+
+// Moves every cube towards the camera and respawns the ones which have passed
+// behind it. Orientations aren't touched, they're evaluated from the spin
+// clock when transforms are written.
+//
+// Moving is spread across the job system. Respawning draws from rand(), so it
+// happens afterwards on this thread, in index order, which keeps the random
+// sequence, and so the simulation, the same whatever the lane or thread count.
+void cubes_update(
+	struct cube_streams* cubes,
+	uint32_t             cubes_len,
+	struct v3            camera_forward,
+	struct v3            camera_right,
+	float                dt)
+{
+	cubes->spin_clock = fmodf(cubes->spin_clock + dt, CUBES_SPIN_PERIOD);
+
+	cubes->step = v3_scale(camera_forward, -CUBES_MOVE_SPEED * dt);
+
+	struct cubes_move_job job = {};
+	job.cubes          = cubes;
+	job.step           = cubes->step;
+	job.camera_forward = camera_forward;
+	job_parallel_for(cubes_len, CUBES_UPDATE_GRAIN, cubes_move, &job);
+
+	for(uint32_t begin = 0; begin < cubes_len; begin += CUBES_UPDATE_GRAIN)
+	{
+		uint32_t* respawn = cubes->respawn_indices + begin;
+		uint32_t respawn_len = cubes->respawn_lens[begin / CUBES_UPDATE_GRAIN];
+		for(uint32_t i = 0; i < respawn_len; i++)
+		{
+			reposition_cube(cubes, respawn[i], camera_forward, camera_right);
+		}
+	}
+}
+
+#ifdef CGLM_SSE_FP
+// Sine and cosine of each lane, which must be within [-pi/2, pi/2]. Taylor
+// series out far enough to be accurate to float precision over that range.
+void cubes_sincos_ps(__m128 x, __m128* sin_out, __m128* cos_out)
+{
+	__m128 x2 = _mm_mul_ps(x, x);
+
+	__m128 s = _mm_set1_ps(-1.0f / 39916800);
+	s = glmm_fmadd(s, x2, _mm_set1_ps( 1.0f / 362880));
+	s = glmm_fmadd(s, x2, _mm_set1_ps(-1.0f / 5040));
+	s = glmm_fmadd(s, x2, _mm_set1_ps( 1.0f / 120));
+	s = glmm_fmadd(s, x2, _mm_set1_ps(-1.0f / 6));
+	s = glmm_fmadd(s, x2, _mm_set1_ps( 1.0f));
+	*sin_out = _mm_mul_ps(s, x);
+
+	__m128 c = _mm_set1_ps(1.0f / 479001600);
+	c = glmm_fmadd(c, x2, _mm_set1_ps(-1.0f / 3628800));
+	c = glmm_fmadd(c, x2, _mm_set1_ps( 1.0f / 40320));
+	c = glmm_fmadd(c, x2, _mm_set1_ps(-1.0f / 720));
+	c = glmm_fmadd(c, x2, _mm_set1_ps( 1.0f / 24));
+	c = glmm_fmadd(c, x2, _mm_set1_ps(-1.0f / 2));
+	*cos_out = glmm_fmadd(c, x2, _mm_set1_ps(1.0f));
+}
+
+#define CUBES_GATHER(stream) _mm_set_ps(stream[d], stream[c], stream[b], stream[a])
+
+// Current orientations of cubes a, b, c and d, one quaternion component per
+// register. Each is its spawn orientation followed by its spin since spawning.
+void cubes_orientations_ps(
+	struct cube_streams* cubes,
+	uint32_t             a,
+	uint32_t             b,
+	uint32_t             c,
+	uint32_t             d,
+	__m128*              qx,
+	__m128*              qy,
+	__m128*              qz,
+	__m128*              qw)
+{
+	__m128 zero       = _mm_setzero_ps();
+	__m128 clock      = _mm_set1_ps(cubes->spin_clock);
+	__m128 period     = _mm_set1_ps(CUBES_SPIN_PERIOD);
+	__m128 half_speed = _mm_set1_ps(radians(CUBES_SPIN_SPEED) / 2);
+	__m128 half_pi    = _mm_set1_ps(GLM_PI_2f);
+
+	// Half the spin angle, within [0, pi) since the clock and spawn phase are
+	// both within one period. Shifted into [-pi/2, pi/2), its sine is the
+	// shifted cosine, and its cosine the negated shifted sine.
+	__m128 age = _mm_sub_ps(clock, CUBES_GATHER(cubes->spawn_phase));
+	age = _mm_add_ps(age, _mm_and_ps(period, _mm_cmplt_ps(age, zero)));
+	__m128 half_sin, half_cos;
+	cubes_sincos_ps(
+		_mm_sub_ps(_mm_mul_ps(age, half_speed), half_pi),
+		&half_cos,
+		&half_sin);
+	half_cos = _mm_sub_ps(zero, half_cos);
+
+	// Spawn orientation times the spin quaternion.
+	__m128 ox = CUBES_GATHER(cubes->orientation_x);
+	__m128 oy = CUBES_GATHER(cubes->orientation_y);
+	__m128 oz = CUBES_GATHER(cubes->orientation_z);
+	__m128 ow = CUBES_GATHER(cubes->orientation_w);
+	__m128 sx = _mm_mul_ps(CUBES_GATHER(cubes->spin_x), half_sin);
+	__m128 sy = _mm_mul_ps(CUBES_GATHER(cubes->spin_y), half_sin);
+	__m128 sz = _mm_mul_ps(CUBES_GATHER(cubes->spin_z), half_sin);
+
+	*qx = _mm_mul_ps(ow, sx);
+	*qx = glmm_fmadd(ox, half_cos, *qx);
+	*qx = glmm_fmadd(oy, sz, *qx);
+	*qx = glmm_fnmadd(oz, sy, *qx);
+	*qy = _mm_mul_ps(ow, sy);
+	*qy = glmm_fnmadd(ox, sz, *qy);
+	*qy = glmm_fmadd(oy, half_cos, *qy);
+	*qy = glmm_fmadd(oz, sx, *qy);
+	*qz = _mm_mul_ps(ow, sz);
+	*qz = glmm_fmadd(ox, sy, *qz);
+	*qz = glmm_fnmadd(oy, sx, *qz);
+	*qz = glmm_fmadd(oz, half_cos, *qz);
+	*qw = _mm_mul_ps(ow, half_cos);
+	*qw = glmm_fnmadd(ox, sx, *qw);
+	*qw = glmm_fnmadd(oy, sy, *qw);
+	*qw = glmm_fnmadd(oz, sz, *qw);
+}
+#endif
+
+// Current orientation of one cube, as cubes_orientations_ps.
+void cube_orientation(struct cube_streams* cubes, uint32_t cube, versor orientation)
+{
+	float age = cubes->spin_clock - cubes->spawn_phase[cube];
+	if(age < 0)
+	{
+		age += CUBES_SPIN_PERIOD;
+	}
+	vec3 spin_axis = {cubes->spin_x[cube], cubes->spin_y[cube], cubes->spin_z[cube]};
+	versor spin;
+	glm_quatv(spin, age * radians(CUBES_SPIN_SPEED), spin_axis);
+	versor spawn_orientation =
+	{
+		cubes->orientation_x[cube],
+		cubes->orientation_y[cube],
+		cubes->orientation_z[cube],
+		cubes->orientation_w[cube]
+	};
+	glm_quat_mul(spawn_orientation, spin, orientation);
+}
+
+// Writes the transform of each listed cube to transforms, in list order. Each
+// cube's orientation is its spawn orientation followed by its spin since
+// spawning, so orientations are only built for cubes which are submitted, and
+// never accumulate error. Each transform is stored exactly once, since
+// transforms is usually write combined GPU memory.
+void cubes_write_transforms_range(
+	struct cube_streams* cubes,
+	uint32_t*            indices,
+	uint32_t             indices_len,
+	struct m4*           transforms)
+{
+	uint32_t i = 0;
+
+#ifdef CGLM_SSE_FP
+	__m128 zero       = _mm_setzero_ps();
+	__m128 one        = _mm_set1_ps(1.0f);
+	__m128 two        = _mm_set1_ps(2.0f);
+
+	for(; i + 4 <= indices_len; i += 4)
+	{
+		uint32_t a = indices[i + 0];
+		uint32_t b = indices[i + 1];
+		uint32_t c = indices[i + 2];
+		uint32_t d = indices[i + 3];
+
+		__m128 qx, qy, qz, qw;
+		cubes_orientations_ps(cubes, a, b, c, d, &qx, &qy, &qz, &qw);
+
+		// Unit quaternion to rotation matrix, rot[column][row], with the
+		// translation as the fourth column.
+		__m128 x2 = _mm_mul_ps(qx, two);
+		__m128 y2 = _mm_mul_ps(qy, two);
+		__m128 z2 = _mm_mul_ps(qz, two);
+		__m128 xx = _mm_mul_ps(qx, x2);
+		__m128 yy = _mm_mul_ps(qy, y2);
+		__m128 zz = _mm_mul_ps(qz, z2);
+		__m128 xy = _mm_mul_ps(qx, y2);
+		__m128 xz = _mm_mul_ps(qx, z2);
+		__m128 yz = _mm_mul_ps(qy, z2);
+		__m128 wx = _mm_mul_ps(qw, x2);
+		__m128 wy = _mm_mul_ps(qw, y2);
+		__m128 wz = _mm_mul_ps(qw, z2);
+
+		__m128 rot[4][4];
+		rot[0][0] = _mm_sub_ps(one, _mm_add_ps(yy, zz));
+		rot[0][1] = _mm_add_ps(xy, wz);
+		rot[0][2] = _mm_sub_ps(xz, wy);
+		rot[0][3] = zero;
+		rot[1][0] = _mm_sub_ps(xy, wz);
+		rot[1][1] = _mm_sub_ps(one, _mm_add_ps(xx, zz));
+		rot[1][2] = _mm_add_ps(yz, wx);
+		rot[1][3] = zero;
+		rot[2][0] = _mm_add_ps(xz, wy);
+		rot[2][1] = _mm_sub_ps(yz, wx);
+		rot[2][2] = _mm_sub_ps(one, _mm_add_ps(xx, yy));
+		rot[2][3] = zero;
+		rot[3][0] = CUBES_GATHER(cubes->position_x);
+		rot[3][1] = CUBES_GATHER(cubes->position_y);
+		rot[3][2] = CUBES_GATHER(cubes->position_z);
+		rot[3][3] = one;
+
+		// Transposing a column's components across the four cubes gives each
+		// cube's column, which goes out as a single store.
+		for(uint32_t col = 0; col < 4; col++)
+		{
+			__m128 r0 = rot[col][0];
+			__m128 r1 = rot[col][1];
+			__m128 r2 = rot[col][2];
+			__m128 r3 = rot[col][3];
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+			_mm_storeu_ps(transforms[i + 0].data + col * 4, r0);
+			_mm_storeu_ps(transforms[i + 1].data + col * 4, r1);
+			_mm_storeu_ps(transforms[i + 2].data + col * 4, r2);
+			_mm_storeu_ps(transforms[i + 3].data + col * 4, r3);
+		}
+	}
+#endif
+
+	// Scalar tail, or everything if SSE isn't available.
+	for(; i < indices_len; i++)
+	{
+		uint32_t cube = indices[i];
+
+		versor orientation;
+		cube_orientation(cubes, cube, orientation);
+
+		mat4 rot;
+		glm_quat_mat4(orientation, rot);
+		float* transform = transforms[i].data;
+		for(uint32_t col = 0; col < 3; col++)
+		{
+			transform[col * 4 + 0] = rot[col][0];
+			transform[col * 4 + 1] = rot[col][1];
+			transform[col * 4 + 2] = rot[col][2];
+			transform[col * 4 + 3] = 0;
+		}
+		transform[12] = cubes->position_x[cube];
+		transform[13] = cubes->position_y[cube];
+		transform[14] = cubes->position_z[cube];
+		transform[15] = 1;
+	}
+}
+
+struct cubes_write_job
+{
+	struct cube_streams* cubes;
+	uint32_t*            indices;
+	struct m4*           transforms;
+};
+
+void cubes_write_transforms_chunk(void* data, uint32_t begin, uint32_t end)
+{
+	PROFILE_ZONE("cubes_write_transforms");
+
+	struct cubes_write_job* job = data;
+	cubes_write_transforms_range(
+		job->cubes,
+		job->indices + begin,
+		end - begin,
+		job->transforms + begin);
+}
+
+// cubes_write_transforms_range, spread across the job system. Every chunk
+// writes its own run of transforms.
+void cubes_write_transforms(
+	struct cube_streams* cubes,
+	uint32_t*            indices,
+	uint32_t             indices_len,
+	struct m4*           transforms)
+{
+	struct cubes_write_job job = {};
+	job.cubes      = cubes;
+	job.indices    = indices;
+	job.transforms = transforms;
+	job_parallel_for(indices_len, CUBES_WRITE_GRAIN, cubes_write_transforms_chunk, &job);
 }
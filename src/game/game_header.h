@@ -1,15 +1,31 @@
-#define CUBES_LEN 128
+// Cube count when the platform doesn't choose one.
+#define CUBES_DEFAULT_LEN 128
 #define MAX_DRAW_DISTANCE_Z 25
 #define CUBE_POS_MAX_XY  15
 // TODO - increasing difficulty will probably be partly a matter of reducing
 // this maximum over time, because the cubes are repositioned once they pass
 // the position of the camera.
 #define CUBE_POS_MAX_Z 50
+// Radius of the sphere bounding a unit cube centered on its origin.
+#define CUBE_BOUNDING_RADIUS 0.8660254f
+#define CUBES_MOVE_SPEED 3
+// Degrees per second.
+#define CUBES_SPIN_SPEED 180
+// Cubes per job when moving them, and transforms per job when writing them.
+// The update grain must be a multiple of the SIMD lane count.
+#define CUBES_UPDATE_GRAIN 4096
+#define CUBES_WRITE_GRAIN 1024
 
+#define CAMERA_FOV_Y 75
+#define CAMERA_NEAR 0.1
+#define CAMERA_FAR 100
+
+#include "visibility.c"
 #include "render_group.c"
 #include "input.c"
 #include "game_memory.c"
 #include "cubes.c"
+#include "collision.c"
 #include "camera.c"
 #include "game_init.c"
 #include "game_loop.c"
@@ -1,8 +1,10 @@
 #define SPAWN_RANGE 15
 
-void game_init(void* mem, uint32_t mem_bytes)
+// The same seed and cube count always produce the same cube field, and with
+// the same dt and input, the same simulation.
+void game_init(void* mem, size_t mem_bytes, uint32_t seed, uint32_t cubes_len)
 {
-	srand(time(NULL));
+	srand(seed);
 
     struct game_memory* game = (struct game_memory*)mem;
 
@@ -18,15 +20,30 @@ void game_init(void* mem, uint32_t mem_bytes)
 	    game->camera_yaw,
 	    game->camera_pitch);
 
-    for(int32_t i = 0; i < CUBES_LEN; i++)
+    struct game_arena arena = {};
+    arena.next = (uint8_t*)mem + sizeof(struct game_memory);
+    arena.end  = (uint8_t*)mem + mem_bytes;
+
+    struct cube_streams* cubes = &game->cubes;
+    cube_streams_init(cubes, cubes_len, &arena);
+    game->visible_indices = game_arena_push(&arena, cubes_len * sizeof(uint32_t));
+    collision_grid_init(&game->collision, cubes_len, &arena);
+
+    for(uint32_t i = 0; i < cubes_len; i++)
     {
-	    reposition_cube(&game->cube_positions[i], game->cube_orientations[i], game->camera_forward, game->camera_right);
+	    reposition_cube(cubes, i, game->camera_forward, game->camera_right);
 
-	    game->cube_rotations_per_frame[i] = 
+	    struct v3 spin = 
 	    (struct v3){{{
 		    rand_t(),
 		    rand_t(),
 		    rand_t()
 	    }}};
+	    spin = v3_normalize(spin);
+	    cubes->spin_x[i] = spin.x;
+	    cubes->spin_y[i] = spin.y;
+	    cubes->spin_z[i] = spin.z;
     }
+
+    collision_grid_rebuild(&game->collision, cubes);
 }
@@ -1,12 +1,14 @@
 #define MAX_NETWORK_LINES 4
-#define CUBES_MOVE_SPEED 3
 #define CAM_LOOK_SPEED 12
 #define CAM_LOOK_LERP_SPEED 1
+// Radius of the sphere around the camera which cubes can hit.
+#define CAMERA_COLLISION_RADIUS 0.25f
 
 // TODO - majorus
 // * Dynamic up vector. Always up based on current forward? Think about what
 //   that means.
-// * Raycast from camera to hitting cube.
+// * Shooting. game->aim_hit has the cube under the reticle, needs a fire
+//   button.
 // * Cube knockback - change rotation based on hit normal and current rotation,
 //   and knockback in reverse direction of normal offset by our current speed
 //   of course.
@@ -18,7 +20,7 @@
 //   with the camera following. At the same time clamp the range of the camera
 //   forward direction. Not sure what kind of curves needed for this clamped
 //   movement yet.
-// * Restart game on hit by cube - collision detection.
+// * Restart game on hit by cube. game->camera_hit has the cube.
 // * Dude so like what if these are actually authored levels from start to
 //   finish. That way we need a REAL level editor???
 
@@ -53,43 +55,90 @@ void game_loop(
 		game->camera_yaw,
 		game->camera_pitch);
 
-	mat4 cube_transforms[CUBES_LEN];
-	for(uint32_t i = 0; i < CUBES_LEN; i++)
-	{
-		game->cube_positions[i] = v3_add(
-			game->cube_positions[i], 
-			v3_scale(game->camera_forward, -CUBES_MOVE_SPEED * dt));
-		glm_rotate(
-			game->cube_orientations[i], 
-			dt * radians(180), 
-			game->cube_rotations_per_frame[i].data);
+	// The reticle leads the camera while it catches up to the yaw and pitch
+	// targets.
+#define CAMERA_RETICLE_OFFSET_MOD 0.035
+	render_group->reticle_offset = (struct v2)
+	{{{
+		(game->camera_yaw   - game->camera_yaw_target)   / ((float)window_w * -CAMERA_RETICLE_OFFSET_MOD),
+		(game->camera_pitch - game->camera_pitch_target) / ((float)window_h *  CAMERA_RETICLE_OFFSET_MOD)
+	}}};
+	float aspect = window_h > 0 ? (float)window_w / (float)window_h : 1.0f;
+
+	cubes_update(
+		&game->cubes,
+		game->cubes.len,
+		game->camera_forward,
+		game->camera_right,
+		dt);
+
+	// Queries against the cubes where they are this frame.
+	collision_grid_update(&game->collision, &game->cubes);
+	struct v3 aim_direction = camera_ray_through_ndc(
+		game->camera_forward,
+		game->camera_right,
+		CAMERA_FOV_Y,
+		aspect,
+		render_group->reticle_offset);
+	game->aim_hit = collision_raycast(
+		&game->collision,
+		&game->cubes,
+		game->camera_position,
+		aim_direction,
+		MAX_DRAW_DISTANCE_Z);
+	game->camera_hit = collision_overlap_sphere(
+		&game->collision,
+		&game->cubes,
+		game->camera_position,
+		CAMERA_COLLISION_RADIUS);
 
-		if(v3_dot(game->camera_forward, game->cube_positions[i]) < 0)
-		{
-			reposition_cube(
-				&game->cube_positions[i], 
-				game->cube_orientations[i], 
-				game->camera_forward, 
-				game->camera_right);
-		}
+	// Only cubes which survive the visibility stage get a transform.
+	struct visibility_frustum frustum = visibility_frustum_new(
+		game->camera_position,
+		game->camera_forward,
+		game->camera_right,
+		CAMERA_FOV_Y,
+		aspect,
+		CAMERA_NEAR,
+		MAX_DRAW_DISTANCE_Z);
 
-		glm_mat4_identity(cube_transforms[i]);
-		glm_translate(cube_transforms[i], game->cube_positions[i].data);
-		glm_mat4_mul(cube_transforms[i], game->cube_orientations[i], cube_transforms[i]);
-	}	
+	uint32_t* visible_indices = game->visible_indices;
+	uint32_t visible_len = visibility_cull_spheres(
+		&frustum,
+		game->cubes.position_x,
+		game->cubes.position_y,
+		game->cubes.position_z,
+		game->cubes.len,
+		CUBE_BOUNDING_RADIUS,
+		visible_indices,
+		&render_group->cube_visibility);
+
+	// Every cube could be visible at once. The renderer makes room by the
+	// next frame if there isn't enough, and the extra cubes are dropped until
+	// then.
+	render_group->cube_transforms_requested = game->cubes.len;
+	if(visible_len > render_group->cube_transforms_capacity)
+	{
+		visible_len = render_group->cube_transforms_capacity;
+		render_group->cube_visibility.dropped_len   = render_group->cube_visibility.submitted_len - visible_len;
+		render_group->cube_visibility.submitted_len = visible_len;
+	}
+
+	// Transforms are stored to the render group once, four at a time, spread
+	// across the job system.
+	cubes_write_transforms(
+		&game->cubes,
+		visible_indices,
+		visible_len,
+		render_group->cube_transforms);
+	render_group->cube_transforms_len = visible_len;
 
 	render_group->clear_color = v3_new(.0, .0, .0);
 	render_group->max_draw_distance_z = MAX_DRAW_DISTANCE_Z;
 
 	render_group->camera_position = game->camera_position;
 	render_group->camera_target = v3_add(game->camera_position, game->camera_forward);
-
-#define CAMERA_RETICLE_OFFSET_MOD 0.035
-	render_group->reticle_offset = (struct v2)
-	{{{
-		(game->camera_yaw   - game->camera_yaw_target)   / ((float)window_w * -CAMERA_RETICLE_OFFSET_MOD),
-		(game->camera_pitch - game->camera_pitch_target) / ((float)window_h *  CAMERA_RETICLE_OFFSET_MOD)
-	}}};
-
-	memcpy(render_group->cube_transforms, cube_transforms, sizeof(struct m4) * CUBES_LEN);
+	render_group->camera_fov_y = CAMERA_FOV_Y;
+	render_group->camera_near = CAMERA_NEAR;
+	render_group->camera_far = CAMERA_FAR;
 }
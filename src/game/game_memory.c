@@ -1,3 +1,85 @@
+// Hands out the memory pool after struct game_memory. Everything is 64 byte
+// aligned, so streams start on a cache line whatever the SIMD width.
+struct game_arena
+{
+	uint8_t* next;
+	uint8_t* end;
+};
+
+void* game_arena_push(struct game_arena* arena, size_t bytes)
+{
+	uint8_t* p = (uint8_t*)(((uintptr_t)arena->next + 63) & ~(uintptr_t)63);
+	if(p > arena->end || bytes > (size_t)(arena->end - p))
+	{
+		printf("Game memory pool is too small.\n");
+		PANIC();
+	}
+	arena->next = p + bytes;
+	return p;
+}
+
+// Cube state as a structure of arrays, one stream per component, so the batch
+// kernels in cubes.c load several cubes into each register. Each stream holds
+// len cubes.
+struct cube_streams
+{
+	uint32_t len;
+
+	float* position_x;
+	float* position_y;
+	float* position_z;
+	// Orientation each cube spawned with, as a unit quaternion.
+	float* orientation_x;
+	float* orientation_y;
+	float* orientation_z;
+	float* orientation_w;
+	// Normalized axis each cube spins around, at CUBES_SPIN_SPEED.
+	float* spin_x;
+	float* spin_y;
+	float* spin_z;
+	// Spin clock when each cube spawned.
+	float* spawn_phase;
+
+	// Seconds into the current spin period, wrapped at CUBES_SPIN_PERIOD.
+	float spin_clock;
+	// How far cubes_update last moved every cube.
+	struct v3 step;
+
+	// Scratch for cubes_update. Each chunk of CUBES_UPDATE_GRAIN cubes lists
+	// the ones due a respawn from its first index on, and how many in
+	// respawn_lens.
+	uint32_t* respawn_indices;
+	uint32_t* respawn_lens;
+};
+
+// Uniform grid over the cube field, see collision.c. Each bucket is a doubly
+// linked list of nodes, eight per cube, one for each cell it might overlap.
+struct collision_grid
+{
+	// Power of two.
+	uint32_t  buckets_len;
+	uint32_t* bucket_heads;
+	uint32_t* node_next;
+	uint32_t* node_prev;
+	// Which bucket each node is in, if it's in use.
+	uint32_t* node_bucket;
+	// Sum of the steps cubes_update has moved every cube by since the last
+	// rebuild. Cubes are filed by their position less this.
+	struct v3 drift;
+};
+
+struct collision_hit
+{
+	bool      hit;
+	uint32_t  cube;
+	// Along the ray for raycasts, from the sphere's centre to the cube's
+	// surface for overlaps. Zero if it starts inside the cube.
+	float     distance;
+	// World space normal of the face hit, pointing out of the cube. For
+	// overlaps, the direction that pushes the sphere out.
+	struct v3 normal;
+};
+
 struct game_memory
 {
     float t;
@@ -11,7 +93,13 @@ struct game_memory
 	struct v3 camera_forward;
 	struct v3 camera_right;
 
-	struct v3 cube_positions[CUBES_LEN];
-	mat4 cube_orientations[CUBES_LEN];
-	struct v3 cube_rotations_per_frame[CUBES_LEN];
+	struct cube_streams cubes;
+	// Scratch for the visibility stage, room for every cube.
+	uint32_t* visible_indices;
+
+	struct collision_grid collision;
+	// Nearest cube under the reticle, for shooting.
+	struct collision_hit  aim_hit;
+	// Nearest cube touching the camera.
+	struct collision_hit  camera_hit;
 };
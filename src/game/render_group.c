@@ -8,8 +8,23 @@ struct render_group
 	// TODO - better as a transform? see how usage emerges
 	struct v3 camera_position;
 	struct v3 camera_target;
+	float     camera_fov_y;
+	float     camera_near;
+	float     camera_far;
 
 	struct v2 reticle_offset;
 
-	struct m4 cube_transforms[CUBES_LEN];
+	// Points into memory owned by the renderer, which may be uncached GPU
+	// memory, so each transform should be written exactly once and never read
+	// back. Only the first cube_transforms_len entries are drawn. Cubes which
+	// failed the visibility stage aren't written at all, and are counted in
+	// cube_visibility.
+	struct m4* cube_transforms;
+	uint32_t   cube_transforms_capacity;
+	uint32_t   cube_transforms_len;
+	// Set by the game to how many transforms it would like room for. The
+	// renderer grows cube_transforms_capacity to match, though not necessarily
+	// in time for the next frame.
+	uint32_t   cube_transforms_requested;
+	struct visibility_stats cube_visibility;
 };
@@ -0,0 +1,149 @@
+// CPU side visibility stage which runs between the cube update and the write
+// into the render group, so cubes which are entirely off screen or fully faded
+// into the fog are never transformed, uploaded or rasterized.
+//
+// All planes pass through the camera position with normals pointing into the
+// visible volume, so a cube is visible if its bounding sphere is on the inner
+// side of each of them.
+
+struct visibility_frustum
+{
+	struct v3 origin;
+	struct v3 forward;
+	float     near;
+	// World fades everything to the clear color by this distance, so it serves
+	// as the far plane.
+	float     far;
+
+	// Left, right, bottom, top.
+	struct v3 side_normals[4];
+};
+
+struct visibility_stats
+{
+	uint32_t submitted_len;
+	uint32_t culled_len;
+	// Passed the cull but didn't fit in the renderer's storage. Set by the
+	// caller, since only it knows how much room there is.
+	uint32_t dropped_len;
+};
+
+struct visibility_frustum visibility_frustum_new(
+	struct v3 origin,
+	struct v3 forward,
+	struct v3 right,
+	float     fov_y_degrees,
+	float     aspect,
+	float     near,
+	float     far)
+{
+	struct visibility_frustum frustum;
+	frustum.origin  = origin;
+	frustum.forward = forward;
+	frustum.near    = near;
+	frustum.far     = far;
+
+	struct v3 up = v3_cross(right, forward);
+
+	float half_y = radians(fov_y_degrees) / 2;
+	float half_x = atanf(tanf(half_y) * aspect);
+
+	frustum.side_normals[0] = v3_add(v3_scale(right,  cosf(half_x)), v3_scale(forward, sinf(half_x)));
+	frustum.side_normals[1] = v3_add(v3_scale(right, -cosf(half_x)), v3_scale(forward, sinf(half_x)));
+	frustum.side_normals[2] = v3_add(v3_scale(up,     cosf(half_y)), v3_scale(forward, sinf(half_y)));
+	frustum.side_normals[3] = v3_add(v3_scale(up,    -cosf(half_y)), v3_scale(forward, sinf(half_y)));
+
+	return frustum;
+}
+
+// Writes the indices of every visible position to visible_indices and returns
+// how many there were. Positions come in as separate x, y and z streams, and
+// are tested four at a time when SSE is available.
+uint32_t visibility_cull_spheres(
+	struct visibility_frustum* frustum,
+	float*                     positions_x,
+	float*                     positions_y,
+	float*                     positions_z,
+	uint32_t                   positions_len,
+	float                      radius,
+	uint32_t*                  visible_indices,
+	struct visibility_stats*   stats)
+{
+	uint32_t visible_len = 0;
+	uint32_t i = 0;
+
+#ifdef CGLM_SSE_FP
+	__m128 origin_x = _mm_set1_ps(frustum->origin.x);
+	__m128 origin_y = _mm_set1_ps(frustum->origin.y);
+	__m128 origin_z = _mm_set1_ps(frustum->origin.z);
+	__m128 fwd_x    = _mm_set1_ps(frustum->forward.x);
+	__m128 fwd_y    = _mm_set1_ps(frustum->forward.y);
+	__m128 fwd_z    = _mm_set1_ps(frustum->forward.z);
+	__m128 neg_rad  = _mm_set1_ps(-radius);
+	__m128 near     = _mm_set1_ps(frustum->near - radius);
+	__m128 far      = _mm_set1_ps(frustum->far + radius);
+
+	for(; i + 4 <= positions_len; i += 4)
+	{
+		__m128 px = _mm_sub_ps(_mm_loadu_ps(positions_x + i), origin_x);
+		__m128 py = _mm_sub_ps(_mm_loadu_ps(positions_y + i), origin_y);
+		__m128 pz = _mm_sub_ps(_mm_loadu_ps(positions_z + i), origin_z);
+
+		__m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, fwd_x), _mm_mul_ps(py, fwd_y)), _mm_mul_ps(pz, fwd_z));
+		__m128 mask  = _mm_and_ps(_mm_cmpgt_ps(depth, near), _mm_cmplt_ps(depth, far));
+
+		for(uint32_t j = 0; j < 4; j++)
+		{
+			struct v3 n = frustum->side_normals[j];
+			__m128 dist = _mm_add_ps(
+				_mm_add_ps(
+					_mm_mul_ps(px, _mm_set1_ps(n.x)), 
+					_mm_mul_ps(py, _mm_set1_ps(n.y))), 
+				_mm_mul_ps(pz, _mm_set1_ps(n.z)));
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(dist, neg_rad));
+		}
+
+		int32_t bits = _mm_movemask_ps(mask);
+		for(uint32_t j = 0; j < 4; j++)
+		{
+			if(bits & (1 << j))
+			{
+				visible_indices[visible_len] = i + j;
+				visible_len++;
+			}
+		}
+	}
+#endif
+
+	// Scalar tail, or everything if SSE isn't available.
+	for(; i < positions_len; i++)
+	{
+		struct v3 p = v3_sub(v3_new(positions_x[i], positions_y[i], positions_z[i]), frustum->origin);
+		float depth = v3_dot(p, frustum->forward);
+		if(depth < frustum->near - radius || depth > frustum->far + radius)
+		{
+			continue;
+		}
+
+		bool inside = true;
+		for(uint32_t j = 0; j < 4; j++)
+		{
+			if(v3_dot(p, frustum->side_normals[j]) < -radius)
+			{
+				inside = false;
+				break;
+			}
+		}
+		if(inside)
+		{
+			visible_indices[visible_len] = i;
+			visible_len++;
+		}
+	}
+
+	stats->submitted_len = visible_len;
+	stats->culled_len    = positions_len - visible_len;
+	stats->dropped_len   = 0;
+
+	return visible_len;
+}
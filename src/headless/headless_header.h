@@ -0,0 +1,6 @@
+// Platform layer with no window system. Renders into offscreen images through
+// the same game_loop and vk_loop path as xcb, for running on machines with no
+// display, e.g. on a CPU Vulkan implementation such as lavapipe.
+#include "headless_structs.c"
+#include "headless_init.c"
+#include "headless_loop.c"
@@ -0,0 +1,40 @@
+#define MEMORY_POOL_BYTES 1073741824
+
+struct headless_context headless_init(struct headless_options options)
+{
+	struct headless_context headless = {};
+	headless.options = options;
+
+	struct vk_platform headless_platform = {};
+	headless_platform.context                 = &headless;
+	headless_platform.create_surface_callback = 0;
+	headless_platform.window_extensions_len   = 0;
+	headless_platform.window_extensions       = 0;
+	headless_platform.headless_width          = options.width;
+	headless_platform.headless_height         = options.height;
+	headless_platform.instances_capacity      = options.cubes_len;
+
+	headless.vk = vk_init(&headless_platform);
+	vk_set_msaa_quality(&headless.vk, options.msaa_quality);
+	if(options.compute_output)
+	{
+		vk_set_compute_output(&headless.vk, true);
+	}
+	if(options.command_buffer_reuse != headless.vk.reuse.enabled)
+	{
+		vk_set_command_buffer_reuse(&headless.vk, options.command_buffer_reuse);
+	}
+
+	// No input at all, the camera just sits there while the cubes move.
+	memset(&headless.input, 0, sizeof(headless.input));
+
+	// TODO - raw memory page allocation
+	headless.memory_pool = aligned_alloc(64, MEMORY_POOL_BYTES);
+	headless.memory_pool_bytes = MEMORY_POOL_BYTES;
+
+	game_init(headless.memory_pool, headless.memory_pool_bytes, options.seed, options.cubes_len);
+
+	headless.time_since_start = 0;
+
+	return headless;
+}
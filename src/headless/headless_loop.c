@@ -0,0 +1,98 @@
+// Fixed so that runs are repeatable, regardless of how long frames take.
+#define HEADLESS_DT (1.0f / 60.0f)
+
+// Writes a binary PPM, dropping the alpha channel.
+//
+// VOLATILE - Assumes the offscreen format is R8G8B8A8, see vk_init.
+void headless_write_ppm(const char* fname, uint8_t* pixels, uint32_t width, uint32_t height)
+{
+	FILE* file = fopen(fname, "wb");
+	if(!file)
+	{
+		printf("Failed to open %s for writing.\n", fname);
+		PANIC();
+	}
+
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+	uint8_t row[width * 3];
+	for(uint32_t y = 0; y < height; y++)
+	{
+		uint8_t* src = pixels + (size_t)y * width * 4;
+		for(uint32_t x = 0; x < width; x++)
+		{
+			row[x * 3 + 0] = src[x * 4 + 0];
+			row[x * 3 + 1] = src[x * 4 + 1];
+			row[x * 3 + 2] = src[x * 4 + 2];
+		}
+		fwrite(row, 1, sizeof(row), file);
+	}
+
+	fclose(file);
+}
+
+void headless_loop(struct headless_context* headless)
+{
+	struct headless_options* options = &headless->options;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	uint64_t submitted_total = 0;
+	uint64_t culled_total    = 0;
+	uint64_t dropped_total   = 0;
+	for(uint32_t frame = 0; frame < options->frames_len; frame++)
+	{
+		profiler_frame_mark();
+		PROFILE_ZONE("frame");
+
+		input_reset_buttons(&headless->input);
+		headless->time_since_start += HEADLESS_DT;
+
+		vk_begin_frame(&headless->vk, &headless->render_group);
+		{
+			PROFILE_ZONE("simulate");
+			game_loop(
+				headless->memory_pool,
+				headless->memory_pool_bytes,
+				HEADLESS_DT,
+				options->width,
+				options->height,
+				&headless->input,
+				&headless->render_group);
+		}
+		submitted_total += headless->render_group.cube_visibility.submitted_len;
+		culled_total    += headless->render_group.cube_visibility.culled_len;
+		dropped_total   += headless->render_group.cube_visibility.dropped_len;
+
+		headless->render_group.t = headless->time_since_start / 4.0f;
+		vk_loop(&headless->vk, &headless->render_group);
+
+		if(options->ppm_dir && frame % options->ppm_every == 0)
+		{
+			PROFILE_ZONE("dump");
+			char fname[4096];
+			snprintf(fname, sizeof(fname), "%s/frame_%05u.ppm", options->ppm_dir, frame);
+			headless_write_ppm(fname, vk_headless_readback(&headless->vk), options->width, options->height);
+		}
+	}
+
+	// Include the GPU finishing the last frames.
+	vkDeviceWaitIdle(headless->vk.device);
+
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	float total_ms = 
+		(end.tv_sec - start.tv_sec) * 1000.0f + 
+		(end.tv_nsec - start.tv_nsec) / 1000000.0f;
+	printf("Rendered %u frames at %ux%u in %.2fms, %.3fms per frame.\n", 
+		options->frames_len,
+		options->width,
+		options->height,
+		total_ms,
+		total_ms / options->frames_len);
+	printf("Cubes per frame: %.1f submitted, %.1f culled, %.1f dropped.\n",
+		(double)submitted_total / options->frames_len,
+		(double)culled_total / options->frames_len,
+		(double)dropped_total / options->frames_len);
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "utils/utils_header.h"
+#include "game/game_header.h"
+#include "program_info.c"
+#include "vulkan/vk_header.h"
+#include "headless/headless_header.h"
+
+void print_usage()
+{
+	printf(
+		"Usage: %s_headless [options]\n"
+		"  --frames N        Frames to render (default 300)\n"
+		"  --width N         Image width (default 480)\n"
+		"  --height N        Image height (default 480)\n"
+		"  --ppm DIR         Dump frames to DIR as PPM\n"
+		"  --ppm-every N     Only dump every Nth frame (default 1)\n"
+		"  --msaa QUALITY    auto, off, low, medium or high (default off)\n"
+		"  --compute         Render through the trace compute shader\n"
+		"  --no-reuse        Record every frame instead of reusing command buffers\n"
+		"  --seed N          Seed for the cube field (default 1)\n"
+		"  --cubes N         Cubes in the field (default %u)\n"
+		"  --threads N       Job threads, counting the main thread (default one per core)\n"
+		"  --profile         Dump a CPU trace to %s on exit\n",
+		PROGRAM_NAME,
+		CUBES_DEFAULT_LEN,
+		PROFILER_DUMP_FNAME);
+}
+
+int32_t main(int32_t argc, char** argv)
+{
+	struct headless_options options = {};
+	options.frames_len           = 300;
+	options.width                = 480;
+	options.height               = 480;
+	options.ppm_dir              = 0;
+	options.ppm_every            = 1;
+	// Software rasterizers are the main target, where multisampling costs the
+	// most.
+	options.msaa_quality         = VK_MSAA_QUALITY_OFF;
+	options.seed                 = 1;
+	options.cubes_len            = CUBES_DEFAULT_LEN;
+	options.compute_output       = false;
+	options.command_buffer_reuse = VK_REUSE_COMMAND_BUFFERS;
+	uint32_t threads_len = 0;
+	bool profile = false;
+
+	for(int32_t i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if(strcmp(argv[i], "--frames") == 0 && has_value)
+		{
+			options.frames_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--width") == 0 && has_value)
+		{
+			options.width = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--height") == 0 && has_value)
+		{
+			options.height = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--ppm") == 0 && has_value)
+		{
+			options.ppm_dir = argv[++i];
+		}
+		else if(strcmp(argv[i], "--ppm-every") == 0 && has_value)
+		{
+			options.ppm_every = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--msaa") == 0 && has_value)
+		{
+			i++;
+			options.msaa_quality = VK_MSAA_QUALITY_LEN;
+			for(uint32_t q = 0; q < VK_MSAA_QUALITY_LEN; q++)
+			{
+				if(strcmp(argv[i], vk_msaa_quality_names[q]) == 0)
+				{
+					options.msaa_quality = q;
+				}
+			}
+			if(options.msaa_quality == VK_MSAA_QUALITY_LEN)
+			{
+				print_usage();
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "--seed") == 0 && has_value)
+		{
+			options.seed = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--cubes") == 0 && has_value)
+		{
+			options.cubes_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--threads") == 0 && has_value)
+		{
+			threads_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--compute") == 0)
+		{
+			options.compute_output = true;
+		}
+		else if(strcmp(argv[i], "--no-reuse") == 0)
+		{
+			options.command_buffer_reuse = false;
+		}
+		else if(strcmp(argv[i], "--profile") == 0)
+		{
+			profile = true;
+		}
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+
+	if(options.frames_len == 0 || options.width == 0 || options.height == 0 || options.ppm_every == 0 || options.cubes_len == 0)
+	{
+		print_usage();
+		return 1;
+	}
+
+	profiler_init(profile);
+	jobs_init(threads_len);
+
+	struct headless_context headless = headless_init(options);
+	headless_loop(&headless);
+	vk_deinit(&headless.vk);
+	jobs_deinit();
+
+	if(profile)
+	{
+		profiler_dump(PROFILER_DUMP_FNAME, PROFILER_DUMP_FRAMES);
+	}
+
+	return 0;
+}
@@ -0,0 +1,27 @@
+struct headless_options
+{
+	uint32_t             frames_len;
+	uint32_t             width;
+	uint32_t             height;
+	// Null to not dump any frames.
+	const char*          ppm_dir;
+	uint32_t             ppm_every;
+	enum vk_msaa_quality msaa_quality;
+	bool                 compute_output;
+	bool                 command_buffer_reuse;
+	uint32_t             seed;
+	uint32_t             cubes_len;
+};
+
+struct headless_context 
+{
+	struct headless_options options;
+	float                   time_since_start;
+
+	struct game_memory*     memory_pool;
+	size_t 				    memory_pool_bytes;
+
+	struct input_state      input;
+	struct render_group     render_group;
+	struct vk_context       vk;
+};
@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "utils/utils_header.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_BMP
+#include "extern/stb_image.h"
+
+// Builds the asset pack read by asset_pack_open. Run from the directory the
+// binary is run from, so asset names match the paths the engine asks for:
+//
+//   pack assets.pack shaders/world_vert.spv textures/foo.bmp ...
+//
+// .bmp files are decoded to RGBA8 here so the engine can upload them without
+// decoding anything at startup. Everything else is stored as is.
+
+bool has_extension(const char* fname, const char* ext)
+{
+	size_t fname_len = strlen(fname);
+	size_t ext_len = strlen(ext);
+	return fname_len >= ext_len && strcmp(fname + fname_len - ext_len, ext) == 0;
+}
+
+// Returns a malloc'd copy of the whole file.
+void* read_file(const char* fname, size_t* size)
+{
+	FILE* file = fopen(fname, "rb");
+	if(!file)
+	{
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	*size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	void* data = malloc(*size);
+	if(fread(data, 1, *size, file) != *size)
+	{
+		free(data);
+		data = 0;
+	}
+	fclose(file);
+	return data;
+}
+
+int32_t main(int32_t argc, char** argv)
+{
+	if(argc < 3)
+	{
+		printf("Usage: %s <output> <asset>...\n", argv[0]);
+		return 1;
+	}
+
+	uint32_t entries_len = argc - 2;
+	struct asset_pack_entry* entries = calloc(entries_len, sizeof(struct asset_pack_entry));
+	void** datas = calloc(entries_len, sizeof(void*));
+
+	uint64_t offset = sizeof(struct asset_pack_header) + entries_len * sizeof(struct asset_pack_entry);
+	for(uint32_t i = 0; i < entries_len; i++)
+	{
+		const char* fname = argv[i + 2];
+		struct asset_pack_entry* entry = &entries[i];
+
+		if(strlen(fname) >= ASSET_NAME_MAX)
+		{
+			printf("Asset name too long: %s\n", fname);
+			return 1;
+		}
+		strncpy(entry->name, fname, ASSET_NAME_MAX - 1);
+
+		if(has_extension(fname, ".bmp"))
+		{
+			int32_t w;
+			int32_t h;
+			int32_t channels;
+			datas[i] = stbi_load(fname, &w, &h, &channels, STBI_rgb_alpha);
+			entry->type   = ASSET_TYPE_TEXTURE_RGBA8;
+			entry->width  = w;
+			entry->height = h;
+			entry->size   = (uint64_t)w * h * 4;
+		}
+		else
+		{
+			size_t size = 0;
+			datas[i] = read_file(fname, &size);
+			entry->type = ASSET_TYPE_RAW;
+			entry->size = size;
+		}
+
+		if(!datas[i])
+		{
+			printf("Failed to load asset: %s\n", fname);
+			return 1;
+		}
+
+		offset = (offset + ASSET_PACK_ALIGNMENT - 1) & ~(uint64_t)(ASSET_PACK_ALIGNMENT - 1);
+		entry->offset = offset;
+		offset += entry->size;
+	}
+
+	FILE* out = fopen(argv[1], "wb");
+	if(!out)
+	{
+		printf("Failed to open file for writing: %s\n", argv[1]);
+		return 1;
+	}
+
+	struct asset_pack_header header = {};
+	header.magic       = ASSET_PACK_MAGIC;
+	header.version     = ASSET_PACK_VERSION;
+	header.entries_len = entries_len;
+	fwrite(&header, sizeof(header), 1, out);
+	fwrite(entries, sizeof(struct asset_pack_entry), entries_len, out);
+
+	for(uint32_t i = 0; i < entries_len; i++)
+	{
+		// Pad up to the aligned offset.
+		while((uint64_t)ftell(out) < entries[i].offset)
+		{
+			fputc(0, out);
+		}
+		fwrite(datas[i], 1, entries[i].size, out);
+		free(datas[i]);
+	}
+	fclose(out);
+
+	printf("Packed %u assets into %s (%lu bytes).\n", entries_len, argv[1], (unsigned long)offset);
+	return 0;
+}
@@ -0,0 +1,125 @@
+// Packed asset file produced by the pack tool at build time and memory mapped
+// whole at startup, so loading an asset is a lookup in the index followed by
+// reads straight out of the mapped pages.
+//
+// Layout: asset_pack_header, then entries_len asset_pack_entry records, then
+// each asset's data at its offset, aligned to ASSET_PACK_ALIGNMENT.
+
+#define ASSET_PACK_MAGIC 0x6b617076
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGNMENT 64
+#define ASSET_NAME_MAX 56
+
+enum asset_type
+{
+	ASSET_TYPE_RAW = 0,
+	// Decoded at pack time to tightly packed 8 bit RGBA.
+	ASSET_TYPE_TEXTURE_RGBA8 = 1
+};
+
+struct asset_pack_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entries_len;
+	uint32_t reserved;
+};
+
+struct asset_pack_entry
+{
+	// Path the asset was packed from, relative to the binary, e.g.
+	// "shaders/world_vert.spv".
+	char     name[ASSET_NAME_MAX];
+	uint32_t type;
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct asset_pack
+{
+	void*                    memory;
+	size_t                   bytes;
+	struct asset_pack_entry* entries;
+	uint32_t                 entries_len;
+};
+
+// Returns false, leaving pack empty, if the file doesn't exist or isn't a
+// valid pack.
+bool asset_pack_open(struct asset_pack* pack, const char* fname)
+{
+	memset(pack, 0, sizeof(*pack));
+
+	int32_t fd = open(fname, O_RDONLY);
+	if(fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct asset_pack_header))
+	{
+		close(fd);
+		return false;
+	}
+
+	void* memory = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive.
+	close(fd);
+	if(memory == MAP_FAILED)
+	{
+		return false;
+	}
+
+	struct asset_pack_header* header = (struct asset_pack_header*)memory;
+	if(header->magic != ASSET_PACK_MAGIC 
+	|| header->version != ASSET_PACK_VERSION
+	|| sizeof(struct asset_pack_header) + header->entries_len * sizeof(struct asset_pack_entry) > (size_t)st.st_size)
+	{
+		printf("Invalid asset pack: %s\n", fname);
+		munmap(memory, st.st_size);
+		return false;
+	}
+
+	pack->memory      = memory;
+	pack->bytes       = st.st_size;
+	pack->entries     = (struct asset_pack_entry*)(header + 1);
+	pack->entries_len = header->entries_len;
+
+	// Everything in the pack is read at startup, so start faulting it in now.
+	madvise(memory, st.st_size, MADV_WILLNEED);
+
+	return true;
+}
+
+void asset_pack_close(struct asset_pack* pack)
+{
+	if(pack->memory)
+	{
+		munmap(pack->memory, pack->bytes);
+	}
+	memset(pack, 0, sizeof(*pack));
+}
+
+struct asset_pack_entry* asset_pack_find(struct asset_pack* pack, const char* name)
+{
+	for(uint32_t i = 0; i < pack->entries_len; i++)
+	{
+		if(strncmp(pack->entries[i].name, name, ASSET_NAME_MAX) == 0)
+		{
+			if(pack->entries[i].offset + pack->entries[i].size > pack->bytes)
+			{
+				return 0;
+			}
+			return &pack->entries[i];
+		}
+	}
+	return 0;
+}
+
+void* asset_pack_data(struct asset_pack* pack, struct asset_pack_entry* entry)
+{
+	return (uint8_t*)pack->memory + entry->offset;
+}
@@ -0,0 +1,400 @@
+// Work stealing job system.
+//
+// A fixed pool of threads, each with its own deque of jobs. A thread pushes and
+// pops jobs at the bottom of its own deque without locking, and when that runs
+// dry it steals from the top of someone else's. The thread which called
+// jobs_init is worker 0, and helps out whenever it waits on a counter, so
+// jobs_init(1) gives no extra threads and runs everything inline.
+//
+// Every job is a function over an index range. job_parallel_for hands out one
+// job over the whole range, which splits itself in half, pushing the right
+// half for someone to steal, until it's no larger than the grain. Single jobs
+// are just a range of one.
+//
+// Counters track how many jobs are still outstanding for whoever waits on
+// them, which is how dependencies are expressed: kick off some jobs against a
+// counter, wait on it, then kick off what depends on them.
+//
+// Until jobs_init is called, and on threads the pool doesn't know about, jobs
+// run inline on the calling thread. So the game doesn't need to care whether
+// the platform set up a pool.
+
+#define JOBS_MAX_THREADS 64
+// Power of two. A job pushed onto a full deque is run there and then instead.
+#define JOBS_DEQUE_LEN 1024
+// Rounds of looking for work before an idle worker goes to sleep.
+#define JOBS_SPIN_LEN 256
+
+typedef void (*job_func)(void* data, uint32_t begin, uint32_t end);
+
+struct job_counter
+{
+	_Atomic uint32_t pending;
+};
+
+struct job
+{
+	job_func            func;
+	void*               data;
+	uint32_t            begin;
+	uint32_t            end;
+	// Ranges larger than this are split before func is called.
+	uint32_t            grain;
+	struct job_counter* counter;
+};
+
+// Chase-Lev deque. Only the owning thread touches bottom, and thieves race
+// each other, and the owner for the last job, on top.
+struct jobs_worker
+{
+	alignas(64) _Atomic int64_t top;
+	alignas(64) _Atomic int64_t bottom;
+	struct job                  ring[JOBS_DEQUE_LEN];
+
+	pthread_t                   thread;
+	uint32_t                    idx;
+	// For picking who to steal from.
+	uint32_t                    rand_state;
+};
+
+struct jobs_state
+{
+	struct jobs_worker* workers;
+	uint32_t            threads_len;
+	_Atomic bool        quit;
+
+	// Idle workers sleep on cond, and are woken by pushes.
+	pthread_mutex_t     mutex;
+	pthread_cond_t      cond;
+	_Atomic uint32_t    sleepers;
+};
+
+struct jobs_state jobs;
+_Thread_local struct jobs_worker* jobs_worker_local;
+
+bool jobs_push(struct jobs_worker* worker, struct job* job)
+{
+	int64_t b = atomic_load_explicit(&worker->bottom, memory_order_relaxed);
+	int64_t t = atomic_load_explicit(&worker->top, memory_order_acquire);
+	if(b - t >= JOBS_DEQUE_LEN)
+	{
+		return false;
+	}
+	worker->ring[b & (JOBS_DEQUE_LEN - 1)] = *job;
+	// Publishes the job to thieves, which load bottom with acquire.
+	atomic_store_explicit(&worker->bottom, b + 1, memory_order_release);
+	return true;
+}
+
+bool jobs_pop(struct jobs_worker* worker, struct job* job)
+{
+	int64_t b = atomic_load_explicit(&worker->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&worker->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = atomic_load_explicit(&worker->top, memory_order_relaxed);
+
+	if(t > b)
+	{
+		atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+		return false;
+	}
+
+	*job = worker->ring[b & (JOBS_DEQUE_LEN - 1)];
+	if(t < b)
+	{
+		return true;
+	}
+
+	// The last job, which a thief might be taking at the same moment.
+	bool won = atomic_compare_exchange_strong_explicit(
+		&worker->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+	atomic_store_explicit(&worker->bottom, b + 1, memory_order_relaxed);
+	return won;
+}
+
+bool jobs_steal(struct jobs_worker* victim, struct job* job)
+{
+	int64_t t = atomic_load_explicit(&victim->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t b = atomic_load_explicit(&victim->bottom, memory_order_acquire);
+	if(t >= b)
+	{
+		return false;
+	}
+
+	// The slot can't be reused until top moves past it, so the copy is good
+	// if we're the one who moves it.
+	*job = victim->ring[t & (JOBS_DEQUE_LEN - 1)];
+	return atomic_compare_exchange_strong_explicit(
+		&victim->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+bool jobs_find(struct jobs_worker* worker, struct job* job)
+{
+	if(jobs_pop(worker, job))
+	{
+		return true;
+	}
+
+	// xorshift, starting the sweep somewhere different each time so thieves
+	// don't all pile onto worker 0.
+	worker->rand_state ^= worker->rand_state << 13;
+	worker->rand_state ^= worker->rand_state >> 17;
+	worker->rand_state ^= worker->rand_state << 5;
+	uint32_t first = worker->rand_state % jobs.threads_len;
+	for(uint32_t i = 0; i < jobs.threads_len; i++)
+	{
+		struct jobs_worker* victim = &jobs.workers[(first + i) % jobs.threads_len];
+		if(victim != worker && jobs_steal(victim, job))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool jobs_any_queued()
+{
+	for(uint32_t i = 0; i < jobs.threads_len; i++)
+	{
+		struct jobs_worker* worker = &jobs.workers[i];
+		if(atomic_load(&worker->bottom) > atomic_load(&worker->top))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Pairs with the sleepers increment in jobs_thread_main. Either the pusher
+// sees the sleeper and signals, or the sleeper sees the job and doesn't sleep.
+void jobs_wake()
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(&jobs.sleepers, memory_order_relaxed) > 0)
+	{
+		pthread_mutex_lock(&jobs.mutex);
+		pthread_cond_signal(&jobs.cond);
+		pthread_mutex_unlock(&jobs.mutex);
+	}
+}
+
+void jobs_execute(struct jobs_worker* worker, struct job* job)
+{
+	// Split in whole grains, so every call to func is grain aligned.
+	while(job->end - job->begin > job->grain)
+	{
+		uint32_t grains = (job->end - job->begin + job->grain - 1) / job->grain;
+
+		struct job right = *job;
+		right.begin = job->begin + (grains / 2) * job->grain;
+		atomic_fetch_add_explicit(&job->counter->pending, 1, memory_order_relaxed);
+		if(jobs_push(worker, &right))
+		{
+			jobs_wake();
+		}
+		else
+		{
+			jobs_execute(worker, &right);
+		}
+		job->end = right.begin;
+	}
+
+	job->func(job->data, job->begin, job->end);
+
+	// Releases everything func wrote to whoever waits on the counter.
+	atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+}
+
+void* jobs_thread_main(void* arg)
+{
+	struct jobs_worker* worker = arg;
+	jobs_worker_local = worker;
+
+	struct job job;
+	while(!atomic_load_explicit(&jobs.quit, memory_order_relaxed))
+	{
+		bool found = false;
+		for(uint32_t spin = 0; spin < JOBS_SPIN_LEN && !found; spin++)
+		{
+			found = jobs_find(worker, &job);
+			if(!found)
+			{
+				sched_yield();
+			}
+		}
+		if(found)
+		{
+			jobs_execute(worker, &job);
+			continue;
+		}
+
+		pthread_mutex_lock(&jobs.mutex);
+		atomic_fetch_add(&jobs.sleepers, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		if(!jobs_any_queued() && !atomic_load(&jobs.quit))
+		{
+			pthread_cond_wait(&jobs.cond, &jobs.mutex);
+		}
+		atomic_fetch_sub(&jobs.sleepers, 1);
+		pthread_mutex_unlock(&jobs.mutex);
+	}
+
+	return 0;
+}
+
+// threads_len counts the calling thread. 0 is one thread per core, up to
+// JOBS_MAX_THREADS.
+void jobs_init(uint32_t threads_len)
+{
+	if(threads_len == 0)
+	{
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads_len = cores < 1 ? 1 : (uint32_t)cores;
+	}
+	if(threads_len > JOBS_MAX_THREADS)
+	{
+		threads_len = JOBS_MAX_THREADS;
+	}
+
+	jobs.threads_len = threads_len;
+	jobs.workers     = aligned_alloc(64, threads_len * sizeof(struct jobs_worker));
+	memset(jobs.workers, 0, threads_len * sizeof(struct jobs_worker));
+	atomic_store(&jobs.quit, false);
+	atomic_store(&jobs.sleepers, 0);
+	pthread_mutex_init(&jobs.mutex, 0);
+	pthread_cond_init(&jobs.cond, 0);
+
+	for(uint32_t t = 0; t < threads_len; t++)
+	{
+		struct jobs_worker* worker = &jobs.workers[t];
+		worker->idx        = t;
+		worker->rand_state = 2654435761u * (t + 1);
+	}
+
+	jobs_worker_local = &jobs.workers[0];
+	for(uint32_t t = 1; t < threads_len; t++)
+	{
+		if(pthread_create(&jobs.workers[t].thread, 0, jobs_thread_main, &jobs.workers[t]) != 0)
+		{
+			printf("Failed to start job thread %u.\n", t);
+			PANIC();
+		}
+	}
+}
+
+// Must be called from the thread which called jobs_init, with nothing left
+// outstanding.
+void jobs_deinit()
+{
+	pthread_mutex_lock(&jobs.mutex);
+	atomic_store(&jobs.quit, true);
+	pthread_cond_broadcast(&jobs.cond);
+	pthread_mutex_unlock(&jobs.mutex);
+
+	for(uint32_t t = 1; t < jobs.threads_len; t++)
+	{
+		pthread_join(jobs.workers[t].thread, 0);
+	}
+
+	pthread_mutex_destroy(&jobs.mutex);
+	pthread_cond_destroy(&jobs.cond);
+	free(jobs.workers);
+	jobs.workers      = 0;
+	jobs.threads_len  = 0;
+	jobs_worker_local = 0;
+}
+
+// Threads which will run jobs, counting the one which waits on them.
+uint32_t jobs_threads_len()
+{
+	return jobs_worker_local ? jobs.threads_len : 1;
+}
+
+// Runs func(data, 0, 1) as a job counted by counter, which must be zeroed
+// before its first use.
+void job_run(struct job_counter* counter, job_func func, void* data)
+{
+	struct jobs_worker* worker = jobs_worker_local;
+	if(!worker)
+	{
+		func(data, 0, 1);
+		return;
+	}
+
+	struct job job = {};
+	job.func    = func;
+	job.data    = data;
+	job.begin   = 0;
+	job.end     = 1;
+	job.grain   = 1;
+	job.counter = counter;
+
+	atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+	if(!jobs_push(worker, &job))
+	{
+		jobs_execute(worker, &job);
+		return;
+	}
+	jobs_wake();
+}
+
+// Runs other jobs until everything counted by counter is done. Everything
+// those jobs wrote is visible once this returns.
+void job_wait(struct job_counter* counter)
+{
+	PROFILE_ZONE("job_wait");
+
+	struct jobs_worker* worker = jobs_worker_local;
+	struct job job;
+	while(atomic_load_explicit(&counter->pending, memory_order_acquire) > 0)
+	{
+		if(worker && jobs_find(worker, &job))
+		{
+			jobs_execute(worker, &job);
+		}
+		else
+		{
+			sched_yield();
+		}
+	}
+}
+
+// Calls func over [0, len) in chunks of grain, spread across the pool, and
+// returns once every chunk is done. Each chunk starts on a multiple of grain,
+// so begin / grain is a stable chunk index whatever the thread count.
+void job_parallel_for(uint32_t len, uint32_t grain, job_func func, void* data)
+{
+	if(len == 0)
+	{
+		return;
+	}
+	if(grain == 0)
+	{
+		grain = 1;
+	}
+
+	struct jobs_worker* worker = jobs_worker_local;
+	if(!worker || jobs.threads_len == 1 || len <= grain)
+	{
+		for(uint32_t begin = 0; begin < len; begin += grain)
+		{
+			func(data, begin, len - begin > grain ? begin + grain : len);
+		}
+		return;
+	}
+
+	struct job_counter counter = {};
+	atomic_store_explicit(&counter.pending, 1, memory_order_relaxed);
+
+	struct job job = {};
+	job.func    = func;
+	job.data    = data;
+	job.begin   = 0;
+	job.end     = len;
+	job.grain   = grain;
+	job.counter = &counter;
+
+	jobs_execute(worker, &job);
+	job_wait(&counter);
+}
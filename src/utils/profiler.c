@@ -0,0 +1,205 @@
+// Scoped CPU timing zones, dumped as Chrome trace event JSON which loads in
+// chrome://tracing or Perfetto.
+//
+// Each thread records completed zones into its own ring buffer, so recording
+// takes no locks. The ring only keeps the most recent PROFILER_RING_LEN
+// zones, which is plenty for the last few hundred frames at the current zone
+// count.
+//
+// Zones are nearly free when profiler.enabled is false, costing a load and a
+// branch each, and compile out entirely with PROFILER 0.
+
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+#define PROFILER_RING_LEN 16384
+#define PROFILER_MAX_THREADS 64
+#define PROFILER_DUMP_FRAMES 120
+#define PROFILER_DUMP_FNAME "trace.json"
+
+struct profiler_zone
+{
+	// Must be a string literal or otherwise outlive the profiler.
+	const char* name;
+	uint64_t    start_ns;
+	uint64_t    end_ns;
+	uint32_t    frame;
+};
+
+struct profiler_thread
+{
+	uint32_t             tid;
+	struct profiler_zone zones[PROFILER_RING_LEN];
+	// Total ever written, so the ring index is zones_written % len.
+	uint64_t             zones_written;
+};
+
+struct profiler_state
+{
+	bool                    enabled;
+	uint64_t                start_ns;
+	// Incremented by profiler_frame_mark, and tagged onto each zone so dumps
+	// can be cut to the last N frames.
+	_Atomic uint32_t        frame;
+
+	struct profiler_thread* threads[PROFILER_MAX_THREADS];
+	_Atomic uint32_t        threads_len;
+};
+
+struct profiler_state profiler;
+_Thread_local struct profiler_thread* profiler_thread_local;
+
+uint64_t profiler_now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+void profiler_init(bool enabled)
+{
+	profiler.enabled  = enabled;
+	profiler.start_ns = profiler_now_ns();
+}
+
+// Each thread's ring is allocated the first time it records a zone, and is
+// never freed.
+struct profiler_thread* profiler_get_thread()
+{
+	if(!profiler_thread_local)
+	{
+		uint32_t idx = atomic_fetch_add(&profiler.threads_len, 1);
+		if(idx >= PROFILER_MAX_THREADS)
+		{
+			printf("Profiler supports at most %u threads.\n", PROFILER_MAX_THREADS);
+			PANIC();
+		}
+
+		struct profiler_thread* thread = calloc(1, sizeof(struct profiler_thread));
+		thread->tid = idx;
+		profiler.threads[idx] = thread;
+		profiler_thread_local = thread;
+	}
+	return profiler_thread_local;
+}
+
+void profiler_frame_mark()
+{
+	atomic_fetch_add_explicit(&profiler.frame, 1, memory_order_relaxed);
+}
+
+// Returned by profiler_begin and handed back to profiler_end.
+struct profiler_scope
+{
+	const char* name;
+	uint64_t    start_ns;
+};
+
+struct profiler_scope profiler_begin(const char* name)
+{
+	struct profiler_scope scope = {};
+	if(profiler.enabled)
+	{
+		scope.name     = name;
+		scope.start_ns = profiler_now_ns();
+	}
+	return scope;
+}
+
+void profiler_end(struct profiler_scope* scope)
+{
+	// A zone which began while disabled is dropped, even if the profiler has
+	// since been enabled.
+	if(!scope->name)
+	{
+		return;
+	}
+
+	struct profiler_thread* thread = profiler_get_thread();
+	struct profiler_zone* zone = &thread->zones[thread->zones_written % PROFILER_RING_LEN];
+	zone->name     = scope->name;
+	zone->start_ns = scope->start_ns;
+	zone->end_ns   = profiler_now_ns();
+	zone->frame    = atomic_load_explicit(&profiler.frame, memory_order_relaxed);
+	thread->zones_written++;
+}
+
+// Times the rest of the enclosing block.
+//
+//   {
+//       PROFILE_ZONE("simulate");
+//       ...
+//   }
+#if PROFILER
+#define PROFILE_ZONE_CONCAT_(A, B) A##B
+#define PROFILE_ZONE_CONCAT(A, B) PROFILE_ZONE_CONCAT_(A, B)
+#define PROFILE_ZONE(NAME) \
+	struct profiler_scope PROFILE_ZONE_CONCAT(profile_zone_, __LINE__) \
+	__attribute__((cleanup(profiler_end))) = profiler_begin(NAME)
+#else
+#define PROFILE_ZONE(NAME)
+#endif
+
+// Writes every zone from the last frames_len frames, across all threads. Meant
+// to be called between frames from the thread which marks them. Zones other
+// threads are writing at the same moment may be torn, which is fine for a
+// debugging tool.
+bool profiler_dump(const char* fname, uint32_t frames_len)
+{
+	FILE* file = fopen(fname, "w");
+	if(!file)
+	{
+		printf("Failed to open %s for the profiler dump.\n", fname);
+		return false;
+	}
+
+	uint32_t frame_last  = atomic_load(&profiler.frame);
+	uint32_t frame_first = frame_last > frames_len ? frame_last - frames_len : 0;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	uint32_t zones_len = 0;
+
+	uint32_t threads_len = atomic_load(&profiler.threads_len);
+	for(uint32_t t = 0; t < threads_len && t < PROFILER_MAX_THREADS; t++)
+	{
+		struct profiler_thread* thread = profiler.threads[t];
+		if(!thread)
+		{
+			continue;
+		}
+
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			first ? "" : ",\n",
+			thread->tid,
+			thread->tid);
+		first = false;
+
+		uint64_t written = thread->zones_written;
+		uint64_t oldest  = written > PROFILER_RING_LEN ? written - PROFILER_RING_LEN : 0;
+		for(uint64_t i = oldest; i < written; i++)
+		{
+			struct profiler_zone* zone = &thread->zones[i % PROFILER_RING_LEN];
+			if(zone->frame < frame_first || zone->start_ns < profiler.start_ns)
+			{
+				continue;
+			}
+
+			// Trace event timestamps are in microseconds.
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+				zone->name,
+				thread->tid,
+				(zone->start_ns - profiler.start_ns) / 1000.0,
+				(zone->end_ns - zone->start_ns) / 1000.0,
+				zone->frame);
+			zones_len++;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("Dumped %u profiler zones from frames %u-%u to %s.\n", zones_len, frame_first, frame_last, fname);
+	return true;
+}
@@ -6,9 +6,21 @@
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include <stdatomic.h>
+// POSIX threads, for the job system
+#include <pthread.h>
+#include <sched.h>
+// POSIX, for memory mapping the asset pack
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 // My utils, and cglm for math for now
 #include "cglm/cglm.h"
 #include "lerp.c"
 #include "clamp.c"
 #include "linalg.c"
 #include "random.c"
+#include "asset_pack.c"
+#include "profiler.c"
+#include "jobs.c"
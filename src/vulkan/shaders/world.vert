@@ -12,12 +12,12 @@ layout(binding = 0) uniform ubo_global {
 	float max_draw_distance_z;
 } global;
 
-layout(binding = 1) uniform ubo_inst {
-	mat4 model;
+layout(std430, binding = 1) readonly buffer ssbo_inst {
+	mat4 models[];
 } inst;
 
 void main() {
-	vec4 projection = global.projection * global.view * inst.model * vec4(in_pos, 1.0);
+	vec4 projection = global.projection * global.view * inst.models[gl_InstanceIndex] * vec4(in_pos, 1.0);
     gl_Position = projection;
 
     vec3 base = mix(in_color, global.clear_color, pow(clamp(projection.z / global.max_draw_distance_z, 0, 1), 0.5));
@@ -0,0 +1,290 @@
+// Compute output path. The trace shader ray casts the cube field straight into
+// a storage image, which is then blitted to the swapchain image, with no
+// rasterization at all.
+
+void vk_compute_init(struct vk_context* vk, uint32_t family_idx, uint32_t graphics_family_idx)
+{
+	struct vk_compute_context* compute = &vk->compute;
+	memset(compute, 0, sizeof(*compute));
+
+	compute->family_idx          = family_idx;
+	compute->graphics_family_idx = graphics_family_idx;
+	compute->async               = family_idx != graphics_family_idx;
+	// May be the same queue as uploads go through, if they picked the same
+	// family. Both only submit from the render thread.
+	vkGetDeviceQueue(vk->device, family_idx, 0, &compute->queue);
+
+	VkCommandPoolCreateInfo pool_info = {};
+	pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	pool_info.queueFamilyIndex = family_idx;
+	VK_VERIFY(vkCreateCommandPool(vk->device, &pool_info, 0, &compute->command_pool));
+
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
+	{
+		VkCommandBufferAllocateInfo buf_info = {};
+		buf_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		buf_info.commandPool        = compute->command_pool;
+		buf_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		buf_info.commandBufferCount = 1;
+		VK_VERIFY(vkAllocateCommandBuffers(vk->device, &buf_info, &compute->command_buffers[i]));
+
+		VK_VERIFY(vkCreateSemaphore(vk->device, &semaphore_info, 0, &compute->semaphores[i]));
+	}
+}
+
+// Called from vk_create_swapchain whenever the attachments are (re)created.
+// Whatever these replace has already been retired by the caller.
+void vk_compute_create_images(struct vk_context* vk)
+{
+	struct vk_compute_context* compute = &vk->compute;
+	for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
+	{
+		vk_allocate_image_and_view(
+			vk->allocator,
+			&compute->images[i],
+			&compute->memory[i],
+			&compute->views[i],
+			vk->swap_extent.width,
+			vk->swap_extent.height,
+			VK_COMPUTE_FORMAT,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	compute->images_generation++;
+}
+
+void vk_compute_create_pipeline(struct vk_context* vk)
+{
+	// VOLATILE - Bindings must match trace.comp.
+	struct vk_descriptor_info trace_descriptors[4] = {};
+
+	trace_descriptors[0].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	trace_descriptors[0].offset_in_buffer = offsetof(struct vk_host_memory, global);
+	trace_descriptors[0].range_in_buffer  = sizeof(struct vk_ubo_global_world);
+
+	trace_descriptors[1].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	trace_descriptors[1].offset_in_buffer = offsetof(struct vk_host_memory, global) + offsetof(struct vk_ubo_global, cull);
+	trace_descriptors[1].range_in_buffer  = sizeof(struct vk_ubo_cull);
+
+	trace_descriptors[2].type             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	trace_descriptors[2].frame_buffers    = vk->instances.buffers;
+	trace_descriptors[2].offset_in_buffer = 0;
+	trace_descriptors[2].range_in_buffer  = VK_WHOLE_SIZE;
+
+	trace_descriptors[3].type             = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	trace_descriptors[3].image_views      = vk->compute.views;
+
+	VkShaderModule shader_trace_comp = vk_create_shader_module(vk->device, &vk->assets, "shaders/trace_comp.spv");
+
+	vk_create_compute_pipeline(
+		vk,
+		&vk->pipeline_resources_trace,
+		trace_descriptors,
+		4,
+		shader_trace_comp);
+
+	for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
+	{
+		vk->compute.descriptors_generation[i] = vk->compute.images_generation;
+	}
+}
+
+void vk_set_compute_output(struct vk_context* vk, bool enabled)
+{
+	if(enabled && !vk->compute.blit_supported)
+	{
+		printf("Swapchain images can't be blitted into, staying on the raster passes.\n");
+		return;
+	}
+
+	vk->compute_output = enabled;
+	printf("Rendering through %s%s.\n",
+		enabled ? "the trace compute shader" : "the raster passes",
+		enabled && vk->compute.async ? " on the async compute queue" : "");
+}
+
+// Points this frame's descriptor set at the current images if they've been
+// recreated since it was last written. The frame's fence has been waited on,
+// so nothing in flight is still using the set.
+void vk_compute_update_descriptors(struct vk_context* vk)
+{
+	struct vk_compute_context* compute = &vk->compute;
+	uint32_t frame = vk->frame_idx;
+	if(compute->descriptors_generation[frame] == compute->images_generation)
+	{
+		return;
+	}
+
+	VkDescriptorImageInfo image_info = {};
+	image_info.imageView   = compute->views[frame];
+	image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	// VOLATILE - Binding must match trace.comp.
+	VkWriteDescriptorSet write = {};
+	write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet          = vk->pipeline_resources_trace.descriptor_sets[frame];
+	write.dstBinding      = 3;
+	write.dstArrayElement = 0;
+	write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	write.descriptorCount = 1;
+	write.pImageInfo      = &image_info;
+	vkUpdateDescriptorSets(vk->device, 1, &write, 0, 0);
+
+	compute->descriptors_generation[frame] = compute->images_generation;
+}
+
+// Barrier on this frame's image which leaves it in TRANSFER_SRC_OPTIMAL. With
+// async compute the release half is recorded on the compute queue and the
+// acquire half on the graphics queue, with the same families and layouts.
+VkImageMemoryBarrier vk_compute_image_barrier(struct vk_context* vk)
+{
+	struct vk_compute_context* compute = &vk->compute;
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout                       = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex             = compute->async ? compute->family_idx : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex             = compute->async ? compute->graphics_family_idx : VK_QUEUE_FAMILY_IGNORED;
+	barrier.image                           = compute->images[vk->frame_idx];
+	barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel   = 0;
+	barrier.subresourceRange.levelCount     = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = 1;
+	return barrier;
+}
+
+// Records the trace dispatch, into the compute queue's command buffer when
+// async, otherwise into the graphics one.
+void vk_compute_record_trace(struct vk_context* vk, VkCommandBuffer graphics_command_buffer)
+{
+	struct vk_compute_context* compute = &vk->compute;
+	vk_compute_update_descriptors(vk);
+
+	VkCommandBuffer command_buffer = graphics_command_buffer;
+	if(compute->async)
+	{
+		command_buffer = compute->command_buffers[vk->frame_idx];
+		VK_VERIFY(vkResetCommandBuffer(command_buffer, 0));
+
+		// Not one time submit, since with command buffer reuse this gets
+		// submitted again until the frame is next recorded.
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		VK_VERIFY(vkBeginCommandBuffer(command_buffer, &begin_info));
+	}
+
+	// Last frame's contents are never read, so start from UNDEFINED. The blit
+	// which last read this image belongs to a frame whose fence has already
+	// been waited on.
+	insert_image_memory_barrier(
+		command_buffer,
+		compute->images[vk->frame_idx],
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_GENERAL,
+		0,
+		VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	vkCmdBindPipeline(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		vk->pipeline_resources_trace.pipeline);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		vk->pipeline_resources_trace.pipeline_layout,
+		0,
+		1,
+		&vk->pipeline_resources_trace.descriptor_sets[vk->frame_idx],
+		0,
+		0);
+
+	// VOLATILE - Group size must match local_size_x and local_size_y in
+	// trace.comp.
+	vkCmdDispatch(
+		command_buffer,
+		(vk->swap_extent.width + 7) / 8,
+		(vk->swap_extent.height + 7) / 8,
+		1);
+
+	// Release, or the whole transition when there's only the one queue.
+	VkImageMemoryBarrier barrier = vk_compute_image_barrier(vk);
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = compute->async ? 0 : VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(
+		command_buffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		compute->async ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, 0, 0, 0, 1, &barrier);
+
+	if(compute->async)
+	{
+		VK_VERIFY(vkEndCommandBuffer(command_buffer));
+	}
+}
+
+// Blits this frame's image into the swapchain image, which the frame graph has
+// already put in TRANSFER_DST_OPTIMAL. The blit converts from the float storage
+// format to whatever the swapchain uses, sRGB encoding included.
+void vk_compute_record_blit(struct vk_context* vk, VkCommandBuffer command_buffer, VkImage swap_image)
+{
+	struct vk_compute_context* compute = &vk->compute;
+
+	if(compute->async)
+	{
+		VkImageMemoryBarrier barrier = vk_compute_image_barrier(vk);
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(
+			command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, 0, 0, 0, 1, &barrier);
+	}
+
+	VkImageBlit blit = {};
+	blit.srcSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.mipLevel       = 0;
+	blit.srcSubresource.baseArrayLayer = 0;
+	blit.srcSubresource.layerCount     = 1;
+	blit.srcOffsets[1].x               = vk->swap_extent.width;
+	blit.srcOffsets[1].y               = vk->swap_extent.height;
+	blit.srcOffsets[1].z               = 1;
+	blit.dstSubresource                = blit.srcSubresource;
+	blit.dstOffsets[1]                 = blit.srcOffsets[1];
+	vkCmdBlitImage(
+		command_buffer,
+		compute->images[vk->frame_idx],
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		swap_image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1,
+		&blit,
+		VK_FILTER_NEAREST);
+}
+
+// Async only. Must go in before the frame's graphics submit, which waits on
+// the returned semaphore.
+VkSemaphore vk_compute_submit(struct vk_context* vk)
+{
+	struct vk_compute_context* compute = &vk->compute;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount   = 1;
+	submit_info.pCommandBuffers      = &compute->command_buffers[vk->frame_idx];
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores    = &compute->semaphores[vk->frame_idx];
+	VK_VERIFY(vkQueueSubmit(compute->queue, 1, &submit_info, VK_NULL_HANDLE));
+
+	return compute->semaphores[vk->frame_idx];
+}
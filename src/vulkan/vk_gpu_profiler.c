@@ -0,0 +1,252 @@
+const char* vk_gpu_pass_names[VK_GPU_PASS_LEN] = 
+{
+	"cull",
+	"world",
+	"reticle",
+	"resolve"
+};
+
+// timestamp_valid_bits is for the graphics queue family. Zero means the queue
+// doesn't support timestamps, and the profiler stays disabled.
+void vk_gpu_profiler_init(struct vk_context* vk, uint32_t timestamp_valid_bits, bool statistics_supported)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	memset(profiler, 0, sizeof(*profiler));
+
+#if VK_GPU_PROFILE
+	if(timestamp_valid_bits == 0)
+	{
+		printf("Graphics queue doesn't support timestamps, GPU profiler disabled.\n");
+		return;
+	}
+
+	profiler->enabled            = true;
+	profiler->statistics_enabled = statistics_supported;
+	profiler->timestamp_period   = vk->physical_device_properties.limits.timestampPeriod;
+	profiler->timestamp_mask     = timestamp_valid_bits >= 64 ? UINT64_MAX : ((uint64_t)1 << timestamp_valid_bits) - 1;
+
+	VkQueryPoolCreateInfo timestamp_info = {};
+	timestamp_info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	timestamp_info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+	timestamp_info.queryCount = VK_GPU_TIMESTAMPS_LEN * MAX_IN_FLIGHT_FRAMES;
+	VK_VERIFY(vkCreateQueryPool(vk->device, &timestamp_info, 0, &profiler->timestamp_pool));
+
+	if(profiler->statistics_enabled)
+	{
+		VkQueryPoolCreateInfo statistics_info = {};
+		statistics_info.sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		statistics_info.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		statistics_info.queryCount         = VK_GPU_PASS_LEN * MAX_IN_FLIGHT_FRAMES;
+		statistics_info.pipelineStatistics = VK_GPU_STATISTICS_FLAGS;
+		VK_VERIFY(vkCreateQueryPool(vk->device, &statistics_info, 0, &profiler->statistics_pool));
+	}
+#endif
+}
+
+// Must be recorded outside of rendering, before any other profiler commands
+// for the frame.
+void vk_gpu_profiler_begin_frame(struct vk_context* vk, VkCommandBuffer command_buffer)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	if(!profiler->enabled)
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(
+		command_buffer, 
+		profiler->timestamp_pool, 
+		VK_GPU_TIMESTAMPS_LEN * vk->frame_idx, 
+		VK_GPU_TIMESTAMPS_LEN);
+	if(profiler->statistics_enabled)
+	{
+		vkCmdResetQueryPool(
+			command_buffer, 
+			profiler->statistics_pool, 
+			VK_GPU_PASS_LEN * vk->frame_idx, 
+			VK_GPU_PASS_LEN);
+	}
+
+	vkCmdWriteTimestamp(
+		command_buffer, 
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
+		profiler->timestamp_pool, 
+		VK_GPU_TIMESTAMPS_LEN * vk->frame_idx);
+
+	profiler->frame_recorded[vk->frame_idx] = true;
+}
+
+// For a frame submitted from a reused command buffer, which already has this
+// slot's queries recorded in it.
+void vk_gpu_profiler_reuse_frame(struct vk_context* vk)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	if(profiler->enabled)
+	{
+		profiler->frame_recorded[vk->frame_idx] = true;
+	}
+}
+
+// Marks the end of pass, which started where the previous pass ended.
+void vk_gpu_profiler_end_pass(struct vk_context* vk, VkCommandBuffer command_buffer, enum vk_gpu_pass pass)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	if(!profiler->enabled)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp(
+		command_buffer, 
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 
+		profiler->timestamp_pool, 
+		VK_GPU_TIMESTAMPS_LEN * vk->frame_idx + pass + 1);
+}
+
+// Statistics queries bracket the draws of a single pass, and must begin and
+// end within the same rendering.
+void vk_gpu_profiler_begin_statistics(struct vk_context* vk, VkCommandBuffer command_buffer, enum vk_gpu_pass pass)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	if(!profiler->enabled || !profiler->statistics_enabled)
+	{
+		return;
+	}
+	vkCmdBeginQuery(command_buffer, profiler->statistics_pool, VK_GPU_PASS_LEN * vk->frame_idx + pass, 0);
+}
+
+void vk_gpu_profiler_end_statistics(struct vk_context* vk, VkCommandBuffer command_buffer, enum vk_gpu_pass pass)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	if(!profiler->enabled || !profiler->statistics_enabled)
+	{
+		return;
+	}
+	vkCmdEndQuery(command_buffer, profiler->statistics_pool, VK_GPU_PASS_LEN * vk->frame_idx + pass);
+}
+
+int vk_gpu_profiler_compare_ms(const void* a, const void* b)
+{
+	float fa = *(const float*)a;
+	float fb = *(const float*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+void vk_gpu_pass_stats_push(struct vk_gpu_pass_stats* stats, float ms)
+{
+	stats->history_ms[stats->history_idx] = ms;
+	stats->history_idx = (stats->history_idx + 1) % VK_GPU_HISTORY_LEN;
+	if(stats->history_len < VK_GPU_HISTORY_LEN)
+	{
+		stats->history_len++;
+	}
+
+	float sorted[VK_GPU_HISTORY_LEN];
+	memcpy(sorted, stats->history_ms, stats->history_len * sizeof(float));
+	qsort(sorted, stats->history_len, sizeof(float), vk_gpu_profiler_compare_ms);
+
+	float sum = 0;
+	for(uint32_t i = 0; i < stats->history_len; i++)
+	{
+		sum += sorted[i];
+	}
+
+	// Nearest rank, so with fewer than 100 samples it's just the max.
+	uint32_t p99_idx = (uint32_t)ceilf(0.99f * stats->history_len) - 1;
+
+	stats->min_ms = sorted[0];
+	stats->avg_ms = sum / stats->history_len;
+	stats->p99_ms = sorted[p99_idx];
+}
+
+void vk_gpu_profiler_print(struct vk_context* vk)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+
+	printf("GPU pass      min ms   avg ms   p99 ms\n");
+	for(uint32_t i = 0; i < VK_GPU_PASS_LEN; i++)
+	{
+		struct vk_gpu_pass_stats* stats = &profiler->passes[i];
+		printf("  %-9s %8.3f %8.3f %8.3f", vk_gpu_pass_names[i], stats->min_ms, stats->avg_ms, stats->p99_ms);
+		if(profiler->statistics_enabled && stats->statistics.vertex_invocations > 0)
+		{
+			printf("   %lu verts, %lu prims, %lu frags",
+				stats->statistics.vertex_invocations,
+				stats->statistics.clipping_primitives,
+				stats->statistics.fragment_invocations);
+		}
+		printf("\n");
+	}
+}
+
+// Reads back the results of the last frame recorded in the current slot.
+// Called after the slot's fence has been waited on, so the results are
+// available and this doesn't block.
+void vk_gpu_profiler_read(struct vk_context* vk)
+{
+	struct vk_gpu_profiler* profiler = &vk->gpu_profiler;
+	if(!profiler->enabled || !profiler->frame_recorded[vk->frame_idx])
+	{
+		return;
+	}
+	profiler->frame_recorded[vk->frame_idx] = false;
+
+	uint64_t timestamps[VK_GPU_TIMESTAMPS_LEN];
+	VkResult res = vkGetQueryPoolResults(
+		vk->device,
+		profiler->timestamp_pool,
+		VK_GPU_TIMESTAMPS_LEN * vk->frame_idx,
+		VK_GPU_TIMESTAMPS_LEN,
+		sizeof(timestamps),
+		timestamps,
+		sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT);
+	// Not ready means the frame was never submitted, e.g. the swapchain was
+	// out of date, so there's nothing to read.
+	if(res == VK_NOT_READY)
+	{
+		return;
+	}
+	VK_VERIFY(res);
+
+	for(uint32_t i = 0; i < VK_GPU_PASS_LEN; i++)
+	{
+		uint64_t ticks = (timestamps[i + 1] - timestamps[i]) & profiler->timestamp_mask;
+		vk_gpu_pass_stats_push(&profiler->passes[i], ticks * profiler->timestamp_period / 1000000.0f);
+	}
+
+	// Only the drawing passes have statistics queries, and a query which was
+	// reset but never begun is never available, so only read those.
+	//
+	// VOLATILE - Assumes the drawing passes are contiguous in vk_gpu_pass.
+	if(profiler->statistics_enabled)
+	{
+		uint32_t first = VK_GPU_PASS_WORLD;
+		uint32_t len   = VK_GPU_PASS_RETICLE - VK_GPU_PASS_WORLD + 1;
+
+		struct vk_gpu_statistics statistics[VK_GPU_PASS_LEN];
+		res = vkGetQueryPoolResults(
+			vk->device,
+			profiler->statistics_pool,
+			VK_GPU_PASS_LEN * vk->frame_idx + first,
+			len,
+			len * sizeof(struct vk_gpu_statistics),
+			statistics,
+			sizeof(struct vk_gpu_statistics),
+			VK_QUERY_RESULT_64_BIT);
+		if(res == VK_SUCCESS)
+		{
+			for(uint32_t i = 0; i < len; i++)
+			{
+				profiler->passes[first + i].statistics = statistics[i];
+			}
+		}
+	}
+
+	profiler->frames_since_print++;
+	if(profiler->frames_since_print >= VK_GPU_PROFILE_PRINT_FRAMES)
+	{
+		profiler->frames_since_print = 0;
+		vk_gpu_profiler_print(vk);
+	}
+}
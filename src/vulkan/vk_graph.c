@@ -0,0 +1,771 @@
+// Render graph. Passes declare the images and buffers they use and how, and
+// the graph places the barriers between them, picks the load and store ops of
+// attachments, and creates transient attachments, aliasing the memory of any
+// whose lifetimes don't overlap.
+//
+// A graph is built again for every recording, which costs next to nothing
+// with a handful of passes. Resources are either imported, along with how the
+// previous frame left them, or transient, whose contents never outlive the
+// pass list. vk_graph_record walks the passes in order, so the order they're
+// added in is the order they execute in.
+//
+// Everything is on the one queue. Queue family ownership transfers, as the
+// async compute path needs, are still recorded by hand around the graph.
+
+#define VK_GRAPH_MAX_RESOURCES 16
+#define VK_GRAPH_MAX_PASSES 8
+#define VK_GRAPH_MAX_USES 8
+#define VK_GRAPH_UNUSED UINT32_MAX
+
+enum vk_graph_access
+{
+	VK_GRAPH_ACCESS_NONE,
+	VK_GRAPH_ACCESS_TRANSFER_READ,
+	VK_GRAPH_ACCESS_TRANSFER_WRITE,
+	VK_GRAPH_ACCESS_COMPUTE_READ,
+	// Storage reads and writes, in either order.
+	VK_GRAPH_ACCESS_COMPUTE_WRITE,
+	// The indirect draw command, and whatever the vertex shader reads out of
+	// the same buffer.
+	VK_GRAPH_ACCESS_INDIRECT_READ,
+	// As an attachment, or a resolve target.
+	VK_GRAPH_ACCESS_COLOR_WRITE,
+	VK_GRAPH_ACCESS_DEPTH_WRITE,
+	VK_GRAPH_ACCESS_PRESENT,
+	VK_GRAPH_ACCESS_HOST_READ,
+	VK_GRAPH_ACCESS_LEN
+};
+
+struct vk_graph_access_info
+{
+	VkPipelineStageFlags stages;
+	VkAccessFlags        access;
+	// Images only.
+	VkImageLayout        layout;
+	bool                 writes;
+};
+
+const struct vk_graph_access_info vk_graph_access_infos[VK_GRAPH_ACCESS_LEN] =
+{
+	[VK_GRAPH_ACCESS_NONE] =
+	{
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		0,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		false
+	},
+	[VK_GRAPH_ACCESS_TRANSFER_READ] =
+	{
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_READ_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		false
+	},
+	[VK_GRAPH_ACCESS_TRANSFER_WRITE] =
+	{
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		true
+	},
+	[VK_GRAPH_ACCESS_COMPUTE_READ] =
+	{
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_GENERAL,
+		false
+	},
+	[VK_GRAPH_ACCESS_COMPUTE_WRITE] =
+	{
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL,
+		true
+	},
+	[VK_GRAPH_ACCESS_INDIRECT_READ] =
+	{
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		false
+	},
+	[VK_GRAPH_ACCESS_COLOR_WRITE] =
+	{
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		true
+	},
+	[VK_GRAPH_ACCESS_DEPTH_WRITE] =
+	{
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+		true
+	},
+	[VK_GRAPH_ACCESS_PRESENT] =
+	{
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		false
+	},
+	[VK_GRAPH_ACCESS_HOST_READ] =
+	{
+		VK_PIPELINE_STAGE_HOST_BIT,
+		VK_ACCESS_HOST_READ_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		false
+	},
+};
+
+struct vk_graph_use
+{
+	uint32_t             resource;
+	enum vk_graph_access access;
+	// Attachments only, cleared on load.
+	bool                 clear;
+	// Attachments only, worked out by vk_graph_record.
+	VkAttachmentLoadOp   load_op;
+	VkAttachmentStoreOp  store_op;
+};
+
+struct vk_graph_pass;
+
+typedef void (*vk_graph_record_func)(
+	struct vk_context*    vk,
+	VkCommandBuffer       command_buffer,
+	struct vk_graph_pass* pass,
+	void*                 data);
+
+struct vk_graph_pass
+{
+	const char*          name;
+	vk_graph_record_func record;
+	struct vk_graph_use  uses[VK_GRAPH_MAX_USES];
+	uint32_t             uses_len;
+};
+
+struct vk_graph_resource
+{
+	const char*           name;
+	VkImage               image;
+	VkImageAspectFlags    aspect;
+	VkBuffer              buffer;
+	// How the previous frame last used it. Worked out for transients.
+	enum vk_graph_access  initial;
+	// Images only. Whether what was in it before the frame is wanted, otherwise
+	// it starts from UNDEFINED.
+	bool                  keep_contents;
+	// How it has to be left at the end of the frame, e.g. for presenting.
+	enum vk_graph_access  final;
+
+	// Transients only, created by vk_graph_create_transients into these.
+	bool                  transient;
+	VkImage*              transient_image;
+	VkImageView*          transient_view;
+	struct vk_allocation* transient_memory;
+	VkFormat              format;
+	VkSampleCountFlagBits samples;
+	VkImageUsageFlags     usage;
+
+	// Passes of the first and last uses, VK_GRAPH_UNUSED if there are none.
+	uint32_t              first_pass;
+	uint32_t              last_pass;
+
+	// Where recording has got to. Writes not yet waited on by everything, and
+	// reads since the last write, which barriers have made it visible to.
+	VkImageLayout         layout;
+	VkPipelineStageFlags  write_stages;
+	VkAccessFlags         write_access;
+	VkPipelineStageFlags  read_stages;
+	VkAccessFlags         read_access;
+};
+
+struct vk_graph
+{
+	struct vk_graph_resource resources[VK_GRAPH_MAX_RESOURCES];
+	uint32_t                 resources_len;
+	struct vk_graph_pass     passes[VK_GRAPH_MAX_PASSES];
+	uint32_t                 passes_len;
+};
+
+void vk_graph_init(struct vk_graph* graph)
+{
+	memset(graph, 0, sizeof(*graph));
+}
+
+struct vk_graph_resource* vk_graph_add_resource(struct vk_graph* graph, const char* name, uint32_t* idx)
+{
+	if(graph->resources_len == VK_GRAPH_MAX_RESOURCES)
+	{
+		printf("At most %u resources in a render graph.\n", VK_GRAPH_MAX_RESOURCES);
+		PANIC();
+	}
+
+	*idx = graph->resources_len++;
+	struct vk_graph_resource* resource = &graph->resources[*idx];
+	resource->name       = name;
+	resource->first_pass = VK_GRAPH_UNUSED;
+	resource->last_pass  = VK_GRAPH_UNUSED;
+	return resource;
+}
+
+uint32_t vk_graph_import_image(
+	struct vk_graph*     graph,
+	const char*          name,
+	VkImage              image,
+	VkImageAspectFlags   aspect,
+	enum vk_graph_access initial,
+	bool                 keep_contents,
+	enum vk_graph_access final)
+{
+	uint32_t idx;
+	struct vk_graph_resource* resource = vk_graph_add_resource(graph, name, &idx);
+	resource->image         = image;
+	resource->aspect        = aspect;
+	resource->initial       = initial;
+	resource->keep_contents = keep_contents;
+	resource->final         = final;
+	return idx;
+}
+
+uint32_t vk_graph_import_buffer(
+	struct vk_graph*     graph,
+	const char*          name,
+	VkBuffer             buffer,
+	enum vk_graph_access initial,
+	enum vk_graph_access final)
+{
+	uint32_t idx;
+	struct vk_graph_resource* resource = vk_graph_add_resource(graph, name, &idx);
+	resource->buffer        = buffer;
+	resource->initial       = initial;
+	resource->keep_contents = true;
+	resource->final         = final;
+	return idx;
+}
+
+// An attachment which only lives within the frame. The image may not exist
+// yet, it's whatever *image holds when the graph is built.
+uint32_t vk_graph_transient_image(
+	struct vk_graph*      graph,
+	const char*           name,
+	VkImage*              image,
+	VkImageView*          view,
+	struct vk_allocation* memory,
+	VkFormat              format,
+	VkSampleCountFlagBits samples,
+	VkImageUsageFlags     usage,
+	VkImageAspectFlags    aspect)
+{
+	uint32_t idx;
+	struct vk_graph_resource* resource = vk_graph_add_resource(graph, name, &idx);
+	resource->image            = *image;
+	resource->aspect           = aspect;
+	resource->transient        = true;
+	resource->transient_image  = image;
+	resource->transient_view   = view;
+	resource->transient_memory = memory;
+	resource->format           = format;
+	resource->samples          = samples;
+	resource->usage            = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	return idx;
+}
+
+struct vk_graph_pass* vk_graph_add_pass(struct vk_graph* graph, const char* name, vk_graph_record_func record)
+{
+	if(graph->passes_len == VK_GRAPH_MAX_PASSES)
+	{
+		printf("At most %u passes in a render graph.\n", VK_GRAPH_MAX_PASSES);
+		PANIC();
+	}
+
+	struct vk_graph_pass* pass = &graph->passes[graph->passes_len++];
+	pass->name   = name;
+	pass->record = record;
+	return pass;
+}
+
+void vk_graph_use(struct vk_graph_pass* pass, uint32_t resource, enum vk_graph_access access, bool clear)
+{
+	if(pass->uses_len == VK_GRAPH_MAX_USES)
+	{
+		printf("At most %u resource uses in render graph pass %s.\n", VK_GRAPH_MAX_USES, pass->name);
+		PANIC();
+	}
+
+	struct vk_graph_use* use = &pass->uses[pass->uses_len++];
+	use->resource = resource;
+	use->access   = access;
+	use->clear    = clear;
+}
+
+// Alias group of a transient image, or -1 if it isn't one of the last
+// vk_graph_create_transients.
+int32_t vk_graph_alias_group(struct vk_context* vk, VkImage image)
+{
+	struct vk_graph_aliases* aliases = &vk->graph_aliases;
+	for(uint32_t i = 0; i < aliases->images_len; i++)
+	{
+		if(image != VK_NULL_HANDLE && aliases->images[i] == image)
+		{
+			return aliases->groups[i];
+		}
+	}
+	return -1;
+}
+
+void vk_graph_lifetimes(struct vk_graph* graph)
+{
+	for(uint32_t p = 0; p < graph->passes_len; p++)
+	{
+		struct vk_graph_pass* pass = &graph->passes[p];
+		for(uint32_t u = 0; u < pass->uses_len; u++)
+		{
+			struct vk_graph_resource* resource = &graph->resources[pass->uses[u].resource];
+			if(resource->first_pass == VK_GRAPH_UNUSED)
+			{
+				resource->first_pass = p;
+			}
+			resource->last_pass = p;
+		}
+	}
+}
+
+// The access of the resource's last use in a pass.
+enum vk_graph_access vk_graph_last_access(struct vk_graph* graph, uint32_t pass_idx, uint32_t resource)
+{
+	enum vk_graph_access access = VK_GRAPH_ACCESS_NONE;
+	struct vk_graph_pass* pass = &graph->passes[pass_idx];
+	for(uint32_t u = 0; u < pass->uses_len; u++)
+	{
+		if(pass->uses[u].resource == resource)
+		{
+			access = pass->uses[u].access;
+		}
+	}
+	return access;
+}
+
+// A transient's memory was last used, in the previous frame, by whichever
+// member of its alias group is used last.
+void vk_graph_transient_initial(struct vk_context* vk, struct vk_graph* graph)
+{
+	for(uint32_t r = 0; r < graph->resources_len; r++)
+	{
+		struct vk_graph_resource* resource = &graph->resources[r];
+		if(!resource->transient || resource->first_pass == VK_GRAPH_UNUSED)
+		{
+			continue;
+		}
+
+		int32_t group = vk_graph_alias_group(vk, resource->image);
+		uint32_t last = r;
+		for(uint32_t o = 0; o < graph->resources_len; o++)
+		{
+			struct vk_graph_resource* other = &graph->resources[o];
+			if(other->transient &&
+			   other->last_pass != VK_GRAPH_UNUSED &&
+			   other->last_pass > graph->resources[last].last_pass &&
+			   group >= 0 && vk_graph_alias_group(vk, other->image) == group)
+			{
+				last = o;
+			}
+		}
+		resource->initial = vk_graph_last_access(graph, graph->resources[last].last_pass, last);
+	}
+}
+
+void vk_graph_reset_state(struct vk_graph_resource* resource)
+{
+	const struct vk_graph_access_info* info = &vk_graph_access_infos[resource->initial];
+	bool read = !info->writes && resource->initial != VK_GRAPH_ACCESS_NONE;
+	resource->layout       = resource->keep_contents ? info->layout : VK_IMAGE_LAYOUT_UNDEFINED;
+	resource->write_stages = info->writes ? info->stages : 0;
+	resource->write_access = info->writes ? info->access : 0;
+	resource->read_stages  = read ? info->stages : 0;
+	resource->read_access  = 0;
+}
+
+// Batched up for one vkCmdPipelineBarrier per pass.
+struct vk_graph_barriers
+{
+	VkPipelineStageFlags  src_stages;
+	VkPipelineStageFlags  dst_stages;
+	VkImageMemoryBarrier  images[VK_GRAPH_MAX_RESOURCES];
+	uint32_t              images_len;
+	VkBufferMemoryBarrier buffers[VK_GRAPH_MAX_RESOURCES];
+	uint32_t              buffers_len;
+};
+
+// Moves the resource on to the access, adding a barrier if the access has to
+// wait on what came before it. Reads after reads, and reads a barrier has
+// already made a write visible to, don't need one.
+void vk_graph_transition(
+	struct vk_graph_resource*          resource,
+	const struct vk_graph_access_info* info,
+	VkPipelineStageFlags               alias_stages,
+	VkAccessFlags                      alias_access,
+	struct vk_graph_barriers*          barriers)
+{
+	bool layout_change = resource->image != VK_NULL_HANDLE && resource->layout != info->layout;
+
+	VkPipelineStageFlags src_stages = 0;
+	VkAccessFlags src_access = 0;
+	bool needed = false;
+	if(info->writes || layout_change)
+	{
+		// Write after write or read, or a layout transition, which is a write.
+		src_stages = resource->write_stages | resource->read_stages | alias_stages;
+		src_access = resource->write_access | alias_access;
+		needed     = src_stages != 0 || layout_change;
+	}
+	else if(resource->write_stages != 0 &&
+		((info->stages & ~resource->read_stages) || (info->access & ~resource->read_access)))
+	{
+		src_stages = resource->write_stages;
+		src_access = resource->write_access;
+		needed     = true;
+	}
+
+	if(needed)
+	{
+		if(src_stages == 0)
+		{
+			src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		}
+		barriers->src_stages |= src_stages;
+		barriers->dst_stages |= info->stages;
+
+		if(resource->image != VK_NULL_HANDLE)
+		{
+			VkImageMemoryBarrier* barrier = &barriers->images[barriers->images_len++];
+			memset(barrier, 0, sizeof(*barrier));
+			barrier->sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier->srcAccessMask                   = src_access;
+			barrier->dstAccessMask                   = info->access;
+			barrier->oldLayout                       = resource->layout;
+			barrier->newLayout                       = info->layout;
+			barrier->srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+			barrier->dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+			barrier->image                           = resource->image;
+			barrier->subresourceRange.aspectMask     = resource->aspect;
+			barrier->subresourceRange.baseMipLevel   = 0;
+			barrier->subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
+			barrier->subresourceRange.baseArrayLayer = 0;
+			barrier->subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+		}
+		else
+		{
+			VkBufferMemoryBarrier* barrier = &barriers->buffers[barriers->buffers_len++];
+			memset(barrier, 0, sizeof(*barrier));
+			barrier->sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier->srcAccessMask       = src_access;
+			barrier->dstAccessMask       = info->access;
+			barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier->buffer              = resource->buffer;
+			barrier->offset              = 0;
+			barrier->size                = VK_WHOLE_SIZE;
+		}
+	}
+
+	if(info->writes)
+	{
+		resource->write_stages = info->stages;
+		resource->write_access = info->access;
+		resource->read_stages  = 0;
+		resource->read_access  = 0;
+	}
+	else if(layout_change)
+	{
+		// Later reads in other stages still have to wait on the transition.
+		resource->write_stages = info->stages;
+		resource->write_access = 0;
+		resource->read_stages  = info->stages;
+		resource->read_access  = info->access;
+	}
+	else
+	{
+		resource->read_stages |= info->stages;
+		resource->read_access |= info->access;
+	}
+	if(resource->image != VK_NULL_HANDLE)
+	{
+		resource->layout = info->layout;
+	}
+}
+
+void vk_graph_flush_barriers(VkCommandBuffer command_buffer, struct vk_graph_barriers* barriers)
+{
+	if(barriers->images_len == 0 && barriers->buffers_len == 0)
+	{
+		return;
+	}
+	vkCmdPipelineBarrier(
+		command_buffer,
+		barriers->src_stages,
+		barriers->dst_stages,
+		0,
+		0, 0,
+		barriers->buffers_len, barriers->buffers,
+		barriers->images_len, barriers->images);
+}
+
+// Load and store ops for a use of an attachment. Its contents are only loaded
+// if something earlier in the frame wrote them, or they're kept from before
+// it, and only stored if something later uses them or they have to outlive
+// the frame.
+void vk_graph_attachment_ops(struct vk_graph* graph, uint32_t pass_idx, struct vk_graph_use* use)
+{
+	struct vk_graph_resource* resource = &graph->resources[use->resource];
+
+	bool defined = resource->keep_contents || resource->first_pass < pass_idx;
+	use->load_op =
+		use->clear ? VK_ATTACHMENT_LOAD_OP_CLEAR :
+		defined    ? VK_ATTACHMENT_LOAD_OP_LOAD :
+		             VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+	bool needed = resource->last_pass > pass_idx || resource->final != VK_GRAPH_ACCESS_NONE || resource->keep_contents;
+	use->store_op = needed ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+	// Lazily allocated memory might never be backed at all, so nothing can
+	// count on finding what was written to a transient after its pass.
+	if(resource->transient && needed)
+	{
+		printf("Transient attachment %s is used after render graph pass %s.\n", resource->name, graph->passes[pass_idx].name);
+		PANIC();
+	}
+}
+
+// Records every pass in order, each preceded by the barriers its uses need,
+// then whatever gets resources to their final accesses.
+void vk_graph_record(
+	struct vk_context* vk,
+	struct vk_graph*   graph,
+	VkCommandBuffer    command_buffer,
+	void*              data)
+{
+	vk_graph_lifetimes(graph);
+	vk_graph_transient_initial(vk, graph);
+	for(uint32_t r = 0; r < graph->resources_len; r++)
+	{
+		vk_graph_reset_state(&graph->resources[r]);
+	}
+
+	for(uint32_t p = 0; p < graph->passes_len; p++)
+	{
+		struct vk_graph_pass* pass = &graph->passes[p];
+		struct vk_graph_barriers barriers;
+		barriers.src_stages  = 0;
+		barriers.dst_stages  = 0;
+		barriers.images_len  = 0;
+		barriers.buffers_len = 0;
+
+		for(uint32_t u = 0; u < pass->uses_len; u++)
+		{
+			struct vk_graph_use* use = &pass->uses[u];
+			struct vk_graph_resource* resource = &graph->resources[use->resource];
+
+			// Several uses of one resource in a pass wait together, on the first.
+			bool first_in_pass = true;
+			struct vk_graph_access_info info = vk_graph_access_infos[use->access];
+			for(uint32_t o = 0; o < pass->uses_len; o++)
+			{
+				if(pass->uses[o].resource != use->resource)
+				{
+					continue;
+				}
+				if(o < u)
+				{
+					first_in_pass = false;
+					break;
+				}
+				const struct vk_graph_access_info* other = &vk_graph_access_infos[pass->uses[o].access];
+				info.stages |= other->stages;
+				info.access |= other->access;
+				info.writes |= other->writes;
+			}
+
+			if(use->access == VK_GRAPH_ACCESS_COLOR_WRITE || use->access == VK_GRAPH_ACCESS_DEPTH_WRITE)
+			{
+				vk_graph_attachment_ops(graph, p, use);
+			}
+			if(!first_in_pass)
+			{
+				continue;
+			}
+
+			// The first use of a transient also has to wait on whatever used its
+			// memory earlier in the frame.
+			VkPipelineStageFlags alias_stages = 0;
+			VkAccessFlags alias_access = 0;
+			int32_t group = resource->transient ? vk_graph_alias_group(vk, resource->image) : -1;
+			if(group >= 0 && resource->first_pass == p)
+			{
+				for(uint32_t o = 0; o < graph->resources_len; o++)
+				{
+					struct vk_graph_resource* other = &graph->resources[o];
+					if(other != resource &&
+					   other->last_pass != VK_GRAPH_UNUSED &&
+					   other->last_pass < p &&
+					   vk_graph_alias_group(vk, other->image) == group)
+					{
+						alias_stages |= other->write_stages | other->read_stages;
+						alias_access |= other->write_access;
+					}
+				}
+			}
+
+			vk_graph_transition(resource, &info, alias_stages, alias_access, &barriers);
+		}
+		vk_graph_flush_barriers(command_buffer, &barriers);
+
+		pass->record(vk, command_buffer, pass, data);
+	}
+
+	struct vk_graph_barriers barriers;
+	barriers.src_stages  = 0;
+	barriers.dst_stages  = 0;
+	barriers.images_len  = 0;
+	barriers.buffers_len = 0;
+	for(uint32_t r = 0; r < graph->resources_len; r++)
+	{
+		struct vk_graph_resource* resource = &graph->resources[r];
+		if(resource->final != VK_GRAPH_ACCESS_NONE)
+		{
+			vk_graph_transition(resource, &vk_graph_access_infos[resource->final], 0, 0, &barriers);
+		}
+	}
+	vk_graph_flush_barriers(command_buffer, &barriers);
+}
+
+// Fills in the layout and the load and store ops of a pass's attachment.
+void vk_graph_attachment(
+	struct vk_graph_pass*      pass,
+	uint32_t                   resource,
+	VkRenderingAttachmentInfo* attachment)
+{
+	for(uint32_t u = 0; u < pass->uses_len; u++)
+	{
+		struct vk_graph_use* use = &pass->uses[u];
+		if(use->resource == resource)
+		{
+			attachment->imageLayout = vk_graph_access_infos[use->access].layout;
+			attachment->loadOp      = use->load_op;
+			attachment->storeOp     = use->store_op;
+			return;
+		}
+	}
+
+	printf("Render graph pass %s doesn't use that attachment.\n", pass->name);
+	PANIC();
+}
+
+// Creates the graph's transient images, preferring lazily allocated memory,
+// which tile based GPUs may never have to back at all. Images whose lifetimes
+// don't overlap share memory where their requirements allow. The memory of
+// each group belongs to its first image, the others are left with an empty
+// allocation, so retiring them all frees it once.
+void vk_graph_create_transients(struct vk_context* vk, struct vk_graph* graph)
+{
+	vk_graph_lifetimes(graph);
+
+	struct vk_graph_aliases* aliases = &vk->graph_aliases;
+	aliases->images_len = 0;
+
+	VkMemoryRequirements group_reqs[VK_GRAPH_MAX_TRANSIENTS];
+	uint32_t group_last_pass[VK_GRAPH_MAX_TRANSIENTS];
+	uint32_t group_owner[VK_GRAPH_MAX_TRANSIENTS];
+	uint32_t groups_len = 0;
+	uint32_t resource_groups[VK_GRAPH_MAX_RESOURCES];
+
+	// In order of first use, so each group's lifetimes follow one another.
+	for(uint32_t p = 0; p < graph->passes_len; p++)
+	{
+		for(uint32_t r = 0; r < graph->resources_len; r++)
+		{
+			struct vk_graph_resource* resource = &graph->resources[r];
+			if(!resource->transient || resource->first_pass != p)
+			{
+				continue;
+			}
+			if(aliases->images_len == VK_GRAPH_MAX_TRANSIENTS)
+			{
+				printf("At most %u transient images.\n", VK_GRAPH_MAX_TRANSIENTS);
+				PANIC();
+			}
+
+			vk_create_image(
+				vk->device,
+				resource->transient_image,
+				vk->swap_extent.width,
+				vk->swap_extent.height,
+				resource->format,
+				resource->samples,
+				resource->usage);
+			resource->image = *resource->transient_image;
+
+			VkMemoryRequirements reqs = {};
+			vkGetImageMemoryRequirements(vk->device, resource->image, &reqs);
+
+			uint32_t g = 0;
+			for(; g < groups_len; g++)
+			{
+				if(group_last_pass[g] < p && (group_reqs[g].memoryTypeBits & reqs.memoryTypeBits))
+				{
+					break;
+				}
+			}
+			if(g == groups_len)
+			{
+				group_reqs[g]      = reqs;
+				group_owner[g]     = r;
+				groups_len++;
+			}
+			else
+			{
+				group_reqs[g].size            = reqs.size > group_reqs[g].size ? reqs.size : group_reqs[g].size;
+				group_reqs[g].alignment       = reqs.alignment > group_reqs[g].alignment ? reqs.alignment : group_reqs[g].alignment;
+				group_reqs[g].memoryTypeBits &= reqs.memoryTypeBits;
+			}
+			group_last_pass[g] = resource->last_pass;
+			resource_groups[r] = g;
+
+			aliases->images[aliases->images_len] = resource->image;
+			aliases->groups[aliases->images_len] = g;
+			aliases->images_len++;
+		}
+	}
+
+	for(uint32_t g = 0; g < groups_len; g++)
+	{
+		vk_allocate_memory(
+			vk->allocator,
+			group_reqs[g],
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+			true,
+			graph->resources[group_owner[g]].transient_memory);
+	}
+
+	for(uint32_t r = 0; r < graph->resources_len; r++)
+	{
+		struct vk_graph_resource* resource = &graph->resources[r];
+		if(!resource->transient || resource->first_pass == VK_GRAPH_UNUSED)
+		{
+			continue;
+		}
+
+		uint32_t owner = group_owner[resource_groups[r]];
+		struct vk_allocation* memory = graph->resources[owner].transient_memory;
+		if(owner != r)
+		{
+			*resource->transient_memory = (struct vk_allocation){};
+		}
+		VK_VERIFY(vkBindImageMemory(vk->device, resource->image, memory->memory, memory->offset));
+
+		vk_create_image_view(vk->device, resource->transient_view, resource->image, resource->format, resource->aspect);
+	}
+}
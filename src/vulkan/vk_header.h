@@ -1,11 +1,36 @@
 #define VK_DEBUG 1
+// Starts in IMMEDIATE rather than MAILBOX. Can also be changed at runtime with
+// vk_set_present_mode.
 #define VK_IMMEDIATE 0
+// Times each render pass on the GPU, and prints rolling stats every
+// VK_GPU_PROFILE_PRINT_FRAMES frames.
+#define VK_GPU_PROFILE 1
+#define VK_GPU_PROFILE_PRINT_FRAMES 300
+// Submits each frame slot's recorded command buffers again until the scene's
+// structure changes, instead of recording every frame. Can also be changed at
+// runtime with vk_set_command_buffer_reuse.
+#define VK_REUSE_COMMAND_BUFFERS 1
 
 #define MAX_SWAP_IMAGES 4
 #define MAX_IN_FLIGHT_FRAMES 2
 #define DEPTH_ATTACHMENT_FORMAT VK_FORMAT_D32_SFLOAT
+// Auto MSAA steps down a tier whenever the average frame time over a window
+// is over target. A little slack over 60Hz so vsync jitter alone doesn't.
+#define VK_MSAA_AUTO_TARGET_MS 18.0f
+#define VK_MSAA_AUTO_WINDOW_FRAMES 60
+#define VK_MSAA_AUTO_SKIP_FRAMES 10
+#define VK_MSAA_AUTO_SECONDS 5.0f
+// The frame cap sleeps until this long before the deadline, then spins the
+// rest, since sleeps routinely overshoot by a good fraction of a millisecond.
+#define VK_PACING_SPIN_NS 1500000
+// Relative to the working directory, alongside shaders/, which is next to the
+// binary.
+#define PIPELINE_CACHE_FNAME "pipeline_cache.bin"
+// Built by build.sh from bin/shaders and bin/textures.
+#define ASSET_PACK_FNAME "assets.pack"
 
 #include <vulkan/vulkan.h>
+#include <pthread.h>
 
 VkResult vk_verify_macro_result;
 
@@ -16,13 +41,19 @@ VkResult vk_verify_macro_result;
 							PANIC();\
 						}\
 
-#define STB_IMAGE_IMPLEMENTATION
-#define STBI_ONLY_BMP
-#include "../extern/stb_image.h"
-
+#include "vk_memory.c"
 #include "vk_structs.c"
 #include "vk_static_data.c"
 #include "vk_helpers.c"
+#include "vk_graph.c"
+#include "vk_upload.c"
+#include "vk_gpu_profiler.c"
+#include "vk_compute.c"
+#include "vk_record.c"
+#include "vk_reuse.c"
+#include "vk_instances.c"
 #include "vk_init.c"
+#include "vk_msaa.c"
+#include "vk_pacing.c"
 #include "vk_loop.c"
 
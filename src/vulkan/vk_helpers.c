@@ -1,25 +1,40 @@
-VkShaderModule vk_create_shader_module(VkDevice device, const char* fname)
+// Shaders come straight out of the mapped asset pack. Loose files are only
+// read if the pack is missing or doesn't contain the shader, e.g. during
+// shader iteration without rebuilding the pack.
+VkShaderModule vk_create_shader_module(VkDevice device, struct asset_pack* assets, const char* fname)
 {
-	FILE* file = fopen(fname, "r");
-	if(!file)
+	void*  src = 0;
+	size_t fsize = 0;
+	bool   loose = false;
+
+	struct asset_pack_entry* entry = asset_pack_find(assets, fname);
+	if(entry)
 	{
-		printf("Failed to open file: %s\n", fname);
-		PANIC();
+		src   = asset_pack_data(assets, entry);
+		fsize = entry->size;
 	}
-	fseek(file, 0, SEEK_END);
-	uint32_t fsize = ftell(file);
-	fseek(file, 0, SEEK_SET);
-	char src[fsize];
-
-	char c;
-	uint32_t i = 0;
-	while((c = fgetc(file)) != EOF)
+	else
 	{
-		src[i] = c;
-		i++;
+		FILE* file = fopen(fname, "rb");
+		if(!file)
+		{
+			printf("Failed to open file: %s\n", fname);
+			PANIC();
+		}
+		fseek(file, 0, SEEK_END);
+		fsize = ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		src = malloc(fsize);
+		if(!src || fread(src, 1, fsize, file) != fsize)
+		{
+			printf("Failed to read file: %s\n", fname);
+			PANIC();
+		}
+		fclose(file);
+		loose = true;
 	}
-	fclose(file);
-	
+
 	VkShaderModuleCreateInfo info = {};
 	info.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
 	info.codeSize = fsize;
@@ -32,38 +47,115 @@ VkShaderModule vk_create_shader_module(VkDevice device, const char* fname)
 		printf("Error %i: Failed to create shader module.\n", res);
 		PANIC();
 	}
+
+	if(loose)
+	{
+		free(src);
+	}
 	
 	return module;
 }
 
-uint32_t vk_get_memory_type(
-	VkPhysicalDevice      physical_device, 
-	uint32_t              type_filter, 
-	VkMemoryPropertyFlags properties)
+void vk_get_pipeline_cache_header(struct vk_context* vk, struct vk_pipeline_cache_header* header)
 {
-	VkPhysicalDeviceMemoryProperties mem_properties;
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
-	
-	for(uint32_t i = 0; i < mem_properties.memoryTypeCount; i++)
+	VkPhysicalDeviceIDProperties id_properties = {};
+	id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &id_properties;
+	vkGetPhysicalDeviceProperties2(vk->physical_device, &properties);
+
+	memset(header, 0, sizeof(*header));
+	header->magic          = PIPELINE_CACHE_MAGIC;
+	header->vendor_id      = properties.properties.vendorID;
+	header->device_id      = properties.properties.deviceID;
+	header->driver_version = properties.properties.driverVersion;
+	memcpy(header->device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+	memcpy(header->pipeline_cache_uuid, properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+// Creates vk->pipeline_cache, seeded from fname if it exists and was written
+// by this device and driver. Anything else starts an empty cache.
+void vk_load_pipeline_cache(struct vk_context* vk, const char* fname)
+{
+	struct vk_pipeline_cache_header expected;
+	vk_get_pipeline_cache_header(vk, &expected);
+
+	void*  data = 0;
+	size_t data_size = 0;
+
+	FILE* file = fopen(fname, "rb");
+	if(file)
 	{
-		if((type_filter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties)
+		struct vk_pipeline_cache_header header;
+		if(fread(&header, sizeof(header), 1, file) == 1)
 		{
-			return i;
+			uint64_t file_data_size = header.data_size;
+			header.data_size = 0;
+			if(memcmp(&header, &expected, sizeof(header)) == 0)
+			{
+				data = malloc(file_data_size);
+				if(data && fread(data, 1, file_data_size, file) == file_data_size)
+				{
+					data_size = file_data_size;
+				}
+			}
+			else
+			{
+				printf("Pipeline cache %s is from another device or driver, ignoring it.\n", fname);
+			}
 		}
+		fclose(file);
+	}
+
+	VkPipelineCacheCreateInfo info = {};
+	info.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	info.initialDataSize = data_size;
+	info.pInitialData    = data_size > 0 ? data : 0;
+	VK_VERIFY(vkCreatePipelineCache(vk->device, &info, 0, &vk->pipeline_cache));
+
+	free(data);
+}
+
+void vk_save_pipeline_cache(struct vk_context* vk, const char* fname)
+{
+	size_t data_size = 0;
+	VK_VERIFY(vkGetPipelineCacheData(vk->device, vk->pipeline_cache, &data_size, 0));
+
+	void* data = malloc(data_size);
+	if(!data)
+	{
+		return;
+	}
+	VK_VERIFY(vkGetPipelineCacheData(vk->device, vk->pipeline_cache, &data_size, data));
+
+	struct vk_pipeline_cache_header header;
+	vk_get_pipeline_cache_header(vk, &header);
+	header.data_size = data_size;
+
+	FILE* file = fopen(fname, "wb");
+	if(!file)
+	{
+		printf("Failed to open file for writing: %s\n", fname);
+		free(data);
+		return;
 	}
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(data, 1, data_size, file);
+	fclose(file);
 
-	printf("Failed to find suitable memory type for buffer.\n");
-	PANIC();
+	free(data);
 }
 
 void vk_allocate_buffer(
-	VkDevice              device,
-	VkPhysicalDevice      physical_device,
+	struct vk_allocator*  allocator,
 	VkBuffer*             buffer,
-	VkDeviceMemory*       memory,
+	struct vk_allocation* memory,
 	VkDeviceSize          size, 
 	VkBufferUsageFlags    usage, 
-	VkMemoryPropertyFlags properties)
+	VkMemoryPropertyFlags properties,
+	VkMemoryPropertyFlags preferred_properties)
 {
 	VkBufferCreateInfo buf_info = {};
 	buf_info.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -71,7 +163,7 @@ void vk_allocate_buffer(
 	buf_info.usage       = usage;
 	buf_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	VkResult res = vkCreateBuffer(device, &buf_info, 0, buffer);
+	VkResult res = vkCreateBuffer(allocator->device, &buf_info, 0, buffer);
 	if(res != VK_SUCCESS)
 	{
 		printf("Error %i: Failed to create buffer.\n", res);
@@ -79,32 +171,21 @@ void vk_allocate_buffer(
 	}
 
 	VkMemoryRequirements mem_reqs;
-	vkGetBufferMemoryRequirements(device, *buffer, &mem_reqs);
-
-	VkPhysicalDeviceMemoryProperties mem_properties;
-	vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+	vkGetBufferMemoryRequirements(allocator->device, *buffer, &mem_reqs);
 
-	VkMemoryAllocateInfo alloc_info = {};
-	alloc_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize  = mem_reqs.size;
-	alloc_info.memoryTypeIndex = vk_get_memory_type(
-		physical_device,
-		mem_reqs.memoryTypeBits, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	vk_allocate_memory(allocator, mem_reqs, properties, preferred_properties, false, memory);
 
-	res = vkAllocateMemory(device, &alloc_info, 0, memory);
+	res = vkBindBufferMemory(allocator->device, *buffer, memory->memory, memory->offset);
 	if(res != VK_SUCCESS)
 	{
-		printf("Error %i: Failed to allocate buffer memory.\n", res);
+		printf("Error %i: Failed to bind buffer memory.\n", res);
+		PANIC();
 	}
-	vkBindBufferMemory(device, *buffer, *memory, 0);
 }
 
-void vk_allocate_image(
+void vk_create_image(
 	VkDevice          device,
-	VkPhysicalDevice  physical_device,
 	VkImage*          image,
-	VkDeviceMemory*   memory,
 	uint32_t          width,
 	uint32_t          height,
 	VkFormat          format,
@@ -131,25 +212,26 @@ void vk_allocate_image(
 		printf("Error %i: Failed to create image.\n", res);
 		PANIC();
 	}
+}
+
+void vk_allocate_image(
+	struct vk_allocator*  allocator,
+	VkImage*              image,
+	struct vk_allocation* memory,
+	uint32_t              width,
+	uint32_t              height,
+	VkFormat              format,
+	uint32_t              samples,
+	VkImageUsageFlags     usage_mask)
+{
+	vk_create_image(allocator->device, image, width, height, format, samples, usage_mask);
 
 	VkMemoryRequirements mem_reqs = {};
-	vkGetImageMemoryRequirements(device, *image, &mem_reqs);
+	vkGetImageMemoryRequirements(allocator->device, *image, &mem_reqs);
 
-	VkMemoryAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = mem_reqs.size;
-	alloc_info.memoryTypeIndex = vk_get_memory_type(
-		physical_device,
-		mem_reqs.memoryTypeBits, 
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	vk_allocate_memory(allocator, mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, true, memory);
 
-	res = vkAllocateMemory(device, &alloc_info, 0, memory);
-	if(res != VK_SUCCESS) 
-	{
-		printf("Error %i: Failed to allocate image memory..\n", res);
-		PANIC();
-	}
-	res = vkBindImageMemory(device, *image, *memory, 0);
+	VkResult res = vkBindImageMemory(allocator->device, *image, memory->memory, memory->offset);
 	if(res != VK_SUCCESS) 
 	{
 		printf("Error %i: Failed to bind image memory.\n", res);
@@ -184,81 +266,55 @@ void vk_create_image_view(
 }
 
 void vk_allocate_image_and_view(
-	VkDevice           device,
-	VkPhysicalDevice   physical_device,
-	VkImage*           image,
-	VkDeviceMemory*    memory,
-	VkImageView*       view,
-	uint32_t           width,
-	uint32_t           height,
-	VkFormat           format,
-	uint32_t           samples,
-	VkImageUsageFlags  usage_mask,
-	VkImageAspectFlags aspect_mask)
+	struct vk_allocator*  allocator,
+	VkImage*              image,
+	struct vk_allocation* memory,
+	VkImageView*          view,
+	uint32_t              width,
+	uint32_t              height,
+	VkFormat              format,
+	uint32_t              samples,
+	VkImageUsageFlags     usage_mask,
+	VkImageAspectFlags    aspect_mask)
 {
-	vk_allocate_image(device, physical_device, image, memory, width, height, format, samples, usage_mask);
-	vk_create_image_view(device, view, *image, format, aspect_mask);
+	vk_allocate_image(allocator, image, memory, width, height, format, samples, usage_mask);
+	vk_create_image_view(allocator->device, view, *image, format, aspect_mask);
 }
 
-void vk_allocate_texture(
-	VkDevice         device,
-	VkPhysicalDevice physical_device,
-	VkImage*         image,
-	VkDeviceMemory*  memory,
-	char*            fname)
+// Highest sample count at or below the tier's which both color and depth
+// attachments support. Auto is resolved to a concrete tier by the caller.
+VkSampleCountFlagBits vk_msaa_samples_for_quality(VkSampleCountFlags supported, enum vk_msaa_quality quality)
 {
-	int32_t tex_w;
-	int32_t tex_h;
-	int32_t tex_channels;
-	stbi_uc* pixels = stbi_load(fname, &tex_w, &tex_h, &tex_channels, STBI_rgb_alpha);
-	if(!pixels)
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	switch(quality)
 	{
-		printf("Failed to load image file: %s.\n", fname);
-		PANIC();
+		case VK_MSAA_QUALITY_LOW:    samples = VK_SAMPLE_COUNT_2_BIT; break;
+		case VK_MSAA_QUALITY_MEDIUM: samples = VK_SAMPLE_COUNT_4_BIT; break;
+		case VK_MSAA_QUALITY_HIGH:   samples = VK_SAMPLE_COUNT_8_BIT; break;
+		default:                     samples = VK_SAMPLE_COUNT_1_BIT; break;
+	}
+	while(samples > VK_SAMPLE_COUNT_1_BIT && !(supported & samples))
+	{
+		samples >>= 1;
 	}
+	return samples;
+}
 
-	VkDeviceSize img_size = tex_w * tex_h * 4;
-	VkBuffer staging_buf;
-	VkDeviceMemory staging_mem;
-
-	vk_allocate_buffer(
-		device, 
-		physical_device,
-		&staging_buf, 
-		&staging_mem,
-		img_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-	void* data;
-	vkMapMemory(device, staging_mem, 0, img_size, 0, &data);
-	memcpy(data, pixels, (size_t)img_size);
-	vkUnmapMemory(device, staging_mem);
-
-	stbi_image_free(pixels);
-
-	vk_allocate_image(
-		device,
-		physical_device,
-		image, 
-		memory,
-		tex_w,
-		tex_h,
-		VK_FORMAT_R8G8B8A8_SRGB,
-		VK_SAMPLE_COUNT_1_BIT,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+void vk_destroy_pipeline_resources(struct vk_context* vk, struct vk_pipeline_resources* resources)
+{
+	vkDestroyPipeline(vk->device, resources->pipeline, 0);
+	vkDestroyPipelineLayout(vk->device, resources->pipeline_layout, 0);
+	vkDestroyDescriptorPool(vk->device, resources->descriptor_pool, 0);
+	vkDestroyDescriptorSetLayout(vk->device, resources->descriptor_layout, 0);
+	memset(resources, 0, sizeof(*resources));
 }
 
-void vk_create_graphics_pipeline(
-	struct vk_context*               vk,
-	struct vk_pipeline_resources*    resources,
-	struct vk_descriptor_info*       descriptor_infos,
-	uint8_t                          descriptors_len,
-	struct vk_attribute_description* attribute_descriptions,
-	uint8_t                          attribute_descriptions_len,
-	size_t                           vertex_stride,
-	VkShaderModule                   shader_vert,
-	VkShaderModule                   shader_frag)
+void vk_create_descriptor_sets(
+	struct vk_context*            vk,
+	struct vk_pipeline_resources* resources,
+	struct vk_descriptor_info*    descriptor_infos,
+	uint8_t                       descriptors_len,
+	VkShaderStageFlags            stage_flags)
 {
 	VkDescriptorSetLayoutBinding ubo_bindings[descriptors_len] = {};
 	for(uint8_t i = 0; i < descriptors_len; i++)
@@ -266,7 +322,7 @@ void vk_create_graphics_pipeline(
 		ubo_bindings[i].binding         = i;
 		ubo_bindings[i].descriptorType  = descriptor_infos[i].type;
 		ubo_bindings[i].descriptorCount = 1;
-		ubo_bindings[i].stageFlags      = VK_SHADER_STAGE_VERTEX_BIT;
+		ubo_bindings[i].stageFlags      = stage_flags;
 	}
 
 	VkDescriptorSetLayoutCreateInfo layout_info = {};
@@ -279,41 +335,92 @@ void vk_create_graphics_pipeline(
 	for(uint8_t i = 0; i < descriptors_len; i++)
 	{
 		pool_sizes[i].type            = descriptor_infos[i].type;
-		pool_sizes[i].descriptorCount = 1;
+		pool_sizes[i].descriptorCount = MAX_IN_FLIGHT_FRAMES;
 	}
 
 	VkDescriptorPoolCreateInfo pool_info = {};
 	pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	pool_info.poolSizeCount = descriptors_len;
 	pool_info.pPoolSizes    = pool_sizes;
-	pool_info.maxSets       = 1;
+	pool_info.maxSets       = MAX_IN_FLIGHT_FRAMES;
 	VK_VERIFY(vkCreateDescriptorPool(vk->device, &pool_info, 0, &resources->descriptor_pool));
 
+	VkDescriptorSetLayout set_layouts[MAX_IN_FLIGHT_FRAMES];
+	for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
+	{
+		set_layouts[i] = resources->descriptor_layout;
+	}
+
 	VkDescriptorSetAllocateInfo alloc_info = {};
 	alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	alloc_info.descriptorPool     = resources->descriptor_pool;
-	alloc_info.descriptorSetCount = 1;
-	alloc_info.pSetLayouts        = &resources->descriptor_layout;
-	VK_VERIFY(vkAllocateDescriptorSets(vk->device, &alloc_info, &resources->descriptor_set));
-
-	VkDescriptorBufferInfo buf_infos[descriptors_len] = {};
-	VkWriteDescriptorSet write_descriptors[descriptors_len] = {};
-	for(uint8_t i = 0; i < descriptors_len; i++)
+	alloc_info.descriptorSetCount = MAX_IN_FLIGHT_FRAMES;
+	alloc_info.pSetLayouts        = set_layouts;
+	VK_VERIFY(vkAllocateDescriptorSets(vk->device, &alloc_info, resources->descriptor_sets));
+
+	// Each frame's set points at the same offsets, but within that frame's slice
+	// of the host visible buffer, or that frame's buffer when there's one per
+	// frame. Descriptors into any other buffer are shared by every frame.
+	// Storage images point at that frame's view.
+	for(uint32_t frame = 0; frame < MAX_IN_FLIGHT_FRAMES; frame++)
 	{
-		buf_infos[i].buffer = vk->host_visible_buffer;
-		buf_infos[i].offset = descriptor_infos[i].offset_in_buffer;
-		buf_infos[i].range  = descriptor_infos[i].range_in_buffer;
-
-		write_descriptors[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		write_descriptors[i].dstSet          = resources->descriptor_set;
-		write_descriptors[i].dstBinding      = i;
-		write_descriptors[i].dstArrayElement = 0;
-		write_descriptors[i].descriptorType  = descriptor_infos[i].type;
-		write_descriptors[i].descriptorCount = 1;
-		write_descriptors[i].pBufferInfo     = &buf_infos[i];
+		VkDescriptorBufferInfo buf_infos[descriptors_len] = {};
+		VkDescriptorImageInfo image_infos[descriptors_len] = {};
+		VkWriteDescriptorSet write_descriptors[descriptors_len] = {};
+		for(uint8_t i = 0; i < descriptors_len; i++)
+		{
+			write_descriptors[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write_descriptors[i].dstSet          = resources->descriptor_sets[frame];
+			write_descriptors[i].dstBinding      = i;
+			write_descriptors[i].dstArrayElement = 0;
+			write_descriptors[i].descriptorType  = descriptor_infos[i].type;
+			write_descriptors[i].descriptorCount = 1;
+
+			if(descriptor_infos[i].type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+			{
+				image_infos[i].imageView   = descriptor_infos[i].image_views[frame];
+				image_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+				write_descriptors[i].pImageInfo = &image_infos[i];
+				continue;
+			}
+
+			if(descriptor_infos[i].frame_buffers)
+			{
+				buf_infos[i].buffer = descriptor_infos[i].frame_buffers[frame];
+				buf_infos[i].offset = descriptor_infos[i].offset_in_buffer;
+			}
+			else if(descriptor_infos[i].buffer == VK_NULL_HANDLE)
+			{
+				buf_infos[i].buffer = vk->host_visible_buffer;
+				buf_infos[i].offset = vk->host_visible_stride * frame + descriptor_infos[i].offset_in_buffer;
+			}
+			else
+			{
+				buf_infos[i].buffer = descriptor_infos[i].buffer;
+				buf_infos[i].offset = descriptor_infos[i].offset_in_buffer;
+			}
+			buf_infos[i].range  = descriptor_infos[i].range_in_buffer;
+
+			write_descriptors[i].pBufferInfo = &buf_infos[i];
+		}
+
+		vkUpdateDescriptorSets(vk->device, descriptors_len, write_descriptors, 0, 0);
 	}
+}
 
-	vkUpdateDescriptorSets(vk->device, descriptors_len, write_descriptors, 0, 0);
+void vk_create_graphics_pipeline(
+	struct vk_context*               vk,
+	struct vk_pipeline_resources*    resources,
+	struct vk_descriptor_info*       descriptor_infos,
+	uint8_t                          descriptors_len,
+	struct vk_attribute_description* attribute_descriptions,
+	uint8_t                          attribute_descriptions_len,
+	size_t                           vertex_stride,
+	VkShaderModule                   shader_vert,
+	VkShaderModule                   shader_frag)
+{
+	vk_create_descriptor_sets(vk, resources, descriptor_infos, descriptors_len, VK_SHADER_STAGE_VERTEX_BIT);
+	vk->pipeline_samples = vk->render_samples;
 
 	// Shaders
 	uint8_t shader_infos_len = 2;
@@ -460,8 +567,67 @@ void vk_create_graphics_pipeline(
 	pipeline_info.stageCount          = shader_infos_len;
 	pipeline_info.pStages             = shader_infos;
 	pipeline_info.layout              = resources->pipeline_layout;
-	VK_VERIFY(vkCreateGraphicsPipelines(vk->device, VK_NULL_HANDLE, 1, &pipeline_info, 0, &resources->pipeline));
+	VK_VERIFY(vkCreateGraphicsPipelines(vk->device, vk->pipeline_cache, 1, &pipeline_info, 0, &resources->pipeline));
 
 	vkDestroyShaderModule(vk->device, shader_vert, 0);
 	vkDestroyShaderModule(vk->device, shader_frag, 0);
 }
+
+void vk_create_compute_pipeline(
+	struct vk_context*            vk,
+	struct vk_pipeline_resources* resources,
+	struct vk_descriptor_info*    descriptor_infos,
+	uint8_t                       descriptors_len,
+	VkShaderModule                shader_comp)
+{
+	vk_create_descriptor_sets(vk, resources, descriptor_infos, descriptors_len, VK_SHADER_STAGE_COMPUTE_BIT);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+	pipeline_layout_info.sType          = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts    = &resources->descriptor_layout;
+	VK_VERIFY(vkCreatePipelineLayout(vk->device, &pipeline_layout_info, 0, &resources->pipeline_layout));
+
+	VkComputePipelineCreateInfo pipeline_info = {};
+	pipeline_info.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_info.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_info.stage.module = shader_comp;
+	pipeline_info.stage.pName  = "main";
+	pipeline_info.layout       = resources->pipeline_layout;
+	VK_VERIFY(vkCreateComputePipelines(vk->device, vk->pipeline_cache, 1, &pipeline_info, 0, &resources->pipeline));
+
+	vkDestroyShaderModule(vk->device, shader_comp, 0);
+}
+
+void insert_image_memory_barrier(
+	VkCommandBuffer         command_buffer, 
+	VkImage                 image, 
+	VkImageAspectFlags      aspect_mask,
+	VkImageLayout           layout_old, 
+	VkImageLayout           layout_new, 
+	VkAccessFlags           src_access_mask,
+	VkAccessFlags           dst_access_mask,
+	VkPipelineStageFlagBits stage_src, 
+	VkPipelineStageFlagBits stage_dst) 
+{
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask     = aspect_mask;
+    subresource_range.baseMipLevel   = 0;
+    subresource_range.levelCount     = VK_REMAINING_MIP_LEVELS;
+    subresource_range.baseArrayLayer = 0;
+    subresource_range.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask       = src_access_mask;
+    barrier.dstAccessMask       = dst_access_mask;
+    barrier.oldLayout           = layout_old;
+    barrier.newLayout           = layout_new;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image               = image;
+    barrier.subresourceRange    = subresource_range;
+
+    vkCmdPipelineBarrier(command_buffer, stage_src, stage_dst, 0, 0, 0, 0, 0, 1, &barrier);
+}
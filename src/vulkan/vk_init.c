@@ -1,27 +1,73 @@
-void vk_create_swapchain(
-	struct vk_context* vk, 
-	bool               recreate)
+// Rebuilt whenever the sample count changes, as it's baked into the
+// multisample state.
+void vk_create_graphics_pipelines(struct vk_context* vk)
 {
-	if(recreate) 
-	{
-		vkDeviceWaitIdle(vk->device);
-		for(uint32_t i = 0; i < vk->swap_images_len; i++)
-		{
-			vkDestroyImageView(vk->device, vk->swap_views[i], 0);
-		}
-		vkDestroySwapchainKHR(vk->device, vk->swapchain, 0);
-
-		vkDestroyImage(vk->device, vk->render_image, 0);
-		vkDestroyImageView(vk->device, vk->render_view, 0);
-		vkFreeMemory(vk->device, vk->render_image_memory, 0);
-
-		vkDestroySemaphore(vk->device, vk->semaphore_image_available, 0);
-		vkDestroySemaphore(vk->device, vk->semaphore_render_finished, 0);
-	}
+	struct vk_descriptor_info world_descriptors[2] = {};
+
+	world_descriptors[0].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	world_descriptors[0].offset_in_buffer = offsetof(struct vk_host_memory, global);
+	world_descriptors[0].range_in_buffer  = sizeof(struct vk_ubo_global_world);
+
+	// The world pass only sees the instances that survived culling.
+	world_descriptors[1].type             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	world_descriptors[1].frame_buffers    = vk->instances.cull_buffers;
+	world_descriptors[1].offset_in_buffer = offsetof(struct vk_cull_memory, visible_models);
+	world_descriptors[1].range_in_buffer  = VK_WHOLE_SIZE;
+
+	struct vk_attribute_description world_attributes[2];
+
+	world_attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	world_attributes[0].offset = offsetof(struct vk_cube_vertex, pos);
+
+	world_attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	world_attributes[1].offset = offsetof(struct vk_cube_vertex, color);
+
+	VkShaderModule shader_world_vert = vk_create_shader_module(vk->device, &vk->assets, "shaders/world_vert.spv");
+	VkShaderModule shader_world_frag = vk_create_shader_module(vk->device, &vk->assets, "shaders/world_frag.spv");
+
+	vk_create_graphics_pipeline(
+		vk, 
+		&vk->pipeline_resources_world, 
+		world_descriptors, 
+		2, 
+		world_attributes,
+		2,
+		sizeof(struct vk_cube_vertex),
+		shader_world_vert, 
+		shader_world_frag);
+
+	struct vk_descriptor_info reticle_descriptor = {};
+	reticle_descriptor.type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	reticle_descriptor.offset_in_buffer = offsetof(struct vk_host_memory, global) + offsetof(struct vk_ubo_global, reticle_pos),
+	reticle_descriptor.range_in_buffer  = sizeof(struct v2);
+
+	struct vk_attribute_description reticle_attribute;
+	reticle_attribute.format = VK_FORMAT_R32G32_SFLOAT;
+	reticle_attribute.offset = offsetof(struct vk_reticle_vertex, pos);
+
+	VkShaderModule shader_reticle_vert = vk_create_shader_module(vk->device, &vk->assets, "shaders/reticle_vert.spv");
+	VkShaderModule shader_reticle_frag = vk_create_shader_module(vk->device, &vk->assets, "shaders/reticle_frag.spv");
+
+	vk_create_graphics_pipeline(
+		vk, 
+		&vk->pipeline_resources_reticle, 
+		&reticle_descriptor, 
+		1, 
+		&reticle_attribute,
+		1,
+		sizeof(struct vk_reticle_vertex),
+		shader_reticle_vert, 
+		shader_reticle_frag);
+}
 
+// The previous swapchain, if any, is handed over as oldSwapchain so the
+// presentation engine can move straight across, then retired.
+void vk_create_wsi_swapchain(struct vk_context* vk, struct vk_retired* retired)
+{
 	// Query surface capabilities.
 	uint32_t image_count = 0;
 	VkSurfaceTransformFlagBitsKHR pre_transform;
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 	{
 		VkSurfaceCapabilitiesKHR abilities;
 
@@ -41,13 +87,28 @@ void vk_create_swapchain(
 			PANIC();
 		}
 
-		image_count = abilities.minImageCount + 1;
+		image_count = vk->pacing.swap_images ? vk->pacing.swap_images : abilities.minImageCount + 1;
+		if(image_count > MAX_SWAP_IMAGES)
+		{
+			image_count = MAX_SWAP_IMAGES;
+		}
+		if(image_count < abilities.minImageCount)
+		{
+			image_count = abilities.minImageCount;
+		}
 		if(abilities.maxImageCount > 0 && image_count > abilities.maxImageCount) 
 		{
 			image_count = abilities.maxImageCount;
 		}
 
 		pre_transform = abilities.currentTransform;
+
+		// The compute output path blits into the swapchain image.
+		vk->compute.blit_supported = abilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if(vk->compute.blit_supported)
+		{
+			usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
 	}
 
 	// Choose surface format.
@@ -76,8 +137,8 @@ void vk_create_swapchain(
 
 	// Choose presentation mode.
 	// 
-	// Default to VK_PRESENT_MODE_FIFO_KHR, as this is the only mode required to
-	// be supported by the spec.
+	// Fall back to VK_PRESENT_MODE_FIFO_KHR if the requested mode isn't there,
+	// as this is the only mode required to be supported by the spec.
 	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
 	{
 		uint32_t modes_len;
@@ -88,12 +149,13 @@ void vk_create_swapchain(
 
 		for(int i = 0; i < modes_len; i++) 
 		{
-			if(modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) 
+			if(modes[i] == vk->pacing.present_mode) 
 			{
 				present_mode = modes[i];
 				break;
 			}
 		}
+		vk->present_mode = present_mode;
 	}
 
 	VkSwapchainCreateInfoKHR info = {};
@@ -106,7 +168,7 @@ void vk_create_swapchain(
 	info.imageColorSpace       = vk->surface_format.colorSpace;
 	info.imageExtent           = vk->swap_extent;
 	info.imageArrayLayers      = 1;
-	info.imageUsage            = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // TODO probably right, but we'll see.
+	info.imageUsage            = usage;
 	info.imageSharingMode      = VK_SHARING_MODE_EXCLUSIVE; // TODO needs to be CONCURRENT if compute is in different family from present
 	info.queueFamilyIndexCount = 0; // Not used in exclusive mode. Need to check for concurrent.
 	info.pQueueFamilyIndices   = 0; // Also not used in exclusive mode, see above.
@@ -114,69 +176,265 @@ void vk_create_swapchain(
 	info.compositeAlpha        = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	info.presentMode           = present_mode;
 	info.clipped               = VK_TRUE;
-	info.oldSwapchain          = VK_NULL_HANDLE;
-
-#if VK_IMMEDIATE
-		info.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-#endif
+	info.oldSwapchain          = vk->swapchain;
 
+	VkSwapchainKHR swapchain_old = vk->swapchain;
 	VK_VERIFY(vkCreateSwapchainKHR(vk->device, &info, 0, &vk->swapchain));
+	if(swapchain_old != VK_NULL_HANDLE)
+	{
+		retired->swapchain = swapchain_old;
+	}
 	VK_VERIFY(vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &vk->swap_images_len, 0));
+	// minImageCount is only a minimum, so the driver is free to go over it.
+	if(vk->swap_images_len > MAX_SWAP_IMAGES)
+	{
+		printf("Swapchain has %u images, more than MAX_SWAP_IMAGES.\n", vk->swap_images_len);
+		PANIC();
+	}
 	VK_VERIFY(vkGetSwapchainImagesKHR(vk->device, vk->swapchain, &vk->swap_images_len, vk->swap_images));
+}
 
-	// Create image views.
-	for(int i = 0; i < vk->swap_images_len; i++) 
+// Headless stand in for the swapchain. Each frame in flight renders into its
+// own image, which is left in TRANSFER_SRC_OPTIMAL and copied into that frame's
+// readback buffer.
+void vk_create_offscreen_images(struct vk_context* vk)
+{
+	vk->swap_images_len = MAX_IN_FLIGHT_FRAMES;
+	for(uint32_t i = 0; i < vk->swap_images_len; i++)
 	{
-		vk_create_image_view(
-			vk->device, 
-			&vk->swap_views[i], 
-			vk->swap_images[i], 
-			vk->surface_format.format, 
-			VK_IMAGE_ASPECT_COLOR_BIT);
+		vk_allocate_image(
+			vk->allocator,
+			&vk->swap_images[i],
+			&vk->swap_image_memory[i],
+			vk->swap_extent.width,
+			vk->swap_extent.height,
+			vk->surface_format.format,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 	}
+	vk->compute.blit_supported = true;
 
-	// Create render image resources for multisampling
-	vk_allocate_image_and_view(
-		vk->device, 
-		vk->physical_device, 
-		&vk->render_image,
-		&vk->render_image_memory,
-		&vk->render_view,
-		vk->swap_extent.width,
-		vk->swap_extent.height,
-		vk->surface_format.format,
-		vk->render_samples,
-		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-		VK_IMAGE_ASPECT_COLOR_BIT);
-
-	// Create image resources for depth buffering
-	vk_allocate_image_and_view(
-		vk->device, 
-		vk->physical_device, 
-		&vk->depth_image,
-		&vk->depth_image_memory,
-		&vk->depth_view,
-		vk->swap_extent.width,
-		vk->swap_extent.height,
-		DEPTH_ATTACHMENT_FORMAT,
-		vk->render_samples,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-		VK_IMAGE_ASPECT_DEPTH_BIT);
-
-	// Create synchronization primitives
+	for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
 	{
+		vk_allocate_buffer(
+			vk->allocator,
+			&vk->readback_buffers[i],
+			&vk->readback_memory[i],
+			(VkDeviceSize)vk->swap_extent.width * vk->swap_extent.height * 4,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			// Read back on the CPU, so cached memory is much faster if there is
+			// some.
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+	}
+}
+
+// Destroys everything retired by frames which have since completed. Called
+// after waiting on a frame's fence, which is what moves frames_completed on.
+void vk_retired_collect(struct vk_context* vk)
+{
+	uint32_t kept = 0;
+	for(uint32_t i = 0; i < vk->retired_len; i++)
+	{
+		struct vk_retired* retired = &vk->retired[i];
+		if(retired->frame > vk->frames_completed)
+		{
+			vk->retired[kept++] = *retired;
+			continue;
+		}
+
+		for(uint32_t j = 0; j < retired->swap_views_len; j++)
+		{
+			vkDestroyImageView(vk->device, retired->swap_views[j], 0);
+			vkDestroySemaphore(vk->device, retired->swap_semaphores[j], 0);
+		}
+		for(uint32_t j = 0; j < retired->images_len; j++)
+		{
+			vkDestroyImageView(vk->device, retired->image_views[j], 0);
+			vkDestroyImage(vk->device, retired->images[j], 0);
+			vk_free_memory(vk->allocator, &retired->image_memory[j]);
+		}
+		// Destroying a retired swapchain also releases its images.
+		if(retired->swapchain != VK_NULL_HANDLE)
+		{
+			vkDestroySwapchainKHR(vk->device, retired->swapchain, 0);
+		}
+	}
+	vk->retired_len = kept;
+}
+
+// Returns an empty entry which is destroyed once every frame submitted so far
+// has completed.
+struct vk_retired* vk_retire(struct vk_context* vk)
+{
+	// Only a burst of resizes faster than frames complete gets here, so it's
+	// fine to just wait the backlog out.
+	if(vk->retired_len == VK_MAX_RETIRED)
+	{
+		vkDeviceWaitIdle(vk->device);
+		vk->frames_completed = vk->frames_submitted;
+		vk_retired_collect(vk);
+	}
+
+	struct vk_retired* retired = &vk->retired[vk->retired_len++];
+	*retired = (struct vk_retired){};
+	retired->frame = vk->frames_submitted;
+	return retired;
+}
+
+void vk_retire_image(
+	struct vk_retired*    retired,
+	VkImage*              image,
+	VkImageView*          view,
+	struct vk_allocation* memory)
+{
+	if(*image == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	uint32_t idx = retired->images_len++;
+	retired->images[idx]       = *image;
+	retired->image_views[idx]  = *view;
+	retired->image_memory[idx] = *memory;
+
+	*image  = VK_NULL_HANDLE;
+	*view   = VK_NULL_HANDLE;
+	*memory = (struct vk_allocation){};
+}
+
+// Recreation doesn't wait for the device. Whatever frames in flight might
+// still be using is retired and destroyed once they've completed, and the
+// render and depth attachments are kept when neither the extent nor the
+// sample count changed.
+void vk_create_swapchain(
+	struct vk_context* vk, 
+	bool               recreate)
+{
+	// Whatever gets replaced below may come back with the same handle.
+	vk_reuse_invalidate(vk);
+
+	// New pipelines for a new sample count would need retiring as well, and
+	// this only happens on an explicit quality change, so just wait instead.
+	if(recreate && vk->pipeline_samples != vk->render_samples)
+	{
+		vkDeviceWaitIdle(vk->device);
+		vk->frames_completed = vk->frames_submitted;
+		vk_retired_collect(vk);
+
+		vk_destroy_pipeline_resources(vk, &vk->pipeline_resources_world);
+		vk_destroy_pipeline_resources(vk, &vk->pipeline_resources_reticle);
+		vk_create_graphics_pipelines(vk);
+	}
+
+	struct vk_retired* retired = recreate ? vk_retire(vk) : 0;
+
+	// Offscreen images are sized from the platform once and never change, so
+	// headless recreation only ever touches the attachments.
+	if(!vk->headless || !recreate)
+	{
+		if(retired)
+		{
+			for(uint32_t i = 0; i < vk->swap_images_len; i++)
+			{
+				retired->swap_views[i]      = vk->swap_views[i];
+				retired->swap_semaphores[i] = vk->semaphores_render_finished[i];
+			}
+			retired->swap_views_len = vk->swap_images_len;
+		}
+
+		if(vk->headless)
+		{
+			vk_create_offscreen_images(vk);
+		}
+		else
+		{
+			vk_create_wsi_swapchain(vk, retired);
+		}
+
+		// Create image views.
+		for(int i = 0; i < vk->swap_images_len; i++) 
+		{
+			vk_create_image_view(
+				vk->device, 
+				&vk->swap_views[i], 
+				vk->swap_images[i], 
+				vk->surface_format.format, 
+				VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+
+		// Nothing is presented headless, so nothing waits on these.
 		VkSemaphoreCreateInfo semaphore_info = {};
 		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		for(uint32_t i = 0; i < vk->swap_images_len; i++)
+		{
+			vk->semaphores_render_finished[i] = VK_NULL_HANDLE;
+			if(!vk->headless)
+			{
+				VK_VERIFY(vkCreateSemaphore(vk->device, &semaphore_info, 0, &vk->semaphores_render_finished[i]));
+			}
+		}
+	}
+
+	if(recreate)
+	{
+		if(vk->attachments_extent.width  == vk->swap_extent.width &&
+		   vk->attachments_extent.height == vk->swap_extent.height &&
+		   vk->attachments_samples       == vk->render_samples)
+		{
+			return;
+		}
 
-		VK_VERIFY(vkCreateSemaphore(vk->device, &semaphore_info, 0, &vk->semaphore_image_available));
-		VK_VERIFY(vkCreateSemaphore(vk->device, &semaphore_info, 0, &vk->semaphore_render_finished));
+		vk_retire_image(retired, &vk->render_image, &vk->render_view, &vk->render_image_memory);
+		vk_retire_image(retired, &vk->depth_image, &vk->depth_view, &vk->depth_image_memory);
+		for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
+		{
+			vk_retire_image(retired, &vk->compute.images[i], &vk->compute.views[i], &vk->compute.memory[i]);
+		}
 	}
+	vk->attachments_extent  = vk->swap_extent;
+	vk->attachments_samples = vk->render_samples;
+
+	vk_compute_create_images(vk);
+
+	// The render and depth attachments are the frame graph's transients. It's
+	// built for the raster passes whichever path is current, so they're there
+	// to switch back to.
+	struct vk_frame_graph frame_graph;
+	frame_graph.render_group       = 0;
+	frame_graph.image_idx          = 0;
+	frame_graph.record_secondaries = false;
+	frame_graph.compute_output     = false;
+	vk_frame_graph_build(vk, &frame_graph);
+	vk_graph_create_transients(vk, &frame_graph.graph);
 }
 
 struct vk_context vk_init(struct vk_platform* platform)
 {
 	struct vk_context vk;
 
+	// Without a surface callback there's no window system at all, and frames
+	// render into offscreen images instead of a swapchain.
+	vk.headless = platform->create_surface_callback == 0;
+	if(vk.headless)
+	{
+		vk.surface                   = VK_NULL_HANDLE;
+		vk.swapchain                 = VK_NULL_HANDLE;
+		vk.surface_format.format     = VK_FORMAT_R8G8B8A8_SRGB;
+		vk.surface_format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+		vk.swap_extent.width         = platform->headless_width;
+		vk.swap_extent.height        = platform->headless_height;
+	}
+
+	// Map the asset pack. Everything loaded from disk during init reads from
+	// it.
+	{
+		if(!asset_pack_open(&vk.assets, ASSET_PACK_FNAME))
+		{
+			printf("No asset pack at %s, falling back to loose files.\n", ASSET_PACK_FNAME);
+		}
+	}
+
 	// Create instance.
 	{
 		VkApplicationInfo app = {};
@@ -232,12 +490,16 @@ struct vk_context vk_init(struct vk_platform* platform)
 	}
 
 	// Create surface.
+	if(!vk.headless)
 	{
 		VK_VERIFY(platform->create_surface_callback(&vk, platform->context));
 	}
 
 	// Create physical device.
 	uint32_t graphics_family_idx = 0;
+	uint32_t transfer_family_idx = 0;
+	uint32_t compute_family_idx = 0;
+	uint32_t timestamp_valid_bits = 0;
 	{
 		uint32_t devices_len;
 
@@ -256,21 +518,17 @@ struct vk_context vk_init(struct vk_platform* platform)
 			VkQueueFamilyProperties fams[fams_len];
 			vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &fams_len, fams);
 
-			//bool compute = false;
 			bool graphics = false;
+			uint32_t device_graphics_family_idx = 0;
 			for(int j = 0; j < fams_len; j++) 
 			{
-				/*
-				if(fams[j].queueFlags & VK_QUEUE_COMPUTE_BIT) 
-				{
-					compute = true;
-					compute_family_idx = j;
-				}
-				*/
-				if(fams[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) 
+				// The culling pre-pass is recorded into the same command buffer as
+				// the world pass, so the graphics family must also do compute.
+				if((fams[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) && (fams[j].queueFlags & VK_QUEUE_COMPUTE_BIT)) 
 				{
 					graphics = true;
-					graphics_family_idx = j;
+					device_graphics_family_idx = j;
+					break;
 				}
 			}
 			if(!graphics) 
@@ -299,44 +557,56 @@ struct vk_context vk_init(struct vk_platform* platform)
 					continue;
 				}
 			}
-			if(!swapchain || !dynamic) 
+			if((!swapchain && !vk.headless) || !dynamic) 
 			{
 				continue;
 			}
 
 			vk.physical_device = devices[i];
-
-			VkPhysicalDeviceProperties properties;
-			vkGetPhysicalDeviceProperties(vk.physical_device, &properties);
-			VkSampleCountFlags sample_counts = properties.limits.framebufferColorSampleCounts; //& properties.limits.framebufferDepthSampleCounts;
-			if(sample_counts & VK_SAMPLE_COUNT_64_BIT) 
-			{ 
-				vk.render_samples = VK_SAMPLE_COUNT_64_BIT; 
-			} 
-			else if(sample_counts & VK_SAMPLE_COUNT_32_BIT)
+			graphics_family_idx = device_graphics_family_idx;
+			timestamp_valid_bits = fams[graphics_family_idx].timestampValidBits;
+
+			// Uploads go through a separate queue family when there is one, so
+			// they can run alongside rendering instead of in front of it. A
+			// transfer only family is usually backed by the copy engines, so
+			// prefer that, then any other family which can copy. Every family
+			// which supports graphics or compute implicitly supports transfer.
+			transfer_family_idx = graphics_family_idx;
+			for(int j = 0; j < fams_len; j++)
 			{
-				vk.render_samples = VK_SAMPLE_COUNT_32_BIT; 
-			}
-			else if(sample_counts & VK_SAMPLE_COUNT_16_BIT)
-			{
-				vk.render_samples = VK_SAMPLE_COUNT_16_BIT; 
-			}
-			else if(sample_counts & VK_SAMPLE_COUNT_8_BIT)
-			{
-				vk.render_samples = VK_SAMPLE_COUNT_8_BIT; 
-			}
-			else if(sample_counts & VK_SAMPLE_COUNT_4_BIT)
-			{
-				vk.render_samples = VK_SAMPLE_COUNT_4_BIT; 
-			}
-			else if(sample_counts & VK_SAMPLE_COUNT_2_BIT)
-			{
-				vk.render_samples = VK_SAMPLE_COUNT_2_BIT; 
+				VkQueueFlags flags = fams[j].queueFlags;
+				if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+				{
+					transfer_family_idx = j;
+					break;
+				}
+				if(transfer_family_idx == graphics_family_idx 
+				&& !(flags & VK_QUEUE_GRAPHICS_BIT) 
+				&& (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)))
+				{
+					transfer_family_idx = j;
+				}
 			}
-			else
+
+			// Async compute wants a family which can't do graphics, so its work
+			// can overlap the graphics queue's.
+			compute_family_idx = graphics_family_idx;
+			for(int j = 0; j < fams_len; j++)
 			{
-				vk.render_samples = VK_SAMPLE_COUNT_1_BIT;
+				VkQueueFlags flags = fams[j].queueFlags;
+				if((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+				{
+					compute_family_idx = j;
+					break;
+				}
 			}
+
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(vk.physical_device, &properties);
+			// The depth attachment is multisampled along with the color one.
+			vk.supported_samples = 
+				properties.limits.framebufferColorSampleCounts & 
+				properties.limits.framebufferDepthSampleCounts;
 		}
 
 		// Exit if we haven't found an eligible device.
@@ -345,22 +615,46 @@ struct vk_context vk_init(struct vk_platform* platform)
 			printf("No suitable physical device.\n");
 			PANIC();
 		}
+
+		vkGetPhysicalDeviceProperties(vk.physical_device, &vk.physical_device_properties);
 	}
 
 	// Create logical device.
 	{ 
-		VkDeviceQueueCreateInfo queue = {};
-		queue.sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queue.pNext            = 0;
-		queue.flags            = 0;
-		queue.queueFamilyIndex = graphics_family_idx;
-		queue.queueCount       = 1; // 1 because only 1 queue, right?
-		float priority         = 1.0f;
-	 	queue.pQueuePriorities = &priority;
+		float priority = 1.0f;
+		VkDeviceQueueCreateInfo queues[3] = {};
+		uint32_t queues_len = 1;
+
+		queues[0].sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queues[0].pNext            = 0;
+		queues[0].flags            = 0;
+		queues[0].queueFamilyIndex = graphics_family_idx;
+		queues[0].queueCount       = 1;
+	 	queues[0].pQueuePriorities = &priority;
+
+		if(transfer_family_idx != graphics_family_idx)
+		{
+			queues[queues_len]                  = queues[0];
+			queues[queues_len].queueFamilyIndex = transfer_family_idx;
+			queues_len++;
+		}
+
+		// Shares the transfer family's queue if they're the same family.
+		if(compute_family_idx != graphics_family_idx && compute_family_idx != transfer_family_idx)
+		{
+			queues[queues_len]                  = queues[0];
+			queues[queues_len].queueFamilyIndex = compute_family_idx;
+			queues_len++;
+		}
+
+	 	VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+		timeline_features.sType             = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timeline_features.pNext             = 0;
+		timeline_features.timelineSemaphore = VK_TRUE;
 
 	 	VkPhysicalDeviceDynamicRenderingFeatures dynamic_features = {};
 		dynamic_features.sType            = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
-		dynamic_features.pNext            = 0;
+		dynamic_features.pNext            = &timeline_features;
 		dynamic_features.dynamicRendering = VK_TRUE;
 
 
@@ -368,19 +662,77 @@ struct vk_context vk_init(struct vk_platform* platform)
 		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
 		features.pNext = &dynamic_features;
 		vkGetPhysicalDeviceFeatures2(vk.physical_device, &features);
+
+		// Timeline semaphores are core in 1.2, but the feature still has to be
+		// enabled.
+		if(!timeline_features.timelineSemaphore)
+		{
+			printf("Physical device doesn't support timeline semaphores.\n");
+			PANIC();
+		}
 		
 		VkDeviceCreateInfo info = {};
 		info.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	 	info.pNext                   = &features;
 	 	info.flags                   = 0;
-	 	info.queueCreateInfoCount    = 1;
-	 	info.pQueueCreateInfos       = &queue;
-	 	const char* device_exts[2] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME };
-	 	info.enabledExtensionCount   = 2;
+	 	info.queueCreateInfoCount    = queues_len;
+	 	info.pQueueCreateInfos       = queues;
+	 	const char* device_exts[2] = { VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME, VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	 	info.enabledExtensionCount   = vk.headless ? 1 : 2;
 	 	info.ppEnabledExtensionNames = device_exts;
 	 	VK_VERIFY(vkCreateDevice(vk.physical_device, &info, 0, &vk.device));
 
 		vkGetDeviceQueue(vk.device, graphics_family_idx, 0, &vk.queue_graphics);
+
+		vk.allocator = vk_allocator_create(vk.device, vk.physical_device);
+
+		vk_upload_init(&vk, transfer_family_idx, graphics_family_idx);
+		printf("Uploading through queue family %u (%s).\n", 
+			transfer_family_idx, 
+			vk.upload.dedicated ? "dedicated" : "shared with graphics");
+
+		vk_compute_init(&vk, compute_family_idx, graphics_family_idx);
+		vk.compute_output = false;
+		printf("Compute output through queue family %u (%s).\n", 
+			compute_family_idx, 
+			vk.compute.async ? "async" : "shared with graphics");
+
+		// Every supported feature was queried into features and enabled with it,
+		// so pipeline statistics queries are available if they're supported.
+		vk_gpu_profiler_init(&vk, timestamp_valid_bits, features.features.pipelineStatisticsQuery);
+	}
+
+	// Pick the starting sample count. Auto mode starts at the highest tier and
+	// steps down from vk_begin_frame if frames are too slow.
+	{
+		vk.msaa_quality = VK_MSAA_QUALITY_AUTO;
+		vk.msaa_auto = (struct vk_msaa_auto){};
+		vk.msaa_auto.tier = VK_MSAA_QUALITY_HIGH;
+		vk.msaa_auto.frames_to_skip = VK_MSAA_AUTO_SKIP_FRAMES;
+		vk.render_samples = vk_msaa_samples_for_quality(vk.supported_samples, vk.msaa_auto.tier);
+		vk.render_image = VK_NULL_HANDLE;
+		vk.render_view = VK_NULL_HANDLE;
+		vk.render_image_memory = (struct vk_allocation){};
+	}
+
+	// Default pacing, which the platform can change once we're up.
+	{
+		vk.pacing = (struct vk_pacing){};
+		vk.pacing.present_mode     = VK_IMMEDIATE ? VK_PRESENT_MODE_IMMEDIATE_KHR : VK_PRESENT_MODE_MAILBOX_KHR;
+		vk.pacing.max_frames_ahead = MAX_IN_FLIGHT_FRAMES;
+		vk.present_mode            = VK_PRESENT_MODE_FIFO_KHR;
+	}
+
+	// Nothing submitted or retired yet, and no previous swapchain to hand to
+	// the first one.
+	{
+		if(!vk.headless)
+		{
+			vk.swapchain = VK_NULL_HANDLE;
+		}
+		vk.frames_submitted = 0;
+		vk.frames_completed = 0;
+		vk.retired_len      = 0;
 	}
 
 	// Create swapchain, images, and image views. This has been abstracted to allow
@@ -393,80 +745,106 @@ struct vk_context vk_init(struct vk_platform* platform)
 	}
 
 	// Allocate host visible memory buffer.
+	//
+	// Each frame in flight gets its own slice so the CPU can fill the next
+	// frame's uniforms while the GPU is still reading the previous one.
 	{
-		VkDeviceSize buf_size = sizeof(struct vk_host_memory);
+		VkDeviceSize alignment = vk.physical_device_properties.limits.minUniformBufferOffsetAlignment;
+		if(vk.physical_device_properties.limits.minStorageBufferOffsetAlignment > alignment)
+		{
+			alignment = vk.physical_device_properties.limits.minStorageBufferOffsetAlignment;
+		}
+		vk.host_visible_stride = vk_align_up(sizeof(struct vk_host_memory), alignment);
+		VkDeviceSize buf_size = vk.host_visible_stride * MAX_IN_FLIGHT_FRAMES;
 
 		vk_allocate_buffer(
-			vk.device,
-			vk.physical_device,
+			vk.allocator,
 			&vk.host_visible_buffer,
 			&vk.host_visible_memory,
 			buf_size,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			// Read by the GPU every frame, so put it in device local memory when
+			// the device has some which is also host visible.
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		vk.host_visible_mapped = vk.host_visible_memory.mapped;
+	}
 
-		vkMapMemory(vk.device, vk.host_visible_memory, 0, buf_size, 0, (void*)&vk.host_visible_mapped);
+	// Allocate each frame's instance buffers. Descriptors are pointed at them
+	// when the pipelines are created just below.
+	{
+		uint32_t capacity = platform->instances_capacity;
+		if(capacity == 0)
+		{
+			capacity = VK_INSTANCES_DEFAULT_CAPACITY;
+		}
+		vk_instances_init(&vk, capacity);
 	}
 
+	// Pipeline creation is the bulk of startup time without a warm cache, so
+	// time it to make the difference visible.
+	struct timespec pipelines_start;
+	clock_gettime(CLOCK_MONOTONIC, &pipelines_start);
+
+	vk_load_pipeline_cache(&vk, PIPELINE_CACHE_FNAME);
+
 	// Create graphics pipelines
 	{
-		struct vk_descriptor_info world_descriptors[2];
-
-		world_descriptors[0].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		world_descriptors[0].offset_in_buffer = offsetof(struct vk_host_memory, global);
-		world_descriptors[0].range_in_buffer  = sizeof(struct vk_ubo_global_world);
-
-		world_descriptors[1].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		world_descriptors[1].offset_in_buffer = offsetof(struct vk_host_memory, instance);
-		world_descriptors[1].range_in_buffer  = sizeof(mat4);
-
-		struct vk_attribute_description world_attributes[2];
-
-		world_attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		world_attributes[0].offset = offsetof(struct vk_cube_vertex, pos);
-
-		world_attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		world_attributes[1].offset = offsetof(struct vk_cube_vertex, color);
-
-		VkShaderModule shader_world_vert = vk_create_shader_module(vk.device, "shaders/world_vert.spv");
-		VkShaderModule shader_world_frag = vk_create_shader_module(vk.device, "shaders/world_frag.spv");
-
-		vk_create_graphics_pipeline(
-			&vk, 
-			&vk.pipeline_resources_world, 
-			world_descriptors, 
-			2, 
-			world_attributes,
-			2,
-			sizeof(struct vk_cube_vertex),
-			shader_world_vert, 
-			shader_world_frag);
-
-		struct vk_descriptor_info reticle_descriptor;
-		reticle_descriptor.type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-		reticle_descriptor.offset_in_buffer = offsetof(struct vk_host_memory, global) + offsetof(struct vk_ubo_global, reticle_pos),
-		reticle_descriptor.range_in_buffer  = sizeof(struct v2);
-
-		struct vk_attribute_description reticle_attribute;
-		reticle_attribute.format = VK_FORMAT_R32G32_SFLOAT;
-		reticle_attribute.offset = offsetof(struct vk_reticle_vertex, pos);
-
-		VkShaderModule shader_reticle_vert = vk_create_shader_module(vk.device, "shaders/reticle_vert.spv");
-		VkShaderModule shader_reticle_frag = vk_create_shader_module(vk.device, "shaders/reticle_frag.spv");
-
-		vk_create_graphics_pipeline(
-			&vk, 
-			&vk.pipeline_resources_reticle, 
-			&reticle_descriptor, 
-			1, 
-			&reticle_attribute,
-			1,
-			sizeof(struct vk_reticle_vertex),
-			shader_reticle_vert, 
-			shader_reticle_frag);
+		vk_create_graphics_pipelines(&vk);
+	}
+
+	// Create compute pipelines
+	{
+		// VOLATILE - Bindings must match cull.comp.
+		struct vk_descriptor_info cull_descriptors[5] = {};
+
+		cull_descriptors[0].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		cull_descriptors[0].offset_in_buffer = offsetof(struct vk_host_memory, global);
+		cull_descriptors[0].range_in_buffer  = sizeof(struct vk_ubo_global_world);
+
+		cull_descriptors[1].type             = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		cull_descriptors[1].offset_in_buffer = offsetof(struct vk_host_memory, global) + offsetof(struct vk_ubo_global, cull);
+		cull_descriptors[1].range_in_buffer  = sizeof(struct vk_ubo_cull);
+
+		cull_descriptors[2].type             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cull_descriptors[2].frame_buffers    = vk.instances.buffers;
+		cull_descriptors[2].offset_in_buffer = 0;
+		cull_descriptors[2].range_in_buffer  = VK_WHOLE_SIZE;
+
+		cull_descriptors[3].type             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cull_descriptors[3].frame_buffers    = vk.instances.cull_buffers;
+		cull_descriptors[3].offset_in_buffer = offsetof(struct vk_cull_memory, visible_models);
+		cull_descriptors[3].range_in_buffer  = VK_WHOLE_SIZE;
+
+		cull_descriptors[4].type             = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cull_descriptors[4].frame_buffers    = vk.instances.cull_buffers;
+		cull_descriptors[4].offset_in_buffer = offsetof(struct vk_cull_memory, draw_command);
+		cull_descriptors[4].range_in_buffer  = sizeof(VkDrawIndexedIndirectCommand);
+
+		VkShaderModule shader_cull_comp = vk_create_shader_module(vk.device, &vk.assets, "shaders/cull_comp.spv");
+
+		vk_create_compute_pipeline(
+			&vk,
+			&vk.pipeline_resources_cull,
+			cull_descriptors,
+			5,
+			shader_cull_comp);
+	}
+
+	// Trace pipeline for the compute output path.
+	{
+		vk_compute_create_pipeline(&vk);
 	}
 
-	// Create command pool and allocate command buffers
+	struct timespec pipelines_end;
+	clock_gettime(CLOCK_MONOTONIC, &pipelines_end);
+	printf("Pipelines created in %.2fms.\n", 
+		(pipelines_end.tv_sec - pipelines_start.tv_sec) * 1000.0f + 
+		(pipelines_end.tv_nsec - pipelines_start.tv_nsec) / 1000000.0f);
+
+	// Create command pool and per frame command buffers and synchronization
+	// primitives.
 	{
 		VkCommandPoolCreateInfo pool_info = {};
 		pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -474,12 +852,33 @@ struct vk_context vk_init(struct vk_platform* platform)
 		pool_info.queueFamilyIndex = graphics_family_idx;
 		VK_VERIFY(vkCreateCommandPool(vk.device, &pool_info, 0, &vk.command_pool));
 
-		VkCommandBufferAllocateInfo buf_info = {};
-		buf_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		buf_info.commandPool        = vk.command_pool;
-		buf_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		buf_info.commandBufferCount = 1;
-		VK_VERIFY(vkAllocateCommandBuffers(vk.device, &buf_info, &vk.command_buffer));
+		VkSemaphoreCreateInfo semaphore_info = {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		// Fences start signaled so the first wait on each slot falls through.
+		VkFenceCreateInfo fence_info = {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		for(uint32_t i = 0; i < MAX_IN_FLIGHT_FRAMES; i++)
+		{
+			struct vk_frame* frame = &vk.frames[i];
+
+			VkCommandBufferAllocateInfo buf_info = {};
+			buf_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			buf_info.commandPool        = vk.command_pool;
+			buf_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			buf_info.commandBufferCount = 1;
+			VK_VERIFY(vkAllocateCommandBuffers(vk.device, &buf_info, &frame->command_buffer));
+
+			VK_VERIFY(vkCreateFence(vk.device, &fence_info, 0, &frame->fence_in_flight));
+			VK_VERIFY(vkCreateSemaphore(vk.device, &semaphore_info, 0, &frame->semaphore_image_available));
+			frame->number = 0;
+		}
+		vk.frame_idx = 0;
+
+		vk_recorder_init(&vk, graphics_family_idx);
+		vk_reuse_init(&vk);
 	}
 
 	// Allocate device local memory buffer
@@ -514,90 +913,55 @@ struct vk_context vk_init(struct vk_platform* platform)
 			buf_size += mesh_vert_buffer_sizes[i] + mesh_index_buffer_sizes[i];
 		}
 
-		VkBuffer staging_buf;
-		VkDeviceMemory staging_buf_mem;
-
 		vk_allocate_buffer(
-			vk.device,
-			vk.physical_device,
-			&staging_buf,
-			&staging_buf_mem,
+			vk.allocator,
+			&vk.device_local_buffer,
+			&vk.device_local_memory,
 			buf_size, 
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			0);
 
-		void* buf_data;
-		vkMapMemory(vk.device, staging_buf_mem, 0, buf_size, 0, &buf_data);
+		vk_upload_begin(&vk);
 		{
-			size_t total_offset = 0;
+			uint8_t* buf_data = vk_upload_buffer(
+				&vk,
+				vk.device_local_buffer,
+				0,
+				buf_size,
+				VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
 			for(uint8_t i = 0; i < MESHES_LEN; i++)
 			{
 				memcpy(buf_data + mesh_datas[i]->buffer_offset_vertex, mesh_datas[i]->vertex_memory, mesh_vert_buffer_sizes[i]);
 				memcpy(buf_data + mesh_datas[i]->buffer_offset_index,  mesh_datas[i]->index_memory,  mesh_index_buffer_sizes[i]);
-				total_offset += mesh_vert_buffer_sizes[i] + mesh_index_buffer_sizes[i];
 			}
 		}
-		vkUnmapMemory(vk.device, staging_buf_mem);
+		uint64_t meshes_uploaded = vk_upload_submit(&vk);
 
-		vk_allocate_buffer(
-			vk.device,
-			vk.physical_device,
-			&vk.device_local_buffer,
-			&vk.device_local_memory,
-			buf_size, 
-			VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-		// TODO - I'm copying this to do the texture image transition.
-		// I have two options, not sure at this point what makes sense, and it's late
-		// at night.
-		//   (ref: multiple_command_buffers)
-		// 
-		// 1. Only ever allocate one command buffer, or just do another for
-		// initialization. At any rate, I have no idea why I'm using a temp one for
-		// this at the moment.
-		// 2. If it makes sense to just be making temp command buffers like this, the
-		// process should at least be made into a function.
-		VkCommandBufferAllocateInfo alloc_info = {};
-		alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		alloc_info.commandPool        = vk.command_pool;
-		alloc_info.commandBufferCount = 1;
-
-		VkCommandBuffer cmd_buf;
-		vkAllocateCommandBuffers(vk.device, &alloc_info, &cmd_buf);
-
-		VkCommandBufferBeginInfo begin_info = {};
-		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-		vkBeginCommandBuffer(cmd_buf, &begin_info);
-		{
-			VkBufferCopy copy = {};
-			copy.size = buf_size;
-			vkCmdCopyBuffer(cmd_buf, staging_buf, vk.device_local_buffer, 1, &copy);
-		}
-		vkEndCommandBuffer(cmd_buf);
-
-		VkSubmitInfo submit_info = {};
-		submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers    = &cmd_buf;
-
-		// TODO - We are using the graphics queue for this presently, but might we
-		// want to use a transfer queue for this?
-		// I'm not sure if there's any possible performance boost, and I'd rather not
-		// do it just for the sake of it.
-		// 
-		// High level on how this might be done at the following link:
-		// https://vulkan-tutorial.com/Vertex_buffers/Staging_buffer
-		vkQueueSubmit(vk.queue_graphics, 1, &submit_info, VK_NULL_HANDLE);
-		vkQueueWaitIdle(vk.queue_graphics);
-
-		vkFreeCommandBuffers(vk.device, vk.command_pool, 1, &cmd_buf);
-		vkDestroyBuffer(vk.device, staging_buf, 0);
-		vkFreeMemory(vk.device, staging_buf_mem, 0);
+		// The first frame can't draw anything without the meshes, so there's
+		// nothing to gain by not waiting here. The graphics queue still takes
+		// ownership in vk_loop.
+		vk_upload_wait(&vk, meshes_uploaded);
 	}
 
+#if VK_DEBUG
+	vk_memory_print_stats(vk.allocator);
+#endif
+
 	return vk;
 }
+
+void vk_deinit(struct vk_context* vk)
+{
+	vkDeviceWaitIdle(vk->device);
+	vk->frames_completed = vk->frames_submitted;
+	vk_retired_collect(vk);
+	vk_recorder_deinit(vk);
+
+	vk_save_pipeline_cache(vk, PIPELINE_CACHE_FNAME);
+	vkDestroyPipelineCache(vk->device, vk->pipeline_cache, 0);
+
+	asset_pack_close(&vk->assets);
+}
@@ -0,0 +1,150 @@
+// Instance storage. The game writes transforms straight into the current
+// frame's host visible instance buffer, and the cull pass compacts the visible
+// ones into that frame's device local cull buffer. Both are storage buffers
+// sized at runtime, so the instance count is only limited by memory and
+// maxStorageBufferRange.
+//
+// The render group says how many transforms it wants room for. When that's
+// more than the capacity, the capacity at least doubles, and each frame
+// reallocates its buffers the next time it comes around. Until then it hands
+// out what it has, and the game drops whatever doesn't fit.
+
+void vk_instances_allocate_frame(struct vk_context* vk, uint32_t frame, uint32_t capacity)
+{
+	struct vk_instances* instances = &vk->instances;
+
+	vk_allocate_buffer(
+		vk->allocator,
+		&instances->buffers[frame],
+		&instances->memory[frame],
+		capacity * sizeof(mat4),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		// Read by the GPU every frame, so put it in device local memory when
+		// the device has some which is also host visible.
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	vk_allocate_buffer(
+		vk->allocator,
+		&instances->cull_buffers[frame],
+		&instances->cull_memory[frame],
+		offsetof(struct vk_cull_memory, visible_models) + capacity * sizeof(mat4),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		0);
+
+	instances->frame_capacities[frame] = capacity;
+}
+
+void vk_instances_init(struct vk_context* vk, uint32_t capacity)
+{
+	struct vk_instances* instances = &vk->instances;
+
+	// The visible models are the larger of the two ranges bound.
+	instances->max_capacity = vk->physical_device_properties.limits.maxStorageBufferRange / sizeof(mat4);
+	if(capacity > instances->max_capacity)
+	{
+		printf("Only room for %u of %u instances.\n", instances->max_capacity, capacity);
+		capacity = instances->max_capacity;
+	}
+	instances->capacity = capacity;
+
+	for(uint32_t f = 0; f < MAX_IN_FLIGHT_FRAMES; f++)
+	{
+		vk_instances_allocate_frame(vk, f, capacity);
+	}
+}
+
+// Points the current frame's descriptor sets at its new buffers.
+// VOLATILE - Bindings must match world.vert, cull.comp and trace.comp, and the
+// descriptor infos they're created from.
+void vk_instances_update_descriptors(struct vk_context* vk)
+{
+	struct vk_instances* instances = &vk->instances;
+	uint32_t frame = vk->frame_idx;
+
+	VkDescriptorBufferInfo instance_info = {};
+	instance_info.buffer = instances->buffers[frame];
+	instance_info.offset = 0;
+	instance_info.range  = VK_WHOLE_SIZE;
+
+	VkDescriptorBufferInfo visible_info = {};
+	visible_info.buffer = instances->cull_buffers[frame];
+	visible_info.offset = offsetof(struct vk_cull_memory, visible_models);
+	visible_info.range  = VK_WHOLE_SIZE;
+
+	VkDescriptorBufferInfo draw_info = {};
+	draw_info.buffer = instances->cull_buffers[frame];
+	draw_info.offset = offsetof(struct vk_cull_memory, draw_command);
+	draw_info.range  = sizeof(VkDrawIndexedIndirectCommand);
+
+	struct
+	{
+		VkDescriptorSet         set;
+		uint32_t                binding;
+		VkDescriptorBufferInfo* info;
+	} bindings[] =
+	{
+		{ vk->pipeline_resources_world.descriptor_sets[frame], 1, &visible_info  },
+		{ vk->pipeline_resources_cull.descriptor_sets[frame],  2, &instance_info },
+		{ vk->pipeline_resources_cull.descriptor_sets[frame],  3, &visible_info  },
+		{ vk->pipeline_resources_cull.descriptor_sets[frame],  4, &draw_info     },
+		{ vk->pipeline_resources_trace.descriptor_sets[frame], 2, &instance_info },
+	};
+	uint32_t bindings_len = sizeof(bindings) / sizeof(bindings[0]);
+
+	VkWriteDescriptorSet writes[bindings_len] = {};
+	for(uint32_t i = 0; i < bindings_len; i++)
+	{
+		writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet          = bindings[i].set;
+		writes[i].dstBinding      = bindings[i].binding;
+		writes[i].dstArrayElement = 0;
+		writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].descriptorCount = 1;
+		writes[i].pBufferInfo     = bindings[i].info;
+	}
+	vkUpdateDescriptorSets(vk->device, bindings_len, writes, 0, 0);
+}
+
+// Makes sure the current frame has room for requested instances, or as close
+// to it as maxStorageBufferRange allows. Called once the frame's fence has been
+// waited on, so nothing in flight is using its buffers or descriptor sets.
+void vk_instances_reserve(struct vk_context* vk, uint32_t requested)
+{
+	struct vk_instances* instances = &vk->instances;
+	uint32_t frame = vk->frame_idx;
+
+	if(requested > instances->capacity && instances->capacity < instances->max_capacity)
+	{
+		uint32_t capacity = instances->capacity * 2;
+		if(capacity < requested)
+		{
+			capacity = requested;
+		}
+		if(capacity > instances->max_capacity)
+		{
+			printf("Only room for %u of %u instances.\n", instances->max_capacity, requested);
+			capacity = instances->max_capacity;
+		}
+		instances->capacity = capacity;
+	}
+
+	if(instances->frame_capacities[frame] >= instances->capacity)
+	{
+		return;
+	}
+
+	PROFILE_ZONE("grow_instances");
+
+	// Recorded frames reference the old buffers, whose handles may come back.
+	vk_reuse_invalidate(vk);
+
+	vkDestroyBuffer(vk->device, instances->buffers[frame], 0);
+	vk_free_memory(vk->allocator, &instances->memory[frame]);
+	vkDestroyBuffer(vk->device, instances->cull_buffers[frame], 0);
+	vk_free_memory(vk->allocator, &instances->cull_memory[frame]);
+
+	vk_instances_allocate_frame(vk, frame, instances->capacity);
+	vk_instances_update_descriptors(vk);
+}
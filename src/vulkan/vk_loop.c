@@ -1,279 +1,261 @@
-void insert_image_memory_barrier(
-	VkCommandBuffer         command_buffer, 
-	VkImage                 image, 
-	VkImageAspectFlags      aspect_mask,
-	VkImageLayout           layout_old, 
-	VkImageLayout           layout_new, 
-	VkAccessFlags           src_access_mask,
-	VkAccessFlags           dst_access_mask,
-	VkPipelineStageFlagBits stage_src, 
-	VkPipelineStageFlagBits stage_dst) 
+// Waits until the next frame slot is free and points the render group at that
+// slot's instance buffer, so the game writes its transforms straight into
+// mapped GPU memory. Must be called before the game fills the render group for
+// a frame, and followed by vk_loop.
+void vk_begin_frame(struct vk_context* vk, struct render_group* render_group)
 {
-    VkImageSubresourceRange subresource_range = {};
-    subresource_range.aspectMask     = aspect_mask;
-    subresource_range.baseMipLevel   = 0;
-    subresource_range.levelCount     = 1;
-    subresource_range.baseArrayLayer = 0;
-    subresource_range.layerCount     = 1;
-
-    VkImageMemoryBarrier barrier = {};
-    barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.srcAccessMask       = src_access_mask;
-    barrier.dstAccessMask       = dst_access_mask;
-    barrier.oldLayout           = layout_old;
-    barrier.newLayout           = layout_new;
-    barrier.srcQueueFamilyIndex = 0;
-    barrier.dstQueueFamilyIndex = 0;
-    barrier.image               = image;
-    barrier.subresourceRange    = subresource_range;
-
-    vkCmdPipelineBarrier(command_buffer, stage_src, stage_dst, 0, 0, 0, 0, 0, 1, &barrier);
+	PROFILE_ZONE("wait_frame");
+	vk_msaa_auto_update(vk);
+
+	struct vk_frame* frame = &vk->frames[vk->frame_idx];
+
+	// Only blocks if the GPU is still working on the frame that last used this
+	// slot, i.e. if we have lapped it by MAX_IN_FLIGHT_FRAMES.
+	VK_VERIFY(vkWaitForFences(vk->device, 1, &frame->fence_in_flight, VK_TRUE, UINT64_MAX));
+
+	// The graphics queue completes frames in submission order, so everything
+	// up to this slot's last frame is done too.
+	if(frame->number > vk->frames_completed)
+	{
+		vk->frames_completed = frame->number;
+	}
+	vk_retired_collect(vk);
+
+	// The slot's last frame is done, so its queries are ready.
+	vk_gpu_profiler_read(vk);
+
+	// Grows to what the game asked for last frame, which it keeps asking for
+	// until it gets it.
+	vk_instances_reserve(vk, render_group->cube_transforms_requested);
+
+	render_group->cube_transforms          = vk->instances.memory[vk->frame_idx].mapped;
+	render_group->cube_transforms_capacity = vk->instances.frame_capacities[vk->frame_idx];
+	render_group->cube_transforms_len      = 0;
 }
 
 void vk_loop(struct vk_context* vk, struct render_group* render_group)
 {
-	// Translate game memory to uniform buffer object memory.
-	struct vk_host_memory mem = {};
+	struct vk_frame* frame = &vk->frames[vk->frame_idx];
+
+	// Translate game memory to uniform buffer object memory. The instance
+	// transforms are already in place, written by the game after
+	// vk_begin_frame.
 	{
-		mem.global.world.clear_color = render_group->clear_color;
-		mem.global.world.max_draw_distance_z = render_group->max_draw_distance_z;
+		PROFILE_ZONE("translate");
+		struct vk_ubo_global global = {};
+
+		global.world.clear_color = render_group->clear_color;
+		global.world.max_draw_distance_z = render_group->max_draw_distance_z;
 
 		glm_lookat(
     		render_group->camera_position.data, 
     		render_group->camera_target.data,
     		(vec3){0, 1, 0}, 
-    		mem.global.world.view);
-		glm_perspective(radians(75), (float)vk->swap_extent.width / (float)vk->swap_extent.height, .1, 100, mem.global.world.projection);
-		mem.global.world.projection[1][1] *= -1;
+    		global.world.view);
+		glm_perspective(
+			radians(render_group->camera_fov_y), 
+			(float)vk->swap_extent.width / (float)vk->swap_extent.height, 
+			render_group->camera_near, 
+			render_group->camera_far, 
+			global.world.projection);
+		global.world.projection[1][1] *= -1;
 
-		mem.global.reticle_pos = render_group->reticle_offset;
+		global.reticle_pos = render_group->reticle_offset;
 
-		for(uint32_t i = 0; i < CUBES_LEN; i++)
-		{
-			memcpy(mem.instance.models[i], render_group->cube_transforms[i].data, sizeof(struct m4));
-			//glm_translate(mem.instance.models[i], (vec3){(float)i * 2, 0, 0});
-		}
-	}
-	memcpy(vk->host_visible_mapped, &mem, sizeof(mem));
+		global.cull.instances_len   = render_group->cube_transforms_len;
+		global.cull.instance_radius = CUBE_BOUNDING_RADIUS;
 
+		struct vk_host_memory* mem = vk->host_visible_mapped + vk->host_visible_stride * vk->frame_idx;
+		memcpy(&mem->global, &global, sizeof(global));
+	}
 
 	uint32_t image_idx;
-	VkResult res = vkAcquireNextImageKHR(
-		vk->device, 
-		vk->swapchain, 
-		UINT64_MAX, 
-		vk->semaphore_image_available, 
-		VK_NULL_HANDLE, 
-		&image_idx);
-	if(res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR)
+	VkResult res;
+	if(vk->headless)
+	{
+		// One offscreen image per frame in flight, free once the slot's fence
+		// has been waited on.
+		image_idx = vk->frame_idx;
+		res = VK_SUCCESS;
+	}
+	else
+	{
+		PROFILE_ZONE("acquire");
+		res = vkAcquireNextImageKHR(
+			vk->device, 
+			vk->swapchain, 
+			UINT64_MAX, 
+			frame->semaphore_image_available, 
+			VK_NULL_HANDLE, 
+			&image_idx);
+
+		// A failed acquire leaves the semaphore unsignaled and the fence hasn't
+		// been reset, so we can recreate and acquire again without dropping the
+		// frame. SUBOPTIMAL still acquires an image and signals the semaphore,
+		// so we carry on with the frame and recreate after presenting it.
+		if(res == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			vk_create_swapchain(vk, true);
+			res = vkAcquireNextImageKHR(
+				vk->device, 
+				vk->swapchain, 
+				UINT64_MAX, 
+				frame->semaphore_image_available, 
+				VK_NULL_HANDLE, 
+				&image_idx);
+		}
+	}
+	// Still out of date straight after recreating, e.g. mid-resize. Try again
+	// next frame.
+	if(res == VK_ERROR_OUT_OF_DATE_KHR)
 	{
-		vk_create_swapchain(vk, true);
 		return;
 	}
+	// Anything else, like a lost surface or device, leaves the semaphore
+	// unsignaled with nothing we can do about it.
+	if(res != VK_SUBOPTIMAL_KHR)
+	{
+		VK_VERIFY(res);
+	}
 
-	VkCommandBufferBeginInfo begin_info = {};
-	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	vkBeginCommandBuffer(vk->command_buffer, &begin_info);
+	// Only reset once we know we are submitting work that will signal it again.
+	VK_VERIFY(vkResetFences(vk->device, 1, &frame->fence_in_flight));
+
+	uint64_t upload_wait_value = 0;
+	VkCommandBuffer command_buffers[2];
+	uint32_t command_buffers_len = 0;
 	{
-		// Render image transfer
-		insert_image_memory_barrier(
-			vk->command_buffer, 
-			vk->swap_images[image_idx], 
-			VK_IMAGE_ASPECT_COLOR_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			0,
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			//VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-			//VK_PIPELINE_STAGE_TRANSFER_BIT);
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-		// Depth image transfer
-		insert_image_memory_barrier(
-			vk->command_buffer, 
-			vk->depth_image, 
-			VK_IMAGE_ASPECT_DEPTH_BIT,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
-			0,
-			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
-
-		VkRenderingAttachmentInfo color_attachment = {};
-		color_attachment.sType              = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-		color_attachment.loadOp             = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		color_attachment.storeOp            = VK_ATTACHMENT_STORE_OP_STORE;
-		color_attachment.imageLayout        = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-		color_attachment.imageView          = vk->render_view;
-		color_attachment.resolveMode        = VK_RESOLVE_MODE_AVERAGE_BIT;
-		color_attachment.resolveImageView   = vk->swap_views[image_idx];
-		color_attachment.resolveImageLayout = VK_IMAGE_LAYOUT_GENERAL;
-		color_attachment.clearValue.color   = 
-			(VkClearColorValue)
-			{{
-				render_group->clear_color.r, 
-				render_group->clear_color.g, 
-				render_group->clear_color.b, 
-				1.0f
-			}};
-
-		VkRenderingAttachmentInfo depth_attachment = {};
-		depth_attachment.sType                   = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-		depth_attachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		depth_attachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
-		depth_attachment.imageLayout             = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-		depth_attachment.imageView               = vk->depth_view;
-		depth_attachment.resolveMode             = VK_RESOLVE_MODE_NONE;
-		depth_attachment.clearValue.depthStencil = 
-			(VkClearDepthStencilValue)
-			{
-				1.0f,
-				0
-			};
-
-		VkRenderingInfo render_info = {};
-		render_info.sType                = VK_STRUCTURE_TYPE_RENDERING_INFO;
-		render_info.renderArea           = (VkRect2D){{0, 0}, vk->swap_extent};
-		render_info.layerCount           = 1;
-		render_info.colorAttachmentCount = 1;
-		render_info.pColorAttachments    = &color_attachment;
-		render_info.pDepthAttachment     = &depth_attachment;
-		render_info.pStencilAttachment   = 0;
-
-		vkCmdBeginRendering(vk->command_buffer, &render_info);
-		{
-			// TODO - confused. does this actually need to be set up in init as well?
-			// Try without, or something.
-			VkViewport viewport = {};
-			viewport.x        = 0;
-			viewport.y        = 0;
-			viewport.width    = (float)vk->swap_extent.width;
-			viewport.height   = (float)vk->swap_extent.height;
-			viewport.minDepth = 0;
-			viewport.maxDepth = 1;
-			vkCmdSetViewport(vk->command_buffer, 0, 1, &viewport);
-
-			VkRect2D scissor = {};
-			scissor.offset = (VkOffset2D){0, 0};
-			scissor.extent = vk->swap_extent;
-			vkCmdSetScissor(vk->command_buffer, 0, 1, &scissor);
+		PROFILE_ZONE("record");
 
-			{
-				vkCmdBindPipeline(
-					vk->command_buffer, 
-					VK_PIPELINE_BIND_POINT_GRAPHICS, 
-					vk->pipeline_resources_world.pipeline);
-
-				VkDeviceSize offsets[] = {vk->mesh_data_cube.buffer_offset_vertex};
-				vkCmdBindVertexBuffers(
-					vk->command_buffer, 
-					0, 
-					1, 
-					&vk->device_local_buffer,
-					offsets);
-				vkCmdBindIndexBuffer(
-					vk->command_buffer, 
-					vk->device_local_buffer, 
-					vk->mesh_data_cube.buffer_offset_index, 
-					VK_INDEX_TYPE_UINT16);
-
-				for(uint16_t i = 0; i < MAX_INSTANCES; i++) {
-					uint32_t dyn_off = i * sizeof(mat4);
-					vkCmdBindDescriptorSets(
-						vk->command_buffer, 
-						VK_PIPELINE_BIND_POINT_GRAPHICS, 
-						vk->pipeline_resources_world.pipeline_layout, 
-						0, 
-						1, 
-						&vk->pipeline_resources_world.descriptor_set,
-						1,
-						&dyn_off);
-
-					vkCmdDrawIndexed(vk->command_buffer, vk->mesh_data_cube.indices_len, 1, 0, 0, 0);
-				}
-			}
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
+		if(vk->reuse.enabled)
+		{
+			// Ownership acquires only exist while uploads are landing, so they
+			// get a one off prologue ahead of the reused command buffer.
+			if(vk_upload_acquires_pending(vk))
 			{
-				vkCmdBindPipeline(
-					vk->command_buffer, 
-					VK_PIPELINE_BIND_POINT_GRAPHICS, 
-					vk->pipeline_resources_reticle.pipeline);
-
-				VkDeviceSize offset = {vk->mesh_data_reticle.buffer_offset_vertex};
-				vkCmdBindVertexBuffers(
-					vk->command_buffer, 
-					0, 
-					1, 
-					&vk->device_local_buffer,
-					&offset);
-				vkCmdBindIndexBuffer(
-					vk->command_buffer, 
-					vk->device_local_buffer, 
-					vk->mesh_data_reticle.buffer_offset_index, 
-					VK_INDEX_TYPE_UINT16);
-
-				vkCmdBindDescriptorSets(
-					vk->command_buffer, 
-					VK_PIPELINE_BIND_POINT_GRAPHICS, 
-					vk->pipeline_resources_reticle.pipeline_layout, 
-					0, 
-					1, 
-					&vk->pipeline_resources_reticle.descriptor_set,
-					0,
-					0);
-
-				vkCmdDrawIndexed(vk->command_buffer, vk->mesh_data_reticle.indices_len, 1, 0, 0, 0);
+				VK_VERIFY(vkResetCommandBuffer(frame->command_buffer, 0));
+				VK_VERIFY(vkBeginCommandBuffer(frame->command_buffer, &begin_info));
+				upload_wait_value = vk_upload_record_acquires(vk, frame->command_buffer);
+				VK_VERIFY(vkEndCommandBuffer(frame->command_buffer));
+				command_buffers[command_buffers_len++] = frame->command_buffer;
 			}
+			command_buffers[command_buffers_len++] = vk_reuse_command_buffer(vk, render_group, image_idx);
+		}
+		else
+		{
+			VkCommandBuffer command_buffer = frame->command_buffer;
+			VK_VERIFY(vkResetCommandBuffer(command_buffer, 0));
+			VK_VERIFY(vkBeginCommandBuffer(command_buffer, &begin_info));
+
+			// Take ownership of anything the upload queue has finished with.
+			upload_wait_value = vk_upload_record_acquires(vk, command_buffer);
+			vk_record_frame(vk, command_buffer, render_group, image_idx, true);
+
+			VK_VERIFY(vkEndCommandBuffer(command_buffer));
+			command_buffers[command_buffers_len++] = command_buffer;
 		}
-		vkCmdEndRendering(vk->command_buffer);
-
-		// TODO - We'll want one for the depth image as well.
-		insert_image_memory_barrier(
-			vk->command_buffer, 
-			vk->swap_images[image_idx], 
-			VK_IMAGE_ASPECT_COLOR_BIT,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			0,
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
 	}
-	vkEndCommandBuffer(vk->command_buffer);
 
-	VkPipelineStageFlags wait_stages[] = 
-	{
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-	};
+	VkPipelineStageFlags wait_stages[3];
+	VkSemaphore wait_semaphores[3];
+	// Binary semaphore values are ignored.
+	uint64_t wait_values[3];
+	uint32_t waits_len = 0;
 
 	// We wait to submit until that images is available from before. We did all
 	// this prior stuff in the meantime, in theory.
+	// VOLATILE - Must match the swapchain image's initial access in
+	// vk_frame_graph_build.
+	if(!vk->headless)
+	{
+		wait_stages[waits_len]     = 
+			vk->compute_output ? 
+			VK_PIPELINE_STAGE_TRANSFER_BIT : 
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		wait_semaphores[waits_len] = frame->semaphore_image_available;
+		wait_values[waits_len]     = 0;
+		waits_len++;
+	}
+
+	// Only acquired batches are waited on, and those have already completed, so
+	// this never actually holds the frame up. It orders the acquire after the
+	// release as the spec requires.
+	if(upload_wait_value > 0)
+	{
+		wait_stages[waits_len]     = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		wait_semaphores[waits_len] = vk->upload.timeline;
+		wait_values[waits_len]     = upload_wait_value;
+		waits_len++;
+	}
+
+	// The async trace dispatch goes in first, and the blit waits on it.
+	if(vk->compute_output && vk->compute.async)
+	{
+		wait_stages[waits_len]     = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		wait_semaphores[waits_len] = vk_compute_submit(vk);
+		wait_values[waits_len]     = 0;
+		waits_len++;
+	}
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType                   = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.waitSemaphoreValueCount = waits_len;
+	timeline_info.pWaitSemaphoreValues    = wait_values;
+
 	VkSubmitInfo submit_info = {};
 	submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.waitSemaphoreCount   = 1;
-	submit_info.pWaitSemaphores      = &vk->semaphore_image_available;
+	submit_info.pNext                = &timeline_info;
+	submit_info.waitSemaphoreCount   = waits_len;
+	submit_info.pWaitSemaphores      = wait_semaphores;
 	submit_info.pWaitDstStageMask    = wait_stages;
-	submit_info.commandBufferCount   = 1;
-	submit_info.pCommandBuffers      = &vk->command_buffer;
-	submit_info.pSignalSemaphores    = &vk->semaphore_render_finished;
-	submit_info.signalSemaphoreCount = 1;
-	vkQueueSubmit(vk->queue_graphics, 1, &submit_info, VK_NULL_HANDLE);
+	submit_info.commandBufferCount   = command_buffers_len;
+	submit_info.pCommandBuffers      = command_buffers;
+	submit_info.pSignalSemaphores    = &vk->semaphores_render_finished[image_idx];
+	submit_info.signalSemaphoreCount = vk->headless ? 0 : 1;
+	vk->frames_submitted++;
+	frame->number = vk->frames_submitted;
+	{
+		PROFILE_ZONE("submit");
+		VK_VERIFY(vkQueueSubmit(vk->queue_graphics, 1, &submit_info, frame->fence_in_flight));
+	}
+
+	if(vk->headless)
+	{
+		vk->frame_idx = (vk->frame_idx + 1) % MAX_IN_FLIGHT_FRAMES;
+		return;
+	}
 
 	VkPresentInfoKHR present_info = {};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	present_info.waitSemaphoreCount = 1;
-	present_info.pWaitSemaphores = &vk->semaphore_render_finished;
+	present_info.pWaitSemaphores = &vk->semaphores_render_finished[image_idx];
 	present_info.swapchainCount = 1;
 	present_info.pSwapchains = &vk->swapchain;
 	present_info.pImageIndices = &image_idx;
 
-	res = vkQueuePresentKHR(vk->queue_graphics, &present_info); // TODO - try queue_present?
+	{
+		PROFILE_ZONE("present");
+		res = vkQueuePresentKHR(vk->queue_graphics, &present_info); // TODO - try queue_present?
+	}
+
+	vk->frame_idx = (vk->frame_idx + 1) % MAX_IN_FLIGHT_FRAMES;
+
 	if(res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR)
 	{
 		vk_create_swapchain(vk, true);
-		return;
 	}
+}
 
-	vkDeviceWaitIdle(vk->device);
+// Headless only. Waits for the most recently submitted frame and returns its
+// pixels, tightly packed in surface_format, which stay valid until that frame
+// slot is next used.
+void* vk_headless_readback(struct vk_context* vk)
+{
+	uint32_t slot = (vk->frame_idx + MAX_IN_FLIGHT_FRAMES - 1) % MAX_IN_FLIGHT_FRAMES;
+	VK_VERIFY(vkWaitForFences(vk->device, 1, &vk->frames[slot].fence_in_flight, VK_TRUE, UINT64_MAX));
+	return vk->readback_memory[slot].mapped;
 }
@@ -0,0 +1,386 @@
+// Device memory sub-allocator.
+//
+// Rather than one vkAllocateMemory per resource, memory is allocated in large
+// blocks and resources are placed inside them. Each memory type has two pools
+// of blocks, one for buffers and one for optimally tiled images, so linear and
+// non-linear resources never share a block and bufferImageGranularity never
+// comes into play.
+//
+// Host visible blocks are mapped once when they are created and stay mapped.
+
+#define VK_MEMORY_BLOCK_BYTES (64 * 1024 * 1024)
+#define VK_MEMORY_MAX_BLOCKS_PER_POOL 16
+#define VK_MEMORY_MAX_FREE_RANGES 64
+
+struct vk_memory_range
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+};
+
+struct vk_memory_block
+{
+	VkDeviceMemory         memory;
+	VkDeviceSize           size;
+	void*                  mapped;
+
+	VkDeviceSize           bytes_in_use;
+	uint32_t               allocations_len;
+
+	// Sorted by offset and coalesced on free.
+	struct vk_memory_range free_ranges[VK_MEMORY_MAX_FREE_RANGES];
+	uint32_t               free_ranges_len;
+};
+
+struct vk_memory_pool
+{
+	struct vk_memory_block blocks[VK_MEMORY_MAX_BLOCKS_PER_POOL];
+	uint32_t               blocks_len;
+};
+
+struct vk_allocator
+{
+	VkDevice                         device;
+	VkPhysicalDeviceMemoryProperties properties;
+
+	// Indexed by memory type, then 0 for buffers and 1 for images.
+	struct vk_memory_pool            pools[VK_MAX_MEMORY_TYPES][2];
+};
+
+struct vk_allocation
+{
+	VkDeviceMemory memory;
+	VkDeviceSize   offset;
+	VkDeviceSize   size;
+	// Start of this allocation if it is host visible, otherwise null.
+	void*          mapped;
+
+	uint32_t       type_idx;
+	uint32_t       pool_idx;
+	uint32_t       block_idx;
+};
+
+VkDeviceSize vk_align_up(VkDeviceSize size, VkDeviceSize alignment)
+{
+	if(alignment == 0)
+	{
+		return size;
+	}
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+struct vk_allocator* vk_allocator_create(VkDevice device, VkPhysicalDevice physical_device)
+{
+	// Far too big for the stack, and vk_context is passed around by value.
+	struct vk_allocator* allocator = calloc(1, sizeof(struct vk_allocator));
+	if(!allocator)
+	{
+		printf("Failed to allocate device memory allocator.\n");
+		PANIC();
+	}
+
+	allocator->device = device;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &allocator->properties);
+
+	return allocator;
+}
+
+// Picks a memory type with all of the required properties, preferring one
+// which also has all of the preferred properties. For example, per frame
+// data requires host visible memory but prefers memory which is also device
+// local, which is what integrated GPUs and resizable BAR expose.
+uint32_t vk_get_memory_type(
+	struct vk_allocator*  allocator,
+	uint32_t              type_filter,
+	VkMemoryPropertyFlags required,
+	VkMemoryPropertyFlags preferred)
+{
+	VkPhysicalDeviceMemoryProperties* mem_properties = &allocator->properties;
+
+	VkMemoryPropertyFlags wanted = required | preferred;
+	for(uint32_t i = 0; i < mem_properties->memoryTypeCount; i++)
+	{
+		if((type_filter & (1 << i)) && (mem_properties->memoryTypes[i].propertyFlags & wanted) == wanted)
+		{
+			return i;
+		}
+	}
+	for(uint32_t i = 0; i < mem_properties->memoryTypeCount; i++)
+	{
+		if((type_filter & (1 << i)) && (mem_properties->memoryTypes[i].propertyFlags & required) == required)
+		{
+			return i;
+		}
+	}
+
+	printf("Failed to find suitable memory type.\n");
+	PANIC();
+}
+
+// Tries to place an allocation in a block, first fit. Returns false if there
+// isn't a large enough free range.
+bool vk_memory_block_allocate(
+	struct vk_memory_block* block,
+	VkDeviceSize            size,
+	VkDeviceSize            alignment,
+	VkDeviceSize*           offset)
+{
+	for(uint32_t i = 0; i < block->free_ranges_len; i++)
+	{
+		struct vk_memory_range range = block->free_ranges[i];
+
+		VkDeviceSize aligned = vk_align_up(range.offset, alignment);
+		VkDeviceSize padding = aligned - range.offset;
+		if(padding + size > range.size)
+		{
+			continue;
+		}
+
+		// Whatever is left either side of the allocation stays free. The padding
+		// before it keeps this slot and the tail after it needs a new one.
+		VkDeviceSize tail = range.size - padding - size;
+		uint32_t ranges_needed = (padding > 0) + (tail > 0);
+		if(block->free_ranges_len - 1 + ranges_needed > VK_MEMORY_MAX_FREE_RANGES)
+		{
+			continue;
+		}
+
+		if(padding > 0 && tail > 0)
+		{
+			memmove(
+				&block->free_ranges[i + 2], 
+				&block->free_ranges[i + 1], 
+				(block->free_ranges_len - i - 1) * sizeof(struct vk_memory_range));
+			block->free_ranges[i].size       = padding;
+			block->free_ranges[i + 1].offset = aligned + size;
+			block->free_ranges[i + 1].size   = tail;
+			block->free_ranges_len++;
+		}
+		else if(padding > 0)
+		{
+			block->free_ranges[i].size = padding;
+		}
+		else if(tail > 0)
+		{
+			block->free_ranges[i].offset = aligned + size;
+			block->free_ranges[i].size   = tail;
+		}
+		else
+		{
+			memmove(
+				&block->free_ranges[i], 
+				&block->free_ranges[i + 1], 
+				(block->free_ranges_len - i - 1) * sizeof(struct vk_memory_range));
+			block->free_ranges_len--;
+		}
+
+		block->bytes_in_use += size;
+		block->allocations_len++;
+		*offset = aligned;
+		return true;
+	}
+	return false;
+}
+
+void vk_allocate_memory(
+	struct vk_allocator*  allocator,
+	VkMemoryRequirements  reqs,
+	VkMemoryPropertyFlags required,
+	VkMemoryPropertyFlags preferred,
+	bool                  is_image,
+	struct vk_allocation* allocation)
+{
+	uint32_t type_idx = vk_get_memory_type(allocator, reqs.memoryTypeBits, required, preferred);
+	uint32_t pool_idx = is_image ? 1 : 0;
+	struct vk_memory_pool* pool = &allocator->pools[type_idx][pool_idx];
+
+	VkDeviceSize offset = 0;
+	uint32_t block_idx = 0;
+	for(; block_idx < pool->blocks_len; block_idx++)
+	{
+		if(vk_memory_block_allocate(&pool->blocks[block_idx], reqs.size, reqs.alignment, &offset))
+		{
+			break;
+		}
+	}
+
+	// Nothing fits, so start a new block. Anything larger than a standard block
+	// gets a block of its own.
+	if(block_idx == pool->blocks_len)
+	{
+		if(pool->blocks_len == VK_MEMORY_MAX_BLOCKS_PER_POOL)
+		{
+			printf("Out of memory blocks for memory type %u.\n", type_idx);
+			PANIC();
+		}
+
+		struct vk_memory_block* block = &pool->blocks[pool->blocks_len];
+		memset(block, 0, sizeof(*block));
+
+		VkDeviceSize heap_size = allocator->properties.memoryHeaps[allocator->properties.memoryTypes[type_idx].heapIndex].size;
+		block->size = VK_MEMORY_BLOCK_BYTES;
+		if(block->size > heap_size / 8)
+		{
+			block->size = heap_size / 8;
+		}
+		if(block->size < reqs.size)
+		{
+			block->size = reqs.size;
+		}
+
+		VkMemoryAllocateInfo alloc_info = {};
+		alloc_info.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize  = block->size;
+		alloc_info.memoryTypeIndex = type_idx;
+
+		VkResult res = vkAllocateMemory(allocator->device, &alloc_info, 0, &block->memory);
+		if(res != VK_SUCCESS)
+		{
+			printf("Error %i: Failed to allocate %lu byte memory block.\n", res, (unsigned long)block->size);
+			PANIC();
+		}
+
+		if(allocator->properties.memoryTypes[type_idx].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			VK_VERIFY(vkMapMemory(allocator->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+		}
+
+		block->free_ranges[0].offset = 0;
+		block->free_ranges[0].size   = block->size;
+		block->free_ranges_len       = 1;
+		pool->blocks_len++;
+
+		if(!vk_memory_block_allocate(block, reqs.size, reqs.alignment, &offset))
+		{
+			printf("Failed to allocate from a fresh memory block.\n");
+			PANIC();
+		}
+	}
+
+	struct vk_memory_block* block = &pool->blocks[block_idx];
+	allocation->memory    = block->memory;
+	allocation->offset    = offset;
+	allocation->size      = reqs.size;
+	allocation->mapped    = block->mapped ? (uint8_t*)block->mapped + offset : 0;
+	allocation->type_idx  = type_idx;
+	allocation->pool_idx  = pool_idx;
+	allocation->block_idx = block_idx;
+}
+
+void vk_free_memory(struct vk_allocator* allocator, struct vk_allocation* allocation)
+{
+	if(allocation->memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	struct vk_memory_block* block = &allocator->pools[allocation->type_idx][allocation->pool_idx].blocks[allocation->block_idx];
+
+	// Find where the range goes to keep the list sorted, then merge it with its
+	// neighbours if they touch.
+	uint32_t i = 0;
+	while(i < block->free_ranges_len && block->free_ranges[i].offset < allocation->offset)
+	{
+		i++;
+	}
+
+	bool merge_prev = i > 0 
+		&& block->free_ranges[i - 1].offset + block->free_ranges[i - 1].size == allocation->offset;
+	bool merge_next = i < block->free_ranges_len 
+		&& allocation->offset + allocation->size == block->free_ranges[i].offset;
+
+	if(merge_prev && merge_next)
+	{
+		block->free_ranges[i - 1].size += allocation->size + block->free_ranges[i].size;
+		memmove(
+			&block->free_ranges[i], 
+			&block->free_ranges[i + 1], 
+			(block->free_ranges_len - i - 1) * sizeof(struct vk_memory_range));
+		block->free_ranges_len--;
+	}
+	else if(merge_prev)
+	{
+		block->free_ranges[i - 1].size += allocation->size;
+	}
+	else if(merge_next)
+	{
+		block->free_ranges[i].offset = allocation->offset;
+		block->free_ranges[i].size  += allocation->size;
+	}
+	else
+	{
+		// XXX - If the list is full the range is leaked until the block empties.
+		// Hasn't come close to happening with 64 ranges.
+		if(block->free_ranges_len < VK_MEMORY_MAX_FREE_RANGES)
+		{
+			memmove(
+				&block->free_ranges[i + 1], 
+				&block->free_ranges[i], 
+				(block->free_ranges_len - i) * sizeof(struct vk_memory_range));
+			block->free_ranges[i].offset = allocation->offset;
+			block->free_ranges[i].size   = allocation->size;
+			block->free_ranges_len++;
+		}
+	}
+
+	block->bytes_in_use -= allocation->size;
+	block->allocations_len--;
+	if(block->allocations_len == 0)
+	{
+		block->free_ranges[0].offset = 0;
+		block->free_ranges[0].size   = block->size;
+		block->free_ranges_len       = 1;
+	}
+
+	memset(allocation, 0, sizeof(*allocation));
+}
+
+void vk_memory_print_stats(struct vk_allocator* allocator)
+{
+	VkDeviceSize total_bytes = 0;
+	VkDeviceSize total_in_use = 0;
+	uint32_t total_blocks = 0;
+
+	printf("Device memory:\n");
+	for(uint32_t type = 0; type < allocator->properties.memoryTypeCount; type++)
+	{
+		for(uint32_t pool_idx = 0; pool_idx < 2; pool_idx++)
+		{
+			struct vk_memory_pool* pool = &allocator->pools[type][pool_idx];
+			for(uint32_t b = 0; b < pool->blocks_len; b++)
+			{
+				struct vk_memory_block* block = &pool->blocks[b];
+
+				VkDeviceSize free_bytes = 0;
+				VkDeviceSize largest_free = 0;
+				for(uint32_t r = 0; r < block->free_ranges_len; r++)
+				{
+					free_bytes += block->free_ranges[r].size;
+					if(block->free_ranges[r].size > largest_free)
+					{
+						largest_free = block->free_ranges[r].size;
+					}
+				}
+
+				// 0 when all free space is one range, approaching 1 as it splinters.
+				float fragmentation = free_bytes > 0 ? 1.0f - (float)largest_free / (float)free_bytes : 0.0f;
+
+				printf(
+					"  type %2u %-7s block %2u: %8lu / %8lu KB in use, %3u allocations, %2u free ranges, %.2f fragmentation\n",
+					type,
+					pool_idx ? "images" : "buffers",
+					b,
+					(unsigned long)(block->bytes_in_use / 1024),
+					(unsigned long)(block->size / 1024),
+					block->allocations_len,
+					block->free_ranges_len,
+					fragmentation);
+
+				total_bytes  += block->size;
+				total_in_use += block->bytes_in_use;
+				total_blocks++;
+			}
+		}
+	}
+	printf("  %u blocks, %lu / %lu KB in use\n", total_blocks, (unsigned long)(total_in_use / 1024), (unsigned long)(total_bytes / 1024));
+}
@@ -0,0 +1,101 @@
+const char* vk_msaa_quality_names[VK_MSAA_QUALITY_LEN] = 
+{
+	"auto",
+	"off",
+	"low",
+	"medium",
+	"high"
+};
+
+// Rebuilds the multisampled attachments and graphics pipelines in place if the
+// sample count changes. Waits for the device to go idle if it does.
+void vk_msaa_apply(struct vk_context* vk, enum vk_msaa_quality tier)
+{
+	VkSampleCountFlagBits samples = vk_msaa_samples_for_quality(vk->supported_samples, tier);
+	if(samples == vk->render_samples)
+	{
+		return;
+	}
+
+	vk->render_samples = samples;
+	vk_create_swapchain(vk, true);
+}
+
+void vk_set_msaa_quality(struct vk_context* vk, enum vk_msaa_quality quality)
+{
+	vk->msaa_quality = quality;
+
+	enum vk_msaa_quality tier = quality;
+	if(quality == VK_MSAA_QUALITY_AUTO)
+	{
+		vk->msaa_auto = (struct vk_msaa_auto){};
+		vk->msaa_auto.tier = VK_MSAA_QUALITY_HIGH;
+		vk->msaa_auto.frames_to_skip = VK_MSAA_AUTO_SKIP_FRAMES;
+		tier = vk->msaa_auto.tier;
+	}
+	vk_msaa_apply(vk, tier);
+
+	printf("MSAA quality %s, %ux.\n", vk_msaa_quality_names[quality], vk->render_samples);
+}
+
+// Called once per frame. Does nothing unless auto mode is still looking for a
+// tier.
+void vk_msaa_auto_update(struct vk_context* vk)
+{
+	struct vk_msaa_auto* msaa_auto = &vk->msaa_auto;
+	if(vk->msaa_quality != VK_MSAA_QUALITY_AUTO || msaa_auto->settled)
+	{
+		return;
+	}
+
+	struct timespec time_cur;
+	clock_gettime(CLOCK_MONOTONIC, &time_cur);
+	if(msaa_auto->time_prev.tv_sec == 0 && msaa_auto->time_prev.tv_nsec == 0)
+	{
+		msaa_auto->time_prev = time_cur;
+		return;
+	}
+	float dt_ms = 
+		(time_cur.tv_sec - msaa_auto->time_prev.tv_sec) * 1000.0f + 
+		(time_cur.tv_nsec - msaa_auto->time_prev.tv_nsec) / 1000000.0f;
+	msaa_auto->time_prev = time_cur;
+	msaa_auto->time_since_start_ms += dt_ms;
+
+	if(msaa_auto->frames_to_skip > 0)
+	{
+		msaa_auto->frames_to_skip--;
+		return;
+	}
+
+	msaa_auto->window_ms += dt_ms;
+	msaa_auto->window_frames++;
+	if(msaa_auto->window_frames < VK_MSAA_AUTO_WINDOW_FRAMES)
+	{
+		return;
+	}
+
+	float avg_ms = msaa_auto->window_ms / msaa_auto->window_frames;
+	msaa_auto->window_ms     = 0;
+	msaa_auto->window_frames = 0;
+
+	bool too_slow = avg_ms > VK_MSAA_AUTO_TARGET_MS;
+	bool lowest   = vk->render_samples == VK_SAMPLE_COUNT_1_BIT;
+	bool out_of_time = msaa_auto->time_since_start_ms > VK_MSAA_AUTO_SECONDS * 1000.0f;
+	if(!too_slow || lowest || out_of_time)
+	{
+		msaa_auto->settled = true;
+		printf("MSAA auto settled on %ux at %.2fms per frame.\n", vk->render_samples, avg_ms);
+		return;
+	}
+
+	// Step down until the sample count actually changes, as a tier can clamp
+	// to the same count as the one above it.
+	VkSampleCountFlagBits samples_prev = vk->render_samples;
+	while(msaa_auto->tier > VK_MSAA_QUALITY_OFF && vk->render_samples == samples_prev)
+	{
+		msaa_auto->tier--;
+		vk_msaa_apply(vk, msaa_auto->tier);
+	}
+	msaa_auto->frames_to_skip = VK_MSAA_AUTO_SKIP_FRAMES;
+	printf("MSAA auto stepped down to %ux, %.2fms per frame was over target.\n", vk->render_samples, avg_ms);
+}
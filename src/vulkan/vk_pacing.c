@@ -0,0 +1,155 @@
+// Indexed by VkPresentModeKHR, which numbers the core modes from 0.
+const char* vk_present_mode_names[VK_PRESENT_MODE_FIFO_RELAXED_KHR + 1] = 
+{
+	"immediate",
+	"mailbox",
+	"fifo",
+	"fifo_relaxed"
+};
+
+// Returns false if name isn't one of vk_present_mode_names.
+bool vk_present_mode_from_name(const char* name, VkPresentModeKHR* mode)
+{
+	for(uint32_t i = 0; i <= VK_PRESENT_MODE_FIFO_RELAXED_KHR; i++)
+	{
+		if(strcmp(name, vk_present_mode_names[i]) == 0)
+		{
+			*mode = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// The present mode and image count are swapchain properties, so changing them
+// recreates it, which no longer stalls frames in flight. Headless has no
+// swapchain and ignores both.
+void vk_set_present_mode(struct vk_context* vk, VkPresentModeKHR mode)
+{
+	vk->pacing.present_mode = mode;
+	if(vk->headless || mode == vk->present_mode)
+	{
+		return;
+	}
+
+	vk_create_swapchain(vk, true);
+	if(vk->present_mode != mode)
+	{
+		printf("Present mode %s unsupported, using %s.\n", 
+			vk_present_mode_names[mode], 
+			vk_present_mode_names[vk->present_mode]);
+	}
+	else
+	{
+		printf("Present mode %s.\n", vk_present_mode_names[mode]);
+	}
+}
+
+void vk_set_swap_images(struct vk_context* vk, uint32_t swap_images)
+{
+	if(vk->pacing.swap_images == swap_images)
+	{
+		return;
+	}
+	vk->pacing.swap_images = swap_images;
+	if(vk->headless)
+	{
+		return;
+	}
+
+	vk_create_swapchain(vk, true);
+	printf("%u swapchain images.\n", vk->swap_images_len);
+}
+
+void vk_set_frame_cap(struct vk_context* vk, float hz)
+{
+	vk->pacing.frame_cap_hz      = hz > 0 ? hz : 0;
+	vk->pacing.frame_deadline_ns = 0;
+
+	if(vk->pacing.frame_cap_hz > 0)
+	{
+		printf("Frame cap %.0fHz.\n", vk->pacing.frame_cap_hz);
+	}
+	else
+	{
+		printf("Frame cap off.\n");
+	}
+}
+
+void vk_set_max_frames_ahead(struct vk_context* vk, uint32_t frames)
+{
+	if(frames < 1)
+	{
+		frames = 1;
+	}
+	if(frames > MAX_IN_FLIGHT_FRAMES)
+	{
+		frames = MAX_IN_FLIGHT_FRAMES;
+	}
+	vk->pacing.max_frames_ahead = frames;
+
+	printf("At most %u frames ahead of the GPU.\n", frames);
+}
+
+uint64_t vk_pacing_now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+// Called by the platform at the top of each frame, before it polls input, so
+// neither wait adds to the latency of the input it then reads.
+//
+// The latency limiter waits until the GPU has finished all but the last
+// max_frames_ahead - 1 frames, so the frame about to start is at most
+// max_frames_ahead ahead. With the default of MAX_IN_FLIGHT_FRAMES that's the
+// same fence vk_begin_frame waits on anyway.
+//
+// The frame cap then sleeps until the frame's deadline, less VK_PACING_SPIN_NS
+// which is spun off instead for accuracy. Deadlines advance by a fixed period
+// so the average rate holds, but a frame that runs over by more than a whole
+// period resets them rather than trying to catch up with a burst.
+void vk_pace_frame(struct vk_context* vk)
+{
+	PROFILE_ZONE("pace");
+
+	// Fences are the closest thing we have to presentation without
+	// VK_KHR_present_wait, and the GPU finishing a frame is when it's queued
+	// for presentation.
+	{
+		uint32_t slot = 
+			(vk->frame_idx + MAX_IN_FLIGHT_FRAMES - vk->pacing.max_frames_ahead) % 
+			MAX_IN_FLIGHT_FRAMES;
+		VK_VERIFY(vkWaitForFences(vk->device, 1, &vk->frames[slot].fence_in_flight, VK_TRUE, UINT64_MAX));
+	}
+
+	if(vk->pacing.frame_cap_hz <= 0)
+	{
+		return;
+	}
+
+	uint64_t period_ns = (uint64_t)(1000000000.0 / vk->pacing.frame_cap_hz);
+	uint64_t now_ns    = vk_pacing_now_ns();
+	uint64_t deadline  = vk->pacing.frame_deadline_ns;
+
+	if(deadline == 0 || now_ns > deadline + period_ns)
+	{
+		vk->pacing.frame_deadline_ns = now_ns + period_ns;
+		return;
+	}
+
+	if(deadline > now_ns + VK_PACING_SPIN_NS)
+	{
+		uint64_t sleep_ns = deadline - now_ns - VK_PACING_SPIN_NS;
+		struct timespec sleep_time = {};
+		sleep_time.tv_sec  = sleep_ns / 1000000000ull;
+		sleep_time.tv_nsec = sleep_ns % 1000000000ull;
+		nanosleep(&sleep_time, 0);
+	}
+	while(vk_pacing_now_ns() < deadline)
+	{
+	}
+
+	vk->pacing.frame_deadline_ns = deadline + period_ns;
+}
@@ -0,0 +1,589 @@
+// Parallel recording of secondary command buffers for the frame's rendering.
+//
+// vk_loop hands a list of tasks to vk_recorder_begin at the start of the frame
+// and carries on recording the primary command buffer. Each task is a job on
+// the job system, recording into a secondary command buffer from the task's
+// own per-frame pool, and vk_recorder_wait hands them back in task order to be
+// executed inside the rendering. So recording gets the same threads as the
+// game, and without a pool the tasks just run inline in vk_recorder_wait.
+//
+// Below that is the recording of the frame itself, which vk_loop does either
+// every frame or, with command buffer reuse, only when vk_reuse.c finds the
+// last recording out of date.
+
+#define VK_RECORD_MAX_TASKS 8
+
+typedef void (*vk_record_func)(struct vk_context* vk, VkCommandBuffer command_buffer, void* data);
+
+struct vk_record_task
+{
+	vk_record_func record;
+	void*          data;
+};
+
+struct vk_recorder;
+
+// What a task's job gets handed.
+struct vk_record_job
+{
+	struct vk_recorder* recorder;
+	uint32_t            idx;
+};
+
+struct vk_recorder
+{
+	struct job_counter    counter;
+
+	// Only valid between vk_recorder_begin and vk_recorder_wait.
+	struct vk_context*    vk;
+	struct vk_record_task tasks[VK_RECORD_MAX_TASKS];
+	struct vk_record_job  jobs[VK_RECORD_MAX_TASKS];
+	uint32_t              tasks_len;
+	// Kept per frame slot, so a slot's last secondaries can be executed again.
+	VkCommandBuffer       recorded[MAX_IN_FLIGHT_FRAMES][VK_RECORD_MAX_TASKS];
+
+	// A pool per task, since a task can run on any thread and pools can't be
+	// shared between threads. Reset whole when the task is recorded, once the
+	// frame's fence has been waited on.
+	VkCommandPool         command_pools[MAX_IN_FLIGHT_FRAMES][VK_RECORD_MAX_TASKS];
+	VkCommandBuffer       command_buffers[MAX_IN_FLIGHT_FRAMES][VK_RECORD_MAX_TASKS];
+};
+
+// VK_VERIFY writes a global, so jobs check results themselves.
+void vk_record_job_verify(VkResult res, const char* what)
+{
+	if(res != VK_SUCCESS)
+	{
+		printf("Recording job failed to %s (%i).\n", what, res);
+		PANIC();
+	}
+}
+
+void vk_record_job_work(void* data, uint32_t begin, uint32_t end)
+{
+	PROFILE_ZONE("record_secondary");
+
+	struct vk_record_job* job = data;
+	struct vk_recorder* recorder = job->recorder;
+	struct vk_context* vk = recorder->vk;
+	uint32_t frame = vk->frame_idx;
+	uint32_t i = job->idx;
+
+	vk_record_job_verify(vkResetCommandPool(vk->device, recorder->command_pools[frame][i], 0), "reset its pool");
+
+	// Secondaries recorded for use inside dynamic rendering have to declare the
+	// attachments they'll be executed against.
+	VkCommandBufferInheritanceRenderingInfo rendering_info = {};
+	rendering_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+	rendering_info.colorAttachmentCount    = 1;
+	rendering_info.pColorAttachmentFormats = &vk->surface_format.format;
+	rendering_info.depthAttachmentFormat   = DEPTH_ATTACHMENT_FORMAT;
+	rendering_info.rasterizationSamples    = vk->render_samples;
+
+	VkCommandBufferInheritanceInfo inheritance_info = {};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.pNext = &rendering_info;
+
+	// Reused secondaries get executed by each of the slot's primaries, one per
+	// swapchain image, and a secondary without SIMULTANEOUS_USE would
+	// invalidate the primary it was last recorded into.
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags            =
+		(vk->reuse.enabled ? VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) |
+		VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	begin_info.pInheritanceInfo = &inheritance_info;
+
+	VkCommandBuffer command_buffer = recorder->command_buffers[frame][i];
+	vk_record_job_verify(vkBeginCommandBuffer(command_buffer, &begin_info), "begin a secondary");
+	recorder->tasks[i].record(vk, command_buffer, recorder->tasks[i].data);
+	vk_record_job_verify(vkEndCommandBuffer(command_buffer), "end a secondary");
+	recorder->recorded[frame][i] = command_buffer;
+}
+
+void vk_recorder_init(struct vk_context* vk, uint32_t graphics_family_idx)
+{
+	struct vk_recorder* recorder = calloc(1, sizeof(struct vk_recorder));
+	vk->recorder = recorder;
+
+	for(uint32_t f = 0; f < MAX_IN_FLIGHT_FRAMES; f++)
+	{
+		for(uint32_t i = 0; i < VK_RECORD_MAX_TASKS; i++)
+		{
+			VkCommandPoolCreateInfo pool_info = {};
+			pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_info.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+			pool_info.queueFamilyIndex = graphics_family_idx;
+			VK_VERIFY(vkCreateCommandPool(vk->device, &pool_info, 0, &recorder->command_pools[f][i]));
+
+			VkCommandBufferAllocateInfo buf_info = {};
+			buf_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			buf_info.commandPool        = recorder->command_pools[f][i];
+			buf_info.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			buf_info.commandBufferCount = 1;
+			VK_VERIFY(vkAllocateCommandBuffers(vk->device, &buf_info, &recorder->command_buffers[f][i]));
+		}
+	}
+}
+
+// Must be called after vk_begin_frame has waited on the frame's fence, and
+// followed by vk_recorder_wait before the frame is submitted. Both from the
+// thread which called jobs_init, if anyone did.
+void vk_recorder_begin(struct vk_context* vk, struct vk_record_task* tasks, uint32_t tasks_len)
+{
+	struct vk_recorder* recorder = vk->recorder;
+	if(tasks_len > VK_RECORD_MAX_TASKS)
+	{
+		printf("At most %u recording tasks per frame.\n", VK_RECORD_MAX_TASKS);
+		PANIC();
+	}
+
+	recorder->vk        = vk;
+	recorder->tasks_len = tasks_len;
+	memcpy(recorder->tasks, tasks, tasks_len * sizeof(*tasks));
+	for(uint32_t i = 0; i < tasks_len; i++)
+	{
+		recorder->jobs[i].recorder = recorder;
+		recorder->jobs[i].idx      = i;
+		job_run(&recorder->counter, vk_record_job_work, &recorder->jobs[i]);
+	}
+}
+
+// Returns the secondary command buffers in task order.
+VkCommandBuffer* vk_recorder_wait(struct vk_context* vk)
+{
+	PROFILE_ZONE("record_wait");
+
+	struct vk_recorder* recorder = vk->recorder;
+	job_wait(&recorder->counter);
+	recorder->vk = 0;
+
+	return recorder->recorded[vk->frame_idx];
+}
+
+// What vk_recorder_wait last returned for this frame slot, without recording
+// anything.
+VkCommandBuffer* vk_recorder_last(struct vk_context* vk)
+{
+	return vk->recorder->recorded[vk->frame_idx];
+}
+
+void vk_recorder_deinit(struct vk_context* vk)
+{
+	struct vk_recorder* recorder = vk->recorder;
+
+	for(uint32_t f = 0; f < MAX_IN_FLIGHT_FRAMES; f++)
+	{
+		for(uint32_t i = 0; i < VK_RECORD_MAX_TASKS; i++)
+		{
+			vkDestroyCommandPool(vk->device, recorder->command_pools[f][i], 0);
+		}
+	}
+
+	free(recorder);
+	vk->recorder = 0;
+}
+
+// Secondaries don't inherit dynamic state from the primary, so each one sets
+// its own.
+void vk_record_viewport(struct vk_context* vk, VkCommandBuffer command_buffer)
+{
+	VkViewport viewport = {};
+	viewport.x        = 0;
+	viewport.y        = 0;
+	viewport.width    = (float)vk->swap_extent.width;
+	viewport.height   = (float)vk->swap_extent.height;
+	viewport.minDepth = 0;
+	viewport.maxDepth = 1;
+	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = (VkOffset2D){0, 0};
+	scissor.extent = vk->swap_extent;
+	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
+
+// Recorded by the recorder's jobs into secondary command buffers, executed
+// in this order inside the frame's rendering.
+void vk_record_world(struct vk_context* vk, VkCommandBuffer command_buffer, void* data)
+{
+	vk_record_viewport(vk, command_buffer);
+
+	vkCmdBindPipeline(
+		command_buffer, 
+		VK_PIPELINE_BIND_POINT_GRAPHICS, 
+		vk->pipeline_resources_world.pipeline);
+
+	VkDeviceSize offsets[] = {vk->mesh_data_cube.buffer_offset_vertex};
+	vkCmdBindVertexBuffers(
+		command_buffer, 
+		0, 
+		1, 
+		&vk->device_local_buffer,
+		offsets);
+	vkCmdBindIndexBuffer(
+		command_buffer, 
+		vk->device_local_buffer, 
+		vk->mesh_data_cube.buffer_offset_index, 
+		VK_INDEX_TYPE_UINT16);
+
+	vkCmdBindDescriptorSets(
+		command_buffer, 
+		VK_PIPELINE_BIND_POINT_GRAPHICS, 
+		vk->pipeline_resources_world.pipeline_layout, 
+		0, 
+		1, 
+		&vk->pipeline_resources_world.descriptor_sets[vk->frame_idx],
+		0,
+		0);
+
+	// Every visible cube in one draw. The instance count was written
+	// by the culling pass, and the vertex shader picks its model matrix
+	// out of the visible list by gl_InstanceIndex.
+	vk_gpu_profiler_begin_statistics(vk, command_buffer, VK_GPU_PASS_WORLD);
+	vkCmdDrawIndexedIndirect(
+		command_buffer, 
+		vk->instances.cull_buffers[vk->frame_idx], 
+		offsetof(struct vk_cull_memory, draw_command), 
+		1, 
+		sizeof(VkDrawIndexedIndirectCommand));
+	vk_gpu_profiler_end_statistics(vk, command_buffer, VK_GPU_PASS_WORLD);
+
+	vk_gpu_profiler_end_pass(vk, command_buffer, VK_GPU_PASS_WORLD);
+}
+
+void vk_record_reticle(struct vk_context* vk, VkCommandBuffer command_buffer, void* data)
+{
+	vk_record_viewport(vk, command_buffer);
+
+	vkCmdBindPipeline(
+		command_buffer, 
+		VK_PIPELINE_BIND_POINT_GRAPHICS, 
+		vk->pipeline_resources_reticle.pipeline);
+
+	VkDeviceSize offset = {vk->mesh_data_reticle.buffer_offset_vertex};
+	vkCmdBindVertexBuffers(
+		command_buffer, 
+		0, 
+		1, 
+		&vk->device_local_buffer,
+		&offset);
+	vkCmdBindIndexBuffer(
+		command_buffer, 
+		vk->device_local_buffer, 
+		vk->mesh_data_reticle.buffer_offset_index, 
+		VK_INDEX_TYPE_UINT16);
+
+	vkCmdBindDescriptorSets(
+		command_buffer, 
+		VK_PIPELINE_BIND_POINT_GRAPHICS, 
+		vk->pipeline_resources_reticle.pipeline_layout, 
+		0, 
+		1, 
+		&vk->pipeline_resources_reticle.descriptor_sets[vk->frame_idx],
+		0,
+		0);
+
+	vk_gpu_profiler_begin_statistics(vk, command_buffer, VK_GPU_PASS_RETICLE);
+	vkCmdDrawIndexed(command_buffer, vk->mesh_data_reticle.indices_len, 1, 0, 0, 0);
+	vk_gpu_profiler_end_statistics(vk, command_buffer, VK_GPU_PASS_RETICLE);
+
+	vk_gpu_profiler_end_pass(vk, command_buffer, VK_GPU_PASS_RETICLE);
+}
+
+// The raster passes' secondaries, in the order they're executed in.
+struct vk_record_task vk_raster_tasks[] =
+{
+	{vk_record_world,   0},
+	{vk_record_reticle, 0},
+};
+#define VK_RASTER_TASKS_LEN (sizeof(vk_raster_tasks) / sizeof(vk_raster_tasks[0]))
+
+// The frame's render graph, with the indices of its resources for the passes
+// to find them by.
+struct vk_frame_graph
+{
+	struct vk_graph      graph;
+	struct render_group* render_group;
+	uint32_t             image_idx;
+	bool                 record_secondaries;
+	bool                 compute_output;
+
+	uint32_t             swap;
+	uint32_t             render;
+	uint32_t             depth;
+	uint32_t             cull;
+	uint32_t             readback;
+};
+
+void vk_record_trace(struct vk_context* vk, VkCommandBuffer command_buffer, struct vk_graph_pass* pass, void* data)
+{
+	vk_compute_record_trace(vk, command_buffer);
+}
+
+void vk_record_blit(struct vk_context* vk, VkCommandBuffer command_buffer, struct vk_graph_pass* pass, void* data)
+{
+	struct vk_frame_graph* frame_graph = data;
+	vk_compute_record_blit(vk, command_buffer, vk->swap_images[frame_graph->image_idx]);
+}
+
+// The world pass draws whatever the cull pass counts into the draw command.
+void vk_record_cull_reset(struct vk_context* vk, VkCommandBuffer command_buffer, struct vk_graph_pass* pass, void* data)
+{
+	VkDrawIndexedIndirectCommand draw_command = {};
+	draw_command.indexCount    = vk->mesh_data_cube.indices_len;
+	draw_command.instanceCount = 0;
+	vkCmdUpdateBuffer(
+		command_buffer,
+		vk->instances.cull_buffers[vk->frame_idx],
+		offsetof(struct vk_cull_memory, draw_command),
+		sizeof(draw_command),
+		&draw_command);
+}
+
+// Appends every instance which is inside the frustum and not fully fogged to
+// the visible list, counting them into the draw command.
+void vk_record_cull(struct vk_context* vk, VkCommandBuffer command_buffer, struct vk_graph_pass* pass, void* data)
+{
+	vkCmdBindPipeline(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		vk->pipeline_resources_cull.pipeline);
+	vkCmdBindDescriptorSets(
+		command_buffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		vk->pipeline_resources_cull.pipeline_layout,
+		0,
+		1,
+		&vk->pipeline_resources_cull.descriptor_sets[vk->frame_idx],
+		0,
+		0);
+
+	// Dispatched for the frame's whole instance capacity rather than its
+	// count, which cull.comp reads from the UBO and stops at, so the
+	// command buffer doesn't depend on it and can be reused.
+	// VOLATILE - Group size must match local_size_x in cull.comp.
+	vkCmdDispatch(command_buffer, (vk->instances.frame_capacities[vk->frame_idx] + 63) / 64, 1, 1);
+
+	vk_gpu_profiler_end_pass(vk, command_buffer, VK_GPU_PASS_CULL);
+}
+
+void vk_record_raster(struct vk_context* vk, VkCommandBuffer command_buffer, struct vk_graph_pass* pass, void* data)
+{
+	struct vk_frame_graph* frame_graph = data;
+	struct render_group* render_group = frame_graph->render_group;
+	VkImageView swap_view = vk->swap_views[frame_graph->image_idx];
+
+	VkRenderingAttachmentInfo color_attachment = {};
+	color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	if(vk->render_samples > VK_SAMPLE_COUNT_1_BIT)
+	{
+		vk_graph_attachment(pass, frame_graph->render, &color_attachment);
+		color_attachment.imageView          = vk->render_view;
+		color_attachment.resolveMode        = VK_RESOLVE_MODE_AVERAGE_BIT;
+		color_attachment.resolveImageView   = swap_view;
+		color_attachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+	else
+	{
+		vk_graph_attachment(pass, frame_graph->swap, &color_attachment);
+		color_attachment.imageView   = swap_view;
+		color_attachment.resolveMode = VK_RESOLVE_MODE_NONE;
+	}
+	color_attachment.clearValue.color   = 
+		(VkClearColorValue)
+		{{
+			render_group->clear_color.r, 
+			render_group->clear_color.g, 
+			render_group->clear_color.b, 
+			1.0f
+		}};
+
+	VkRenderingAttachmentInfo depth_attachment = {};
+	depth_attachment.sType                   = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	vk_graph_attachment(pass, frame_graph->depth, &depth_attachment);
+	depth_attachment.imageView               = vk->depth_view;
+	depth_attachment.resolveMode             = VK_RESOLVE_MODE_NONE;
+	depth_attachment.clearValue.depthStencil = 
+		(VkClearDepthStencilValue)
+		{
+			1.0f,
+			0
+		};
+
+	VkRenderingInfo render_info = {};
+	render_info.sType                = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	render_info.renderArea           = (VkRect2D){{0, 0}, vk->swap_extent};
+	render_info.layerCount           = 1;
+	render_info.colorAttachmentCount = 1;
+	render_info.pColorAttachments    = &color_attachment;
+	render_info.pDepthAttachment     = &depth_attachment;
+	render_info.pStencilAttachment   = 0;
+	render_info.flags                = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+	vkCmdBeginRendering(command_buffer, &render_info);
+	{
+		VkCommandBuffer* secondaries = frame_graph->record_secondaries ? vk_recorder_wait(vk) : vk_recorder_last(vk);
+		vkCmdExecuteCommands(command_buffer, VK_RASTER_TASKS_LEN, secondaries);
+	}
+	vkCmdEndRendering(command_buffer);
+	vk_gpu_profiler_end_pass(vk, command_buffer, VK_GPU_PASS_RESOLVE);
+}
+
+// Headless only. Tightly packed, so the readback buffer is the image row by
+// row.
+void vk_record_readback(struct vk_context* vk, VkCommandBuffer command_buffer, struct vk_graph_pass* pass, void* data)
+{
+	struct vk_frame_graph* frame_graph = data;
+
+	VkBufferImageCopy copy = {};
+	copy.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.imageSubresource.mipLevel       = 0;
+	copy.imageSubresource.baseArrayLayer = 0;
+	copy.imageSubresource.layerCount     = 1;
+	copy.imageExtent.width               = vk->swap_extent.width;
+	copy.imageExtent.height              = vk->swap_extent.height;
+	copy.imageExtent.depth               = 1;
+	vkCmdCopyImageToBuffer(
+		command_buffer,
+		vk->swap_images[frame_graph->image_idx],
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		vk->readback_buffers[vk->frame_idx],
+		1,
+		&copy);
+}
+
+// Declares the frame's resources and passes. Also built by vk_create_swapchain,
+// with compute_output false, for the lifetimes of the transient attachments.
+void vk_frame_graph_build(struct vk_context* vk, struct vk_frame_graph* frame_graph)
+{
+	struct vk_graph* graph = &frame_graph->graph;
+	vk_graph_init(graph);
+
+	// The swapchain image's contents are never kept. Its first barrier has to
+	// start from the stage the frame's submission waits on the acquire at, so
+	// the transition can't happen before the image is actually available.
+	// VOLATILE - Must match the image available wait stage in vk_loop.
+	frame_graph->swap = vk_graph_import_image(
+		graph,
+		"swap",
+		vk->swap_images[frame_graph->image_idx],
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		frame_graph->compute_output ? VK_GRAPH_ACCESS_TRANSFER_WRITE : VK_GRAPH_ACCESS_COLOR_WRITE,
+		false,
+		vk->headless ? VK_GRAPH_ACCESS_NONE : VK_GRAPH_ACCESS_PRESENT);
+
+	if(frame_graph->compute_output)
+	{
+		// The trace image isn't in the graph, since with async compute it moves
+		// between queues. vk_compute.c places its barriers itself.
+		vk_graph_add_pass(graph, "trace", vk_record_trace);
+
+		struct vk_graph_pass* blit = vk_graph_add_pass(graph, "blit", vk_record_blit);
+		vk_graph_use(blit, frame_graph->swap, VK_GRAPH_ACCESS_TRANSFER_WRITE, false);
+	}
+	else
+	{
+		// This frame slot's own, last read by the slot's previous world pass.
+		frame_graph->cull = vk_graph_import_buffer(
+			graph,
+			"cull",
+			vk->instances.cull_buffers[vk->frame_idx],
+			VK_GRAPH_ACCESS_INDIRECT_READ,
+			VK_GRAPH_ACCESS_NONE);
+
+		// Without multisampling the world renders straight into the swapchain
+		// image and there's no render image.
+		bool multisampled = vk->render_samples > VK_SAMPLE_COUNT_1_BIT;
+		if(multisampled)
+		{
+			frame_graph->render = vk_graph_transient_image(
+				graph,
+				"render",
+				&vk->render_image,
+				&vk->render_view,
+				&vk->render_image_memory,
+				vk->surface_format.format,
+				vk->render_samples,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+				VK_IMAGE_ASPECT_COLOR_BIT);
+		}
+		// TODO - If depth is ever read back, or read by a later pass, the graph
+		// will refuse it as a transient and it needs importing instead.
+		frame_graph->depth = vk_graph_transient_image(
+			graph,
+			"depth",
+			&vk->depth_image,
+			&vk->depth_view,
+			&vk->depth_image_memory,
+			DEPTH_ATTACHMENT_FORMAT,
+			vk->render_samples,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_IMAGE_ASPECT_DEPTH_BIT);
+
+		struct vk_graph_pass* cull_reset = vk_graph_add_pass(graph, "cull_reset", vk_record_cull_reset);
+		vk_graph_use(cull_reset, frame_graph->cull, VK_GRAPH_ACCESS_TRANSFER_WRITE, false);
+
+		struct vk_graph_pass* cull = vk_graph_add_pass(graph, "cull", vk_record_cull);
+		vk_graph_use(cull, frame_graph->cull, VK_GRAPH_ACCESS_COMPUTE_WRITE, false);
+
+		struct vk_graph_pass* raster = vk_graph_add_pass(graph, "raster", vk_record_raster);
+		vk_graph_use(raster, frame_graph->cull, VK_GRAPH_ACCESS_INDIRECT_READ, false);
+		if(multisampled)
+		{
+			vk_graph_use(raster, frame_graph->render, VK_GRAPH_ACCESS_COLOR_WRITE, true);
+		}
+		vk_graph_use(raster, frame_graph->swap, VK_GRAPH_ACCESS_COLOR_WRITE, !multisampled);
+		vk_graph_use(raster, frame_graph->depth, VK_GRAPH_ACCESS_DEPTH_WRITE, true);
+	}
+
+	if(vk->headless)
+	{
+		frame_graph->readback = vk_graph_import_buffer(
+			graph,
+			"readback",
+			vk->readback_buffers[vk->frame_idx],
+			VK_GRAPH_ACCESS_NONE,
+			VK_GRAPH_ACCESS_HOST_READ);
+
+		struct vk_graph_pass* readback = vk_graph_add_pass(graph, "readback", vk_record_readback);
+		vk_graph_use(readback, frame_graph->swap, VK_GRAPH_ACCESS_TRANSFER_READ, false);
+		vk_graph_use(readback, frame_graph->readback, VK_GRAPH_ACCESS_TRANSFER_WRITE, false);
+	}
+}
+
+// Records the frame's graph, from the cull pass to the final swapchain image
+// barrier. Depends on nothing that changes from frame to frame other than
+// what vk_reuse_signature covers, so the result can be submitted again for
+// the same frame slot and swapchain image.
+void vk_record_frame(
+	struct vk_context*   vk,
+	VkCommandBuffer      command_buffer,
+	struct render_group* render_group,
+	uint32_t             image_idx,
+	bool                 record_secondaries)
+{
+	struct vk_frame_graph frame_graph;
+	frame_graph.render_group       = render_group;
+	frame_graph.image_idx          = image_idx;
+	frame_graph.record_secondaries = record_secondaries;
+	frame_graph.compute_output     = vk->compute_output;
+	vk_frame_graph_build(vk, &frame_graph);
+
+	// Timestamps from the async compute queue couldn't be compared against
+	// the graphics queue's, so the GPU profiler only covers the raster path.
+	if(!frame_graph.compute_output)
+	{
+		vk_gpu_profiler_begin_frame(vk, command_buffer);
+
+		// Start the secondaries recording first, so they're done on the
+		// job system while this thread records the passes before them.
+		// When reusing, the slot's last secondaries may still be good.
+		if(record_secondaries)
+		{
+			vk_recorder_begin(vk, vk_raster_tasks, VK_RASTER_TASKS_LEN);
+		}
+	}
+
+	vk_graph_record(vk, &frame_graph.graph, command_buffer, &frame_graph);
+}
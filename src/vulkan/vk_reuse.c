@@ -0,0 +1,124 @@
+// Reuse of recorded frames. A frame's commands only change when the scene's
+// structure does: the pipelines, meshes, attachments and swapchain image, and
+// whether it's traced or rasterized. The camera, instance transforms and
+// instance count are all read from buffers when the commands execute, and the
+// cull pass is dispatched for the frame's whole instance capacity, so the same
+// command buffer can be submitted frame after frame.
+//
+// Each frame slot has a primary per swapchain image. vk_reuse_command_buffer
+// compares the signature the slot's primary for the acquired image was
+// recorded with against the current one, and only records it again if they
+// differ.
+
+void vk_reuse_init(struct vk_context* vk)
+{
+	struct vk_reuse_context* reuse = &vk->reuse;
+	reuse->enabled = VK_REUSE_COMMAND_BUFFERS;
+
+	for(uint32_t f = 0; f < MAX_IN_FLIGHT_FRAMES; f++)
+	{
+		VkCommandBufferAllocateInfo buf_info = {};
+		buf_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		buf_info.commandPool        = vk->command_pool;
+		buf_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		buf_info.commandBufferCount = MAX_SWAP_IMAGES;
+		VK_VERIFY(vkAllocateCommandBuffers(vk->device, &buf_info, reuse->command_buffers[f]));
+	}
+
+	memset(reuse->signatures, 0, sizeof(reuse->signatures));
+	memset(reuse->secondaries_signatures, 0, sizeof(reuse->secondaries_signatures));
+}
+
+// Forgets every recording. Needed whenever something they reference is
+// destroyed, even if it's recreated with the same parameters, since the new
+// handle can come back with the old one's value. A zeroed signature never
+// matches, there's always a world pipeline.
+void vk_reuse_invalidate(struct vk_context* vk)
+{
+	memset(vk->reuse.signatures, 0, sizeof(vk->reuse.signatures));
+	memset(vk->reuse.secondaries_signatures, 0, sizeof(vk->reuse.secondaries_signatures));
+}
+
+void vk_set_command_buffer_reuse(struct vk_context* vk, bool enabled)
+{
+	// The slot's secondaries were recorded one time submit while reuse was off.
+	vk_reuse_invalidate(vk);
+	vk->reuse.enabled = enabled;
+	printf("Command buffer reuse %s.\n", enabled ? "on" : "off");
+}
+
+struct vk_reuse_signature vk_reuse_signature(
+	struct vk_context*   vk,
+	struct render_group* render_group,
+	uint32_t             image_idx)
+{
+	struct vk_reuse_signature signature;
+	memset(&signature, 0, sizeof(signature));
+	signature.pipeline_world            = vk->pipeline_resources_world.pipeline;
+	signature.pipeline_reticle          = vk->pipeline_resources_reticle.pipeline;
+	signature.pipeline_cull             = vk->pipeline_resources_cull.pipeline;
+	signature.pipeline_trace            = vk->pipeline_resources_trace.pipeline;
+	signature.device_local_buffer       = vk->device_local_buffer;
+	signature.instance_buffer           = vk->instances.buffers[vk->frame_idx];
+	signature.cull_buffer               = vk->instances.cull_buffers[vk->frame_idx];
+	signature.instances_capacity        = vk->instances.frame_capacities[vk->frame_idx];
+	signature.cube_indices_len          = vk->mesh_data_cube.indices_len;
+	signature.reticle_indices_len       = vk->mesh_data_reticle.indices_len;
+	signature.extent                    = vk->swap_extent;
+	signature.samples                   = vk->render_samples;
+	signature.render_view               = vk->render_view;
+	signature.depth_view                = vk->depth_view;
+	signature.swap_view                 = vk->swap_views[image_idx];
+	signature.compute_output            = vk->compute_output;
+	signature.compute_images_generation = vk->compute.images_generation;
+	signature.gpu_profiler_enabled      = vk->gpu_profiler.enabled;
+	signature.clear_color               = render_group->clear_color;
+	return signature;
+}
+
+// Returns a primary for this frame, recorded now or earlier, which the frame's
+// fence wait has made safe to submit again. Only called when reuse is enabled.
+VkCommandBuffer vk_reuse_command_buffer(
+	struct vk_context*   vk,
+	struct render_group* render_group,
+	uint32_t             image_idx)
+{
+	struct vk_reuse_context* reuse = &vk->reuse;
+	uint32_t frame = vk->frame_idx;
+	VkCommandBuffer command_buffer = reuse->command_buffers[frame][image_idx];
+
+	struct vk_reuse_signature signature = vk_reuse_signature(vk, render_group, image_idx);
+	if(memcmp(&signature, &reuse->signatures[frame][image_idx], sizeof(signature)) == 0)
+	{
+		if(!vk->compute_output)
+		{
+			vk_gpu_profiler_reuse_frame(vk);
+		}
+		return command_buffer;
+	}
+
+	// The secondaries are shared by all of the slot's primaries, so new ones
+	// leave every other primary in the slot executing stale commands. The
+	// slot's last frame has finished, so none of them are pending.
+	struct vk_reuse_signature secondaries_signature = signature;
+	secondaries_signature.swap_view   = 0;
+	secondaries_signature.clear_color = (struct v3){};
+	bool record_secondaries =
+		!vk->compute_output &&
+		memcmp(&secondaries_signature, &reuse->secondaries_signatures[frame], sizeof(signature)) != 0;
+	if(record_secondaries)
+	{
+		memset(reuse->signatures[frame], 0, sizeof(reuse->signatures[frame]));
+		reuse->secondaries_signatures[frame] = secondaries_signature;
+	}
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	VK_VERIFY(vkResetCommandBuffer(command_buffer, 0));
+	VK_VERIFY(vkBeginCommandBuffer(command_buffer, &begin_info));
+	vk_record_frame(vk, command_buffer, render_group, image_idx, record_secondaries);
+	VK_VERIFY(vkEndCommandBuffer(command_buffer));
+
+	reuse->signatures[frame][image_idx] = signature;
+	return command_buffer;
+}
@@ -1,4 +1,6 @@
-#define MAX_INSTANCES 256
+// Instances to make room for up front if the platform doesn't say. More are
+// allocated as the render group asks for them.
+#define VK_INSTANCES_DEFAULT_CAPACITY 1024
 
 struct vk_ubo_global_world
 {
@@ -9,6 +11,13 @@ struct vk_ubo_global_world
 	float max_draw_distance_z;
 };
 
+// Inputs to the culling compute pass which aren't already in the world UBO.
+struct vk_ubo_cull
+{
+	uint32_t instances_len;
+	float    instance_radius;
+};
+
 // TODO - Our own m4 struct
 // TODO - I figure optimally, we probably want to precompute proj * view every
 // frame as our uniform buffer, then push the model as a push constant.
@@ -16,24 +25,54 @@ struct vk_ubo_global
 {
 	alignas(64) struct vk_ubo_global_world world;
 	alignas(64) struct v2 reticle_pos;
+	alignas(64) struct vk_ubo_cull cull;
+};
+
+// One frame's slice of the host visible buffer.
+struct vk_host_memory
+{
+	alignas(64) struct vk_ubo_global global;
 };
 
-struct vk_ubo_instance
+// Device local output of the culling compute pass, one per frame in flight and
+// sized for that frame's instance capacity. The world pass draws indirectly
+// from draw_command, reading only the compacted visible_models.
+//
+// VOLATILE - Members are aligned to 256, the largest value the spec allows for
+// minStorageBufferOffsetAlignment, so their offsets are valid on any device.
+struct vk_cull_memory
 {
-	alignas(16) mat4 models[MAX_INSTANCES];
+	alignas(256) VkDrawIndexedIndirectCommand draw_command;
+	alignas(256) mat4 visible_models[];
 };
 
-struct vk_host_memory
+// Instance transforms, which the game writes through the render group, and the
+// cull pass's compacted copy of the visible ones. Each frame in flight has its
+// own of both, and only grows them once its fence has been waited on, so the
+// buffers being replaced are never in use.
+struct vk_instances
 {
-	alignas(64) struct vk_ubo_global global;
-	alignas(64) struct vk_ubo_instance instance;
+	// What each frame grows to when it's next used.
+	uint32_t             capacity;
+	// Most instances whose buffers fit in maxStorageBufferRange.
+	uint32_t             max_capacity;
+	uint32_t             frame_capacities[MAX_IN_FLIGHT_FRAMES];
+	// Host visible, read by the cull and trace passes as storage buffers of
+	// mat4, indexed by instance.
+	VkBuffer             buffers[MAX_IN_FLIGHT_FRAMES];
+	struct vk_allocation memory[MAX_IN_FLIGHT_FRAMES];
+	// Device local struct vk_cull_memory.
+	VkBuffer             cull_buffers[MAX_IN_FLIGHT_FRAMES];
+	struct vk_allocation cull_memory[MAX_IN_FLIGHT_FRAMES];
 };
 
 struct vk_pipeline_resources
 {
 	VkDescriptorSetLayout descriptor_layout;
 	VkDescriptorPool      descriptor_pool;
-	VkDescriptorSet       descriptor_set;
+	// One set per frame in flight, each pointing at that frame's slice of the
+	// host visible buffer.
+	VkDescriptorSet       descriptor_sets[MAX_IN_FLIGHT_FRAMES];
 	VkPipeline            pipeline;
 	VkPipelineLayout      pipeline_layout;
 };
@@ -53,11 +92,295 @@ struct vk_mesh_data
 	uint32_t buffer_offset_index;
 };
 
+// Everything a single frame in flight owns. The CPU only waits on
+// fence_in_flight when it comes back around to this slot, at which point the
+// GPU is done with the command buffer and this frame's slice of the host
+// visible buffer.
+struct vk_frame
+{
+	VkCommandBuffer command_buffer;
+	VkFence         fence_in_flight;
+	VkSemaphore     semaphore_image_available;
+	// Value of vk_context.frames_submitted when this slot was last submitted.
+	uint64_t        number;
+};
+
+// Swapchain resources replaced by a recreation while frames in flight may still
+// be using them. They're destroyed once every frame submitted before the
+// recreation has finished, i.e. once frames_completed reaches frame.
+#define VK_MAX_RETIRED 8
+// Render, depth, and the compute output images.
+#define VK_RETIRED_MAX_IMAGES (2 + MAX_IN_FLIGHT_FRAMES)
+
+struct vk_retired
+{
+	uint64_t             frame;
+	VkSwapchainKHR       swapchain;
+	VkImageView          swap_views[MAX_SWAP_IMAGES];
+	VkSemaphore          swap_semaphores[MAX_SWAP_IMAGES];
+	uint32_t             swap_views_len;
+	// Attachments and compute output images, only when they were replaced.
+	VkImage              images[VK_RETIRED_MAX_IMAGES];
+	VkImageView          image_views[VK_RETIRED_MAX_IMAGES];
+	struct vk_allocation image_memory[VK_RETIRED_MAX_IMAGES];
+	uint32_t             images_len;
+};
+
+#define VK_GRAPH_MAX_TRANSIENTS 8
+
+// Which transient images vk_graph_create_transients bound to the same memory,
+// so the graphs recorded afterwards can order each one after whatever used its
+// memory before it.
+struct vk_graph_aliases
+{
+	VkImage  images[VK_GRAPH_MAX_TRANSIENTS];
+	uint32_t groups[VK_GRAPH_MAX_TRANSIENTS];
+	uint32_t images_len;
+};
+
+// Runtime presentation and pacing settings, changed with the setters in
+// vk_pacing.c.
+struct vk_pacing
+{
+	// Requested mode. Falls back to FIFO, which is always supported, if the
+	// surface doesn't offer it.
+	VkPresentModeKHR present_mode;
+	// Requested swapchain image count, clamped to what the surface allows. 0
+	// means one more than the surface minimum.
+	uint32_t         swap_images;
+	// 0 is uncapped.
+	float            frame_cap_hz;
+	// How many frames the CPU may have submitted that the GPU hasn't finished,
+	// from 1 to MAX_IN_FLIGHT_FRAMES.
+	uint32_t         max_frames_ahead;
+	uint64_t         frame_deadline_ns;
+};
+
+// Everything a recorded frame depends on besides per-frame data that's read
+// from buffers at execution time. If the signature a command buffer was
+// recorded with still matches, it can be submitted again as is. Compared with
+// memcmp, and struct copies needn't preserve padding, so every field is sized
+// and ordered to leave none. Flags are uint32_t rather than bool for that
+// reason.
+struct vk_reuse_signature
+{
+	VkPipeline            pipeline_world;
+	VkPipeline            pipeline_reticle;
+	VkPipeline            pipeline_cull;
+	VkPipeline            pipeline_trace;
+	VkBuffer              device_local_buffer;
+	VkBuffer              instance_buffer;
+	VkBuffer              cull_buffer;
+	uint32_t              instances_capacity;
+	uint32_t              cube_indices_len;
+	uint32_t              reticle_indices_len;
+	VkExtent2D            extent;
+	VkSampleCountFlagBits samples;
+	VkImageView           render_view;
+	VkImageView           depth_view;
+	VkImageView           swap_view;
+	uint32_t              compute_output;
+	uint32_t              compute_images_generation;
+	uint32_t              gpu_profiler_enabled;
+	struct v3             clear_color;
+};
+
+// Primaries recorded once per frame slot and swapchain image and resubmitted
+// until the scene's structure changes. Everything that changes per frame, the
+// camera, the instance transforms and count, lives in buffers the recorded
+// commands read from.
+struct vk_reuse_context
+{
+	bool                      enabled;
+	VkCommandBuffer           command_buffers[MAX_IN_FLIGHT_FRAMES][MAX_SWAP_IMAGES];
+	struct vk_reuse_signature signatures[MAX_IN_FLIGHT_FRAMES][MAX_SWAP_IMAGES];
+	// What the slot's secondaries were recorded with. These don't depend on
+	// the swapchain image.
+	struct vk_reuse_signature secondaries_signatures[MAX_IN_FLIGHT_FRAMES];
+};
+
+// Multisampling quality tiers. Each asks for a fixed sample count which is
+// clamped to what the device supports, rather than whatever the device's
+// maximum happens to be.
+enum vk_msaa_quality
+{
+	VK_MSAA_QUALITY_AUTO,
+	VK_MSAA_QUALITY_OFF,
+	VK_MSAA_QUALITY_LOW,
+	VK_MSAA_QUALITY_MEDIUM,
+	VK_MSAA_QUALITY_HIGH,
+	VK_MSAA_QUALITY_LEN
+};
+
+// Auto mode starts at the highest tier and measures frame time over a window
+// of frames, stepping down a tier each window which misses the target, until
+// one meets it or it runs out of time or tiers.
+struct vk_msaa_auto
+{
+	bool                 settled;
+	enum vk_msaa_quality tier;
+	struct timespec      time_prev;
+	float                time_since_start_ms;
+	// Frames after a tier change are skipped, as the rebuild itself is a hitch.
+	uint32_t             frames_to_skip;
+	uint32_t             window_frames;
+	float                window_ms;
+};
+
+// Each pass is the span between two timestamps, so the profiler writes one
+// more timestamp than there are passes.
+enum vk_gpu_pass
+{
+	VK_GPU_PASS_CULL,
+	VK_GPU_PASS_WORLD,
+	VK_GPU_PASS_RETICLE,
+	// Everything from the end of the last draw to the end of rendering, i.e.
+	// the MSAA resolve and attachment stores.
+	VK_GPU_PASS_RESOLVE,
+	VK_GPU_PASS_LEN
+};
+
+#define VK_GPU_TIMESTAMPS_LEN (VK_GPU_PASS_LEN + 1)
+#define VK_GPU_HISTORY_LEN 128
+
+// VOLATILE - Order must match the bits in VK_GPU_STATISTICS_FLAGS, which
+// results are returned in.
+struct vk_gpu_statistics
+{
+	uint64_t vertex_invocations;
+	uint64_t clipping_primitives;
+	uint64_t fragment_invocations;
+};
+
+#define VK_GPU_STATISTICS_FLAGS \
+	(VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+	 VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+	 VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+// Rolling window of a pass's GPU time, with min/avg/p99 recomputed whenever a
+// new sample comes in. statistics only holds the latest frame's counts, and
+// only for passes which draw.
+struct vk_gpu_pass_stats
+{
+	float                    history_ms[VK_GPU_HISTORY_LEN];
+	uint32_t                 history_len;
+	uint32_t                 history_idx;
+
+	float                    min_ms;
+	float                    avg_ms;
+	float                    p99_ms;
+
+	struct vk_gpu_statistics statistics;
+};
+
+// Query pools hold one frame's worth of queries per frame in flight. A frame's
+// results are read back when its slot comes around again, after its fence has
+// signaled, so reading them never waits on the GPU.
+struct vk_gpu_profiler
+{
+	bool                     enabled;
+	bool                     statistics_enabled;
+	// Nanoseconds per timestamp tick.
+	float                    timestamp_period;
+	uint64_t                 timestamp_mask;
+
+	VkQueryPool              timestamp_pool;
+	VkQueryPool              statistics_pool;
+	bool                     frame_recorded[MAX_IN_FLIGHT_FRAMES];
+
+	struct vk_gpu_pass_stats passes[VK_GPU_PASS_LEN];
+	uint32_t                 frames_since_print;
+};
+
+#define VK_UPLOAD_BATCHES 4
+#define VK_UPLOAD_MAX_STAGING 16
+#define VK_UPLOAD_MAX_ACQUIRES 16
+
+// One submission to the upload queue. The acquire barriers are the graphics
+// queue's half of each queue family ownership transfer, recorded by vk_loop
+// once the batch has completed.
+struct vk_upload_batch
+{
+	VkCommandBuffer       command_buffer;
+	// Timeline value signaled when the batch completes.
+	uint64_t              value;
+	// Set once the graphics queue has taken ownership of everything in the
+	// batch and the staging memory is freed, meaning it can be reused.
+	bool                  acquired;
+
+	VkBuffer              staging_buffers[VK_UPLOAD_MAX_STAGING];
+	struct vk_allocation  staging_memory[VK_UPLOAD_MAX_STAGING];
+	uint32_t              staging_len;
+
+	VkBufferMemoryBarrier buffer_acquires[VK_UPLOAD_MAX_ACQUIRES];
+	uint32_t              buffer_acquires_len;
+	VkImageMemoryBarrier  image_acquires[VK_UPLOAD_MAX_ACQUIRES];
+	uint32_t              image_acquires_len;
+	VkPipelineStageFlags  acquire_stages;
+};
+
+struct vk_upload_context
+{
+	VkQueue                queue;
+	uint32_t               family_idx;
+	uint32_t               graphics_family_idx;
+	// False when the device has no queue family besides the graphics one, in
+	// which case uploads go through the graphics queue and there's no
+	// ownership to transfer.
+	bool                   dedicated;
+
+	VkCommandPool          command_pool;
+	VkSemaphore            timeline;
+	uint64_t               submitted_value;
+
+	struct vk_upload_batch batches[VK_UPLOAD_BATCHES];
+	uint32_t               batch_idx;
+	bool                   recording;
+};
+
+// Compute output path, which replaces rasterization with the trace compute
+// shader writing into a storage image that's then blitted to the swapchain.
+//
+// The images are written from scratch every frame, so only the compute to
+// graphics direction needs a queue family ownership transfer.
+#define VK_COMPUTE_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+
+struct vk_compute_context
+{
+	// True when there's a compute only queue family, in which case the trace
+	// dispatch is submitted there and can overlap the previous frame's
+	// graphics work. Otherwise it's recorded into the graphics command buffer.
+	bool                 async;
+	uint32_t             family_idx;
+	uint32_t             graphics_family_idx;
+	VkQueue              queue;
+	VkCommandPool        command_pool;
+	VkCommandBuffer      command_buffers[MAX_IN_FLIGHT_FRAMES];
+	// Signaled by the compute submit, waited on by the frame's graphics submit.
+	VkSemaphore          semaphores[MAX_IN_FLIGHT_FRAMES];
+	// Whether the swapchain images can be blitted into. Near universal, but
+	// not required by the spec.
+	bool                 blit_supported;
+
+	// One per frame in flight, sized to the swapchain, so one frame's dispatch
+	// doesn't have to wait for the previous frame's blit.
+	VkImage              images[MAX_IN_FLIGHT_FRAMES];
+	VkImageView          views[MAX_IN_FLIGHT_FRAMES];
+	struct vk_allocation memory[MAX_IN_FLIGHT_FRAMES];
+	// Bumped whenever the images are recreated. Each frame's descriptor set is
+	// rewritten when its generation falls behind, which is only safe once that
+	// frame's fence has been waited on.
+	uint32_t             images_generation;
+	uint32_t             descriptors_generation[MAX_IN_FLIGHT_FRAMES];
+};
+
 struct vk_context
 {
 	VkInstance                   instance;
 	VkPhysicalDevice             physical_device;
+	VkPhysicalDeviceProperties   physical_device_properties;
 	VkDevice                     device;
+	struct vk_allocator*         allocator;
 	VkSurfaceKHR                 surface;
 	VkSurfaceFormatKHR           surface_format;
 
@@ -68,51 +391,124 @@ struct vk_context
 	VkImage                      render_image;
 	// TODO - Can this be pulled into device_local_memory, and would that be
 	// inadvisable?
-	VkDeviceMemory               render_image_memory;
+	struct vk_allocation         render_image_memory;
+	// With a single sample the world renders straight into the swapchain image
+	// and there's no render image to resolve from.
 	VkSampleCountFlagBits        render_samples;
+	// Supported by both color and depth attachments.
+	VkSampleCountFlags           supported_samples;
+	enum vk_msaa_quality         msaa_quality;
+	struct vk_msaa_auto          msaa_auto;
+	// What the graphics pipelines were last built with, so a swapchain rebuild
+	// knows whether they need rebuilding too.
+	VkSampleCountFlagBits        pipeline_samples;
 
 	VkImageView                  depth_view;
 	VkImage                      depth_image;
-	VkDeviceMemory               depth_image_memory;
+	struct vk_allocation         depth_image_memory;
+	// What the render and depth attachments were created with. A recreation
+	// which changes neither keeps them.
+	VkExtent2D                   attachments_extent;
+	VkSampleCountFlagBits        attachments_samples;
+	struct vk_graph_aliases      graph_aliases;
 
+	// When headless there's no swapchain, and swap_images are offscreen images
+	// owned by us, one per frame in flight, each read back into the matching
+	// readback buffer.
+	bool                         headless;
 	VkSwapchainKHR               swapchain;
 	VkExtent2D                   swap_extent;
 	VkImageView                  swap_views[MAX_SWAP_IMAGES];
 	VkImage                      swap_images[MAX_SWAP_IMAGES];
+	// Signalled by the submit which renders into the matching swap image and
+	// waited on by its present. The presentation engine only lets go of a
+	// semaphore once the image comes back from acquire, so these can't be
+	// per frame in flight.
+	VkSemaphore                  semaphores_render_finished[MAX_SWAP_IMAGES];
 	uint32_t                     swap_images_len;
+	struct vk_allocation         swap_image_memory[MAX_SWAP_IMAGES];
+	VkBuffer                     readback_buffers[MAX_IN_FLIGHT_FRAMES];
+	struct vk_allocation         readback_memory[MAX_IN_FLIGHT_FRAMES];
 
+	VkPipelineCache              pipeline_cache;
+	struct asset_pack            assets;
 	struct vk_pipeline_resources pipeline_resources_world;
 	struct vk_pipeline_resources pipeline_resources_reticle;
+	struct vk_pipeline_resources pipeline_resources_cull;
+	struct vk_pipeline_resources pipeline_resources_trace;
 
 	struct vk_mesh_data          mesh_data_cube;
 	struct vk_mesh_data          mesh_data_reticle;
 
 	VkBuffer                     device_local_buffer;
-	VkDeviceMemory               device_local_memory;
+	struct vk_allocation         device_local_memory;
+
+	struct vk_instances          instances;
 
 	VkBuffer                     host_visible_buffer;
-	VkDeviceMemory               host_visible_memory;
+	struct vk_allocation         host_visible_memory;
 	void*                        host_visible_mapped;
+	// Size of one frame's slice of the host visible buffer, padded out to
+	// minUniformBufferOffsetAlignment.
+	VkDeviceSize                 host_visible_stride;
 
 	VkCommandPool                command_pool;
-	VkCommandBuffer              command_buffer;
+	// Worker threads recording the raster passes' secondary command buffers.
+	struct vk_recorder*          recorder;
+	struct vk_reuse_context      reuse;
+	struct vk_upload_context     upload;
+	// Renders through the trace compute shader instead of the raster passes.
+	bool                         compute_output;
+	struct vk_compute_context    compute;
+	struct vk_gpu_profiler       gpu_profiler;
 
-	VkSemaphore                  semaphore_image_available;
-	VkSemaphore                  semaphore_render_finished;
+	struct vk_frame              frames[MAX_IN_FLIGHT_FRAMES];
+	uint32_t                     frame_idx;
+	struct vk_pacing             pacing;
+	// What the current swapchain was actually created with.
+	VkPresentModeKHR             present_mode;
+	// Frames are numbered from 1 as they're submitted. Everything up to
+	// frames_completed is known to have finished on the GPU, since the graphics
+	// queue completes them in order.
+	uint64_t                     frames_submitted;
+	uint64_t                     frames_completed;
+	struct vk_retired            retired[VK_MAX_RETIRED];
+	uint32_t                     retired_len;
 
 	VkImage                      texture_image;
-	VkDeviceMemory               texture_memory;
+	struct vk_allocation         texture_memory;
 };
 
+// A null create_surface_callback means headless, rendering into offscreen
+// images of headless_width by headless_height.
 struct vk_platform
 {
 	VkResult(*create_surface_callback)(struct vk_context* vk, void* context);
-	void*   context;
-	char**  window_extensions;
-	uint8_t window_extensions_len;
+	void*    context;
+	char**   window_extensions;
+	uint8_t  window_extensions_len;
+	uint32_t headless_width;
+	uint32_t headless_height;
+	// Instances to make room for up front, 0 for VK_INSTANCES_DEFAULT_CAPACITY.
+	uint32_t instances_capacity;
 };
 
 
+// Written in front of the driver's pipeline cache data on disk. The cache is
+// only handed back to the driver if all of this matches the current device.
+#define PIPELINE_CACHE_MAGIC 0x76346463
+
+struct vk_pipeline_cache_header
+{
+	uint32_t magic;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t  device_uuid[VK_UUID_SIZE];
+	uint8_t  pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t data_size;
+};
+
 struct vk_create_swapchain_result
 {
 	VkSurfaceFormatKHR surface_format;
@@ -132,8 +528,14 @@ struct vk_reticle_vertex
 struct vk_descriptor_info
 {
 	VkDescriptorType type;
+	// VK_NULL_HANDLE means the current frame's slice of host_visible_buffer.
+	VkBuffer buffer;
+	// One buffer per frame in flight, used instead of buffer when set.
+	VkBuffer* frame_buffers;
 	VkDeviceSize offset_in_buffer;
 	VkDeviceSize range_in_buffer;
+	// Storage images only. One view per frame in flight, bound in GENERAL.
+	VkImageView* image_views;
 };
 
 struct vk_attribute_description
@@ -0,0 +1,406 @@
+// Uploads through a dedicated transfer queue family when the device has one,
+// falling back to the graphics queue when it doesn't.
+//
+// Uploads are recorded into batches between vk_upload_begin and
+// vk_upload_submit. Each submitted batch signals the next value on a timeline
+// semaphore, so nothing on the CPU ever waits for it unless asked to with
+// vk_upload_wait. Once vk_loop sees a batch has completed, it records the
+// queue family ownership acquire for everything in it and waits on its
+// timeline value, which by then has already been reached, so rendering never
+// stalls on an upload in progress. Resources from a batch may be used by any
+// frame recorded after vk_upload_is_complete returns true for it.
+
+void vk_upload_init(struct vk_context* vk, uint32_t family_idx, uint32_t graphics_family_idx)
+{
+	struct vk_upload_context* upload = &vk->upload;
+	memset(upload, 0, sizeof(*upload));
+
+	upload->family_idx          = family_idx;
+	upload->graphics_family_idx = graphics_family_idx;
+	upload->dedicated           = family_idx != graphics_family_idx;
+	if(upload->dedicated)
+	{
+		vkGetDeviceQueue(vk->device, family_idx, 0, &upload->queue);
+	}
+	else
+	{
+		upload->queue = vk->queue_graphics;
+	}
+
+	VkCommandPoolCreateInfo pool_info = {};
+	pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	pool_info.queueFamilyIndex = family_idx;
+	VK_VERIFY(vkCreateCommandPool(vk->device, &pool_info, 0, &upload->command_pool));
+
+	for(uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++)
+	{
+		VkCommandBufferAllocateInfo buf_info = {};
+		buf_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		buf_info.commandPool        = upload->command_pool;
+		buf_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		buf_info.commandBufferCount = 1;
+		VK_VERIFY(vkAllocateCommandBuffers(vk->device, &buf_info, &upload->batches[i].command_buffer));
+		upload->batches[i].acquired = true;
+	}
+
+	VkSemaphoreTypeCreateInfo type_info = {};
+	type_info.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue  = 0;
+
+	VkSemaphoreCreateInfo semaphore_info = {};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_info.pNext = &type_info;
+	VK_VERIFY(vkCreateSemaphore(vk->device, &semaphore_info, 0, &upload->timeline));
+}
+
+bool vk_upload_is_complete(struct vk_context* vk, uint64_t value)
+{
+	uint64_t completed = 0;
+	VK_VERIFY(vkGetSemaphoreCounterValue(vk->device, vk->upload.timeline, &completed));
+	return completed >= value;
+}
+
+// Blocks until the batch which signals value has finished. Only meant for
+// init, where the first frame needs the meshes anyway.
+void vk_upload_wait(struct vk_context* vk, uint64_t value)
+{
+	VkSemaphoreWaitInfo wait_info = {};
+	wait_info.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores    = &vk->upload.timeline;
+	wait_info.pValues        = &value;
+	VK_VERIFY(vkWaitSemaphores(vk->device, &wait_info, UINT64_MAX));
+}
+
+void vk_upload_free_staging(struct vk_context* vk, struct vk_upload_batch* batch)
+{
+	for(uint32_t i = 0; i < batch->staging_len; i++)
+	{
+		vkDestroyBuffer(vk->device, batch->staging_buffers[i], 0);
+		vk_free_memory(vk->allocator, &batch->staging_memory[i]);
+	}
+	batch->staging_len = 0;
+}
+
+void vk_upload_begin(struct vk_context* vk)
+{
+	struct vk_upload_context* upload = &vk->upload;
+	if(upload->recording)
+	{
+		printf("vk_upload_begin called while already recording an upload batch.\n");
+		PANIC();
+	}
+
+	struct vk_upload_batch* batch = &upload->batches[upload->batch_idx];
+	if(!batch->acquired)
+	{
+		printf("More than %u upload batches submitted without a frame in between.\n", VK_UPLOAD_BATCHES);
+		PANIC();
+	}
+	vk_upload_free_staging(vk, batch);
+
+	batch->buffer_acquires_len = 0;
+	batch->image_acquires_len  = 0;
+	batch->acquire_stages      = 0;
+
+	VK_VERIFY(vkResetCommandBuffer(batch->command_buffer, 0));
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_VERIFY(vkBeginCommandBuffer(batch->command_buffer, &begin_info));
+
+	upload->recording = true;
+}
+
+// Returns mapped staging memory of the given size, which the caller fills
+// before vk_upload_submit.
+void* vk_upload_stage(struct vk_context* vk, VkDeviceSize size, VkBuffer* staging_buffer)
+{
+	struct vk_upload_batch* batch = &vk->upload.batches[vk->upload.batch_idx];
+	if(!vk->upload.recording || batch->staging_len == VK_UPLOAD_MAX_STAGING)
+	{
+		printf("Upload batch isn't recording or is full.\n");
+		PANIC();
+	}
+
+	vk_allocate_buffer(
+		vk->allocator,
+		&batch->staging_buffers[batch->staging_len],
+		&batch->staging_memory[batch->staging_len],
+		size,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		0);
+
+	*staging_buffer = batch->staging_buffers[batch->staging_len];
+	void* mapped = batch->staging_memory[batch->staging_len].mapped;
+	batch->staging_len++;
+	return mapped;
+}
+
+// Records a copy into dst and returns the staging memory to fill with the
+// data. dst_access and dst_stage describe how the graphics queue will first
+// use the buffer.
+void* vk_upload_buffer(
+	struct vk_context*   vk,
+	VkBuffer             dst,
+	VkDeviceSize         dst_offset,
+	VkDeviceSize         size,
+	VkAccessFlags        dst_access,
+	VkPipelineStageFlags dst_stage)
+{
+	struct vk_upload_context* upload = &vk->upload;
+	struct vk_upload_batch* batch = &upload->batches[upload->batch_idx];
+
+	VkBuffer staging;
+	void* mapped = vk_upload_stage(vk, size, &staging);
+
+	VkBufferCopy copy = {};
+	copy.dstOffset = dst_offset;
+	copy.size      = size;
+	vkCmdCopyBuffer(batch->command_buffer, staging, dst, 1, &copy);
+
+	// Release from the transfer family. On a shared family this is an ordinary
+	// barrier which makes the copy visible to the graphics stages, and there's
+	// nothing to acquire.
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask       = upload->dedicated ? 0 : dst_access;
+	barrier.srcQueueFamilyIndex = upload->dedicated ? upload->family_idx : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = upload->dedicated ? upload->graphics_family_idx : VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = dst;
+	barrier.offset              = dst_offset;
+	barrier.size                = size;
+
+	vkCmdPipelineBarrier(
+		batch->command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		upload->dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : dst_stage,
+		0, 0, 0, 1, &barrier, 0, 0);
+
+	if(upload->dedicated)
+	{
+		if(batch->buffer_acquires_len == VK_UPLOAD_MAX_ACQUIRES)
+		{
+			printf("Too many buffer uploads in one batch.\n");
+			PANIC();
+		}
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dst_access;
+		batch->buffer_acquires[batch->buffer_acquires_len] = barrier;
+		batch->buffer_acquires_len++;
+		batch->acquire_stages |= dst_stage;
+	}
+
+	return mapped;
+}
+
+// Copies tightly packed RGBA8 pixels into a single mip, single layer image and
+// leaves it in SHADER_READ_ONLY_OPTIMAL for the fragment shader.
+void vk_upload_texture(
+	struct vk_context* vk,
+	VkImage            image,
+	uint32_t           width,
+	uint32_t           height,
+	void*              pixels)
+{
+	struct vk_upload_context* upload = &vk->upload;
+	struct vk_upload_batch* batch = &upload->batches[upload->batch_idx];
+
+	VkDeviceSize size = (VkDeviceSize)width * height * 4;
+	VkBuffer staging;
+	void* mapped = vk_upload_stage(vk, size, &staging);
+	memcpy(mapped, pixels, size);
+
+	VkImageSubresourceRange range = {};
+	range.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel   = 0;
+	range.levelCount     = 1;
+	range.baseArrayLayer = 0;
+	range.layerCount     = 1;
+
+	VkImageMemoryBarrier to_transfer = {};
+	to_transfer.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	to_transfer.srcAccessMask       = 0;
+	to_transfer.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+	to_transfer.oldLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
+	to_transfer.newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	to_transfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	to_transfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	to_transfer.image               = image;
+	to_transfer.subresourceRange    = range;
+	vkCmdPipelineBarrier(
+		batch->command_buffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, 0, 0, 0, 0, 1, &to_transfer);
+
+	VkBufferImageCopy copy = {};
+	copy.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.imageSubresource.mipLevel       = 0;
+	copy.imageSubresource.baseArrayLayer = 0;
+	copy.imageSubresource.layerCount     = 1;
+	copy.imageExtent.width               = width;
+	copy.imageExtent.height              = height;
+	copy.imageExtent.depth               = 1;
+	vkCmdCopyBufferToImage(batch->command_buffer, staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+	// The layout transition is part of the ownership transfer, and must be
+	// identical in the release and the acquire.
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask       = upload->dedicated ? 0 : VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcQueueFamilyIndex = upload->dedicated ? upload->family_idx : VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = upload->dedicated ? upload->graphics_family_idx : VK_QUEUE_FAMILY_IGNORED;
+	barrier.image               = image;
+	barrier.subresourceRange    = range;
+	vkCmdPipelineBarrier(
+		batch->command_buffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		upload->dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, 0, 0, 0, 1, &barrier);
+
+	if(upload->dedicated)
+	{
+		if(batch->image_acquires_len == VK_UPLOAD_MAX_ACQUIRES)
+		{
+			printf("Too many image uploads in one batch.\n");
+			PANIC();
+		}
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		batch->image_acquires[batch->image_acquires_len] = barrier;
+		batch->image_acquires_len++;
+		batch->acquire_stages |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	}
+}
+
+// Returns the timeline value the batch will signal when it completes.
+uint64_t vk_upload_submit(struct vk_context* vk)
+{
+	struct vk_upload_context* upload = &vk->upload;
+	struct vk_upload_batch* batch = &upload->batches[upload->batch_idx];
+
+	VK_VERIFY(vkEndCommandBuffer(batch->command_buffer));
+
+	upload->submitted_value++;
+	batch->value    = upload->submitted_value;
+	batch->acquired = false;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {};
+	timeline_info.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues    = &batch->value;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext                = &timeline_info;
+	submit_info.commandBufferCount   = 1;
+	submit_info.pCommandBuffers      = &batch->command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores    = &upload->timeline;
+	VK_VERIFY(vkQueueSubmit(upload->queue, 1, &submit_info, VK_NULL_HANDLE));
+
+	upload->recording = false;
+	upload->batch_idx = (upload->batch_idx + 1) % VK_UPLOAD_BATCHES;
+
+	return batch->value;
+}
+
+// Whether vk_upload_record_acquires would record anything, so vk_loop can skip
+// the command buffer for it when reusing the frame's.
+bool vk_upload_acquires_pending(struct vk_context* vk)
+{
+	struct vk_upload_context* upload = &vk->upload;
+
+	uint64_t completed = 0;
+	VK_VERIFY(vkGetSemaphoreCounterValue(vk->device, upload->timeline, &completed));
+
+	for(uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++)
+	{
+		struct vk_upload_batch* batch = &upload->batches[i];
+		if(!batch->acquired && batch->value <= completed)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Called by vk_loop while recording a frame. Acquires everything from batches
+// which have completed on the GPU and returns the timeline value the frame's
+// submission must wait on, or 0 if there's nothing new.
+uint64_t vk_upload_record_acquires(struct vk_context* vk, VkCommandBuffer command_buffer)
+{
+	struct vk_upload_context* upload = &vk->upload;
+
+	uint64_t completed = 0;
+	VK_VERIFY(vkGetSemaphoreCounterValue(vk->device, upload->timeline, &completed));
+
+	uint64_t wait_value = 0;
+	for(uint32_t i = 0; i < VK_UPLOAD_BATCHES; i++)
+	{
+		struct vk_upload_batch* batch = &upload->batches[i];
+		if(batch->acquired || batch->value > completed)
+		{
+			continue;
+		}
+
+		if(batch->buffer_acquires_len > 0 || batch->image_acquires_len > 0)
+		{
+			vkCmdPipelineBarrier(
+				command_buffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				batch->acquire_stages,
+				0,
+				0, 0,
+				batch->buffer_acquires_len, batch->buffer_acquires,
+				batch->image_acquires_len, batch->image_acquires);
+		}
+
+		// Completed, so the staging memory can go right away.
+		vk_upload_free_staging(vk, batch);
+		batch->acquired = true;
+		if(batch->value > wait_value)
+		{
+			wait_value = batch->value;
+		}
+	}
+	return wait_value;
+}
+
+// Textures are decoded to RGBA8 at pack time, so staging is a straight copy
+// out of the mapped asset pack. Must be called between vk_upload_begin and
+// vk_upload_submit.
+void vk_allocate_texture(
+	struct vk_context*    vk,
+	VkImage*              image,
+	struct vk_allocation* memory,
+	char*                 fname)
+{
+	struct asset_pack_entry* entry = asset_pack_find(&vk->assets, fname);
+	if(!entry || entry->type != ASSET_TYPE_TEXTURE_RGBA8)
+	{
+		printf("Failed to find texture in asset pack: %s.\n", fname);
+		PANIC();
+	}
+
+	vk_allocate_image(
+		vk->allocator,
+		image, 
+		memory,
+		entry->width,
+		entry->height,
+		VK_FORMAT_R8G8B8A8_SRGB,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+	vk_upload_texture(vk, *image, entry->width, entry->height, asset_pack_data(&vk->assets, entry));
+}
@@ -7,6 +7,13 @@
 #define XCB_A 0x0061
 #define XCB_S 0x0073
 #define XCB_D 0x0064
+#define XCB_M 0x006d
+#define XCB_P 0x0070
+#define XCB_V 0x0076
+#define XCB_F 0x0066
+#define XCB_L 0x006c
+#define XCB_C 0x0063
+#define XCB_R 0x0072
 
 #include <xcb/xcb.h>
 #include <xcb/xfixes.h>
@@ -14,7 +14,7 @@ VkResult xcb_create_surface_callback(struct vk_context* vk, void* context)
 	return vkCreateXcbSurfaceKHR(vk->instance, &info, 0, &vk->surface);
 }
 
-struct xcb_context xcb_init()
+struct xcb_context xcb_init(uint32_t cubes_len)
 {
 	struct xcb_context xcb;
 	
@@ -72,11 +72,12 @@ struct xcb_context xcb_init()
 		VK_KHR_XCB_SURFACE_EXTENSION_NAME
 	};
 
-	struct vk_platform xcb_platform;
+	struct vk_platform xcb_platform = {};
 	xcb_platform.context = &xcb;
 	xcb_platform.create_surface_callback = xcb_create_surface_callback;
 	xcb_platform.window_extensions_len = 2;
 	xcb_platform.window_extensions = window_exts;
+	xcb_platform.instances_capacity = cubes_len;
 
 	// TODO - doesn't match by the time we are making swapchain, so have to
 	// hardcode it here. Whyyyyy?
@@ -98,12 +99,13 @@ struct xcb_context xcb_init()
 
 	xcb.mouse_just_warped = false;
 	xcb.mouse_moved_yet = false;
+	xcb.frame_cap_idx = 0;
 
 	// TODO - raw memory page allocation
-	xcb.memory_pool = malloc(MEMORY_POOL_BYTES);
+	xcb.memory_pool = aligned_alloc(64, MEMORY_POOL_BYTES);
 	xcb.memory_pool_bytes = MEMORY_POOL_BYTES;
 
-	game_init(xcb.memory_pool, xcb.memory_pool_bytes);
+	game_init(xcb.memory_pool, xcb.memory_pool_bytes, time(NULL), cubes_len);
 
     if(clock_gettime(CLOCK_REALTIME, &xcb.time_prev))
     {
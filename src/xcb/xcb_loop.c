@@ -4,147 +4,207 @@ void xcb_loop(struct xcb_context* xcb)
 {
 	while(xcb->running)
 	{
+		profiler_frame_mark();
+		PROFILE_ZONE("frame");
+
+		vk_pace_frame(&xcb->vk);
+
     	input_reset_buttons(&xcb->input);
     	xcb->input.mouse_delta_x = 0;
     	xcb->input.mouse_delta_y = 0;
     	
-		xcb_generic_event_t* e;
-		while((e = xcb_poll_for_event(xcb->connection)))
 		{
-			switch(e->response_type & ~0x80)
+			PROFILE_ZONE("events");
+			xcb_generic_event_t* e;
+			while((e = xcb_poll_for_event(xcb->connection)))
 			{
-				case XCB_CONFIGURE_NOTIFY:
+				switch(e->response_type & ~0x80)
 				{
-					xcb_configure_notify_event_t* ev = (xcb_configure_notify_event_t*)e;
-					xcb->window_w = ev->width;
-					xcb->window_h = ev->height;
-
-					xcb->mouse_moved_yet = 0;
-					break;
-				}
-            	case XCB_MOTION_NOTIFY:
-                {
-                    // TODO - implement properly
-					xcb_motion_notify_event_t* ev = (xcb_motion_notify_event_t*)e;
-
-					if(!xcb->mouse_moved_yet) 
+					case XCB_CONFIGURE_NOTIFY:
 					{
-    					xcb->mouse_moved_yet = 1;
-    					xcb->input.mouse_delta_x = 0;
-    					xcb->input.mouse_delta_y = 0;
-        				xcb->input.mouse_x = ev->event_x;
-    					xcb->input.mouse_y = ev->event_y;
-    					break;
+						xcb_configure_notify_event_t* ev = (xcb_configure_notify_event_t*)e;
+						xcb->window_w = ev->width;
+						xcb->window_h = ev->height;
+
+						xcb->mouse_moved_yet = 0;
+						break;
 					}
+	            	case XCB_MOTION_NOTIFY:
+	                {
+	                    // TODO - implement properly
+						xcb_motion_notify_event_t* ev = (xcb_motion_notify_event_t*)e;
+
+						if(!xcb->mouse_moved_yet) 
+						{
+	    					xcb->mouse_moved_yet = 1;
+	    					xcb->input.mouse_delta_x = 0;
+	    					xcb->input.mouse_delta_y = 0;
+	        				xcb->input.mouse_x = ev->event_x;
+	    					xcb->input.mouse_y = ev->event_y;
+	    					break;
+						}
                     
-					if(xcb->mouse_just_warped) 
-					{
-    					xcb->mouse_just_warped = 0;
-    					break;
-					}
+						if(xcb->mouse_just_warped) 
+						{
+	    					xcb->mouse_just_warped = 0;
+	    					break;
+						}
                    
 
-					xcb->input.mouse_delta_x = ev->event_x - xcb->input.mouse_x;
-					xcb->input.mouse_delta_y = ev->event_y - xcb->input.mouse_y;
-					xcb->input.mouse_x = ev->event_x;
-					xcb->input.mouse_y = ev->event_y;
+						xcb->input.mouse_delta_x = ev->event_x - xcb->input.mouse_x;
+						xcb->input.mouse_delta_y = ev->event_y - xcb->input.mouse_y;
+						xcb->input.mouse_x = ev->event_x;
+						xcb->input.mouse_y = ev->event_y;
 
-					int32_t bounds_x = xcb->window_w / 4;
-					int32_t bounds_y = xcb->window_h / 4;
-					if(xcb->input.mouse_x < bounds_x ||
-    					xcb->input.mouse_x > xcb->window_w - bounds_x ||
-    					xcb->input.mouse_y < bounds_y ||
-    					xcb->input.mouse_y > xcb->window_h - bounds_y)
-					{
-    					xcb->mouse_just_warped = 1;
-    					xcb->input.mouse_x = xcb->window_w / 2;
-    					xcb->input.mouse_y = xcb->window_h / 2;
+						int32_t bounds_x = xcb->window_w / 4;
+						int32_t bounds_y = xcb->window_h / 4;
+						if(xcb->input.mouse_x < bounds_x ||
+	    					xcb->input.mouse_x > xcb->window_w - bounds_x ||
+	    					xcb->input.mouse_y < bounds_y ||
+	    					xcb->input.mouse_y > xcb->window_h - bounds_y)
+						{
+	    					xcb->mouse_just_warped = 1;
+	    					xcb->input.mouse_x = xcb->window_w / 2;
+	    					xcb->input.mouse_y = xcb->window_h / 2;
 
-    					xcb_warp_pointer(
-        					xcb->connection,
-        					XCB_NONE,
-        					xcb->window,
-        					0, 0, 0, 0,
-        					xcb->window_w / 2, xcb->window_h / 2);
-    					xcb_flush(xcb->connection);
+	    					xcb_warp_pointer(
+	        					xcb->connection,
+	        					XCB_NONE,
+	        					xcb->window,
+	        					0, 0, 0, 0,
+	        					xcb->window_w / 2, xcb->window_h / 2);
+	    					xcb_flush(xcb->connection);
 
+						}
+						break;
+	                }
+					case XCB_KEY_PRESS:
+					{
+						xcb_key_press_event_t* k_e = (xcb_key_press_event_t*)e;
+						xcb_keysym_t keysym = xcb_key_press_lookup_keysym(xcb->keysyms, k_e, 0);
+						switch(keysym)
+						{
+							case XCB_ESCAPE:
+							{
+								xcb->running = false;
+								break;
+							}
+	                		case XCB_W:
+	                		{
+	                    		input_button_press(&xcb->input.move_forward);
+	        					break;
+	                		}
+	                		case XCB_A:
+	                		{
+	                    		input_button_press(&xcb->input.move_left);
+	        					break;
+	                		}
+	                		case XCB_S:
+	                		{
+	                    		input_button_press(&xcb->input.move_back);
+	        					break;
+	                		}
+	                		case XCB_D:
+	                		{
+	                    		input_button_press(&xcb->input.move_right);
+	        					break;
+	                		}
+	                		case XCB_P:
+	                		{
+	                    		// First press starts recording, later ones dump the last
+	                    		// PROFILER_DUMP_FRAMES frames.
+	                    		if(!profiler.enabled)
+	                    		{
+	                        		profiler.enabled = true;
+	                        		printf("Profiler recording, press P again to dump.\n");
+	                    		}
+	                    		else
+	                    		{
+	                        		profiler_dump(PROFILER_DUMP_FNAME, PROFILER_DUMP_FRAMES);
+	                    		}
+	        					break;
+	                		}
+	                		case XCB_M:
+	                		{
+	                    		// Cycle MSAA quality, auto -> off -> low -> medium -> high.
+	                    		vk_set_msaa_quality(&xcb->vk, (xcb->vk.msaa_quality + 1) % VK_MSAA_QUALITY_LEN);
+	        					break;
+	                		}
+	                		case XCB_C:
+	                		{
+	                    		// Toggle between the raster passes and the trace compute shader.
+	                    		vk_set_compute_output(&xcb->vk, !xcb->vk.compute_output);
+	        					break;
+	                		}
+	                		case XCB_R:
+	                		{
+	                    		// Toggle between reusing recorded frames and recording every frame.
+	                    		vk_set_command_buffer_reuse(&xcb->vk, !xcb->vk.reuse.enabled);
+	        					break;
+	                		}
+	                		case XCB_V:
+	                		{
+	                    		// Cycle present mode, immediate -> mailbox -> fifo -> fifo_relaxed.
+	                    		vk_set_present_mode(&xcb->vk, (xcb->vk.pacing.present_mode + 1) % (VK_PRESENT_MODE_FIFO_RELAXED_KHR + 1));
+	        					break;
+	                		}
+	                		case XCB_F:
+	                		{
+	                    		// Cycle the frame cap through XCB_FRAME_CAPS.
+	                    		xcb->frame_cap_idx = (xcb->frame_cap_idx + 1) % XCB_FRAME_CAPS_LEN;
+	                    		vk_set_frame_cap(&xcb->vk, xcb_frame_caps[xcb->frame_cap_idx]);
+	        					break;
+	                		}
+	                		case XCB_L:
+	                		{
+	                    		// Cycle how far the CPU may run ahead, 1 to MAX_IN_FLIGHT_FRAMES.
+	                    		vk_set_max_frames_ahead(&xcb->vk, xcb->vk.pacing.max_frames_ahead % MAX_IN_FLIGHT_FRAMES + 1);
+	        					break;
+	                		}
+	                		default:
+	                    	{
+	                        	break;
+	                        }
+	            		}
+	            		break;
 					}
-					break;
-                }
-				case XCB_KEY_PRESS:
-				{
-					xcb_key_press_event_t* k_e = (xcb_key_press_event_t*)e;
-					xcb_keysym_t keysym = xcb_key_press_lookup_keysym(xcb->keysyms, k_e, 0);
-					switch(keysym)
+					case XCB_KEY_RELEASE:
 					{
-						case XCB_ESCAPE:
+						xcb_key_press_event_t* k_e = (xcb_key_press_event_t*)e;
+						xcb_keysym_t keysym = xcb_key_press_lookup_keysym(xcb->keysyms, k_e, 0);
+						switch(keysym)
 						{
-							xcb->running = false;
-							break;
-						}
-                		case XCB_W:
-                		{
-                    		input_button_press(&xcb->input.move_forward);
-        					break;
-                		}
-                		case XCB_A:
-                		{
-                    		input_button_press(&xcb->input.move_left);
-        					break;
-                		}
-                		case XCB_S:
-                		{
-                    		input_button_press(&xcb->input.move_back);
-        					break;
-                		}
-                		case XCB_D:
-                		{
-                    		input_button_press(&xcb->input.move_right);
-        					break;
-                		}
-                		default:
-                    	{
-                        	break;
-                        }
-            		}
-            		break;
-				}
-				case XCB_KEY_RELEASE:
-				{
-					xcb_key_press_event_t* k_e = (xcb_key_press_event_t*)e;
-					xcb_keysym_t keysym = xcb_key_press_lookup_keysym(xcb->keysyms, k_e, 0);
-					switch(keysym)
+	                		case XCB_W:
+	                		{
+	                    		input_button_release(&xcb->input.move_forward);
+	        					break;
+	                		}
+	                		case XCB_A:
+	                		{
+	                    		input_button_release(&xcb->input.move_left);
+	        					break;
+	                		}
+	                		case XCB_S:
+	                		{
+	                    		input_button_release(&xcb->input.move_back);
+	        					break;
+	                		}
+	                		case XCB_D:
+	                		{
+	                    		input_button_release(&xcb->input.move_right);
+	        					break;
+	                		}
+	                		default:
+	                    	{
+	                        	break;
+	                        }
+	            		}
+	            		break;
+					}
+					default:
 					{
-                		case XCB_W:
-                		{
-                    		input_button_release(&xcb->input.move_forward);
-        					break;
-                		}
-                		case XCB_A:
-                		{
-                    		input_button_release(&xcb->input.move_left);
-        					break;
-                		}
-                		case XCB_S:
-                		{
-                    		input_button_release(&xcb->input.move_back);
-        					break;
-                		}
-                		case XCB_D:
-                		{
-                    		input_button_release(&xcb->input.move_right);
-        					break;
-                		}
-                		default:
-                    	{
-                        	break;
-                        }
-            		}
-            		break;
-				}
-				default:
-				{
-					break;
+						break;
+					}
 				}
 			}
 		}
@@ -159,14 +219,18 @@ void xcb_loop(struct xcb_context* xcb)
         xcb->time_prev = time_cur;
     	xcb->time_since_start += dt;
 
-		game_loop(
-    		xcb->memory_pool,
-    		xcb->memory_pool_bytes,
-    		dt,
-    		xcb->window_w,
-    		xcb->window_h,
-    		&xcb->input,
-    		&xcb->render_group);
+		vk_begin_frame(&xcb->vk, &xcb->render_group);
+		{
+			PROFILE_ZONE("simulate");
+			game_loop(
+    			xcb->memory_pool,
+    			xcb->memory_pool_bytes,
+    			dt,
+    			xcb->window_w,
+    			xcb->window_h,
+    			&xcb->input,
+    			&xcb->render_group);
+		}
 
 		xcb->render_group.t = xcb->time_since_start / 4.0f;
 		vk_loop(&xcb->vk, &xcb->render_group);
@@ -8,10 +8,113 @@
 #include "vulkan/vk_header.h"
 #include "xcb/xcb_header.h"
 
+void print_usage()
+{
+	printf(
+		"Usage: %s [options]\n"
+		"  --profile            Record from the first frame and dump a CPU trace to %s on exit\n"
+		"  --present-mode MODE  immediate, mailbox, fifo or fifo_relaxed (default mailbox)\n"
+		"  --swap-images N      Swapchain images to ask for (default surface minimum + 1)\n"
+		"  --fps-cap HZ         Cap the frame rate (default uncapped)\n"
+		"  --frames-ahead N     Frames the CPU may run ahead of the GPU, 1 to %u (default %u)\n"
+		"  --cubes N            Cubes in the field (default %u)\n"
+		"  --threads N          Job threads, counting the main thread (default one per core)\n",
+		PROGRAM_NAME,
+		PROFILER_DUMP_FNAME,
+		MAX_IN_FLIGHT_FRAMES,
+		MAX_IN_FLIGHT_FRAMES,
+		CUBES_DEFAULT_LEN);
+}
+
 int32_t main(int32_t argc, char** argv)
 {
-	struct xcb_context xcb = xcb_init();
+	// --profile records from the first frame and dumps a trace on exit.
+	// Otherwise recording can be started at runtime with P.
+	bool profile = false;
+	// Pacing can all be changed at runtime too, with V, F and L.
+	bool             set_present_mode = false;
+	VkPresentModeKHR present_mode     = VK_PRESENT_MODE_FIFO_KHR;
+	uint32_t         swap_images      = 0;
+	float            fps_cap          = 0;
+	uint32_t         frames_ahead     = MAX_IN_FLIGHT_FRAMES;
+	uint32_t         cubes_len        = CUBES_DEFAULT_LEN;
+	uint32_t         threads_len      = 0;
+	for(int32_t i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if(strcmp(argv[i], "--profile") == 0)
+		{
+			profile = true;
+		}
+		else if(strcmp(argv[i], "--present-mode") == 0 && has_value)
+		{
+			set_present_mode = true;
+			if(!vk_present_mode_from_name(argv[++i], &present_mode))
+			{
+				print_usage();
+				return 1;
+			}
+		}
+		else if(strcmp(argv[i], "--swap-images") == 0 && has_value)
+		{
+			swap_images = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--fps-cap") == 0 && has_value)
+		{
+			fps_cap = strtof(argv[++i], 0);
+		}
+		else if(strcmp(argv[i], "--frames-ahead") == 0 && has_value)
+		{
+			frames_ahead = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--cubes") == 0 && has_value)
+		{
+			cubes_len = strtoul(argv[++i], 0, 10);
+		}
+		else if(strcmp(argv[i], "--threads") == 0 && has_value)
+		{
+			threads_len = strtoul(argv[++i], 0, 10);
+		}
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+
+	if(cubes_len == 0)
+	{
+		print_usage();
+		return 1;
+	}
+	profiler_init(profile);
+	jobs_init(threads_len);
+
+	struct xcb_context xcb = xcb_init(cubes_len);
+
+	// Applied after init, so a non-default present mode or image count
+	// recreates the swapchain once before the first frame.
+	if(set_present_mode)
+	{
+		vk_set_present_mode(&xcb.vk, present_mode);
+	}
+	vk_set_swap_images(&xcb.vk, swap_images);
+	if(fps_cap > 0)
+	{
+		vk_set_frame_cap(&xcb.vk, fps_cap);
+	}
+	if(frames_ahead != MAX_IN_FLIGHT_FRAMES)
+	{
+		vk_set_max_frames_ahead(&xcb.vk, frames_ahead);
+	}
 	xcb_loop(&xcb);
+	vk_deinit(&xcb.vk);
+	jobs_deinit();
+
+	if(profile)
+	{
+		profiler_dump(PROFILER_DUMP_FNAME, PROFILER_DUMP_FRAMES);
+	}
 
 	return 0;
 }
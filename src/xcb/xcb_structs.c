@@ -1,3 +1,7 @@
+// Frame caps cycled through with F, in Hz. 0 is uncapped.
+#define XCB_FRAME_CAPS_LEN 5
+float xcb_frame_caps[XCB_FRAME_CAPS_LEN] = {0, 30, 60, 120, 144};
+
 struct xcb_context 
 {
 	bool                running;
@@ -13,6 +17,7 @@ struct xcb_context
 	xcb_key_symbols_t*  keysyms;
 	bool 				mouse_just_warped;
 	bool				mouse_moved_yet;
+	uint32_t            frame_cap_idx;
 
 	struct game_memory* memory_pool;
 	size_t 				memory_pool_bytes;